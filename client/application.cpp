@@ -543,9 +543,14 @@ void application::initialize_vulkan()
 	        .pQueuePriorities = &queuePriority,
 	};
 
-	vk::PhysicalDeviceFeatures device_features{
-	        .shaderClipDistance = true,
+	// Enable all supported compressed texture formats, they are used when transcoding Basis Universal textures
+	vk::PhysicalDeviceFeatures supported_features = vk_physical_device.getFeatures();
+	physical_device_features = vk::PhysicalDeviceFeatures{
 	        // .samplerAnisotropy = true,
+	        .textureCompressionETC2 = supported_features.textureCompressionETC2,
+	        .textureCompressionASTC_LDR = supported_features.textureCompressionASTC_LDR,
+	        .textureCompressionBC = supported_features.textureCompressionBC,
+	        .shaderClipDistance = true,
 	};
 
 	vk::StructureChain device_create_info{
@@ -554,7 +559,7 @@ void application::initialize_vulkan()
 	                .pQueueCreateInfos = &queueCreateInfo,
 	                .enabledExtensionCount = (uint32_t)vk_device_extensions.size(),
 	                .ppEnabledExtensionNames = vk_device_extensions.data(),
-	                .pEnabledFeatures = &device_features,
+	                .pEnabledFeatures = &physical_device_features,
 	        },
 #ifdef __ANDROID__
 	        vk::PhysicalDeviceSamplerYcbcrConversionFeaturesKHR{
@@ -28,6 +28,7 @@
 #endif
 
 #include "utils/singleton.h"
+#include "utils/thread_pool.h"
 #include "vk/vk_allocator.h"
 #include "xr/xr.h"
 #include <atomic>
@@ -111,6 +112,8 @@ class application : public singleton<application>
 	vk::raii::CommandPool vk_cmdpool = nullptr;
 	vk::raii::PipelineCache pipeline_cache = nullptr;
 	vk::PhysicalDeviceProperties physical_device_properties;
+	// Features enabled on vk_device
+	vk::PhysicalDeviceFeatures physical_device_features;
 
 	// Vulkan memory allocator stuff
 	std::optional<vk_allocator> allocator;
@@ -148,6 +151,9 @@ class application : public singleton<application>
 
 	std::shared_ptr<wifi_lock> wifi;
 
+	// Worker threads for asset loading
+	utils::thread_pool workers;
+
 	std::mutex server_intent_mutex;
 	std::optional<wivrn_discover::service> server_intent;
 
@@ -309,6 +315,11 @@ public:
 		return *instance().wifi;
 	}
 
+	static utils::thread_pool & get_thread_pool()
+	{
+		return instance().workers;
+	}
+
 	static void ignore_debug_reports_for(void * object)
 	{
 #ifndef NDEBUG
@@ -378,6 +389,11 @@ public:
 		return instance().physical_device_properties;
 	}
 
+	static const vk::PhysicalDeviceFeatures & get_physical_device_features()
+	{
+		return instance().physical_device_features;
+	}
+
 	static vk::raii::Device & get_device()
 	{
 		return instance().vk_device;
@@ -162,6 +162,8 @@ configuration::configuration(xr::system & system)
 			                .txt = {{"cookie", (std::string)i["cookie"]}}
 
 			        }};
+			if (auto val = i["last_address"]; val.is_string())
+				data.last_address = (std::string)val;
 			servers.emplace(data.service.txt["cookie"], data);
 		}
 
@@ -215,7 +217,8 @@ void configuration::save()
 
 	for (auto & [cookie, server_data]: servers)
 	{
-		if (server_data.autoconnect or server_data.manual)
+		// Discovered servers are kept when they have a known address so that they can be reached without mDNS
+		if (server_data.autoconnect or server_data.manual or not server_data.last_address.empty())
 		{
 			ss << "{";
 			ss << "\"autoconnect\":" << std::boolalpha << server_data.autoconnect << ",";
@@ -224,6 +227,8 @@ void configuration::save()
 			ss << "\"hostname\":" << json_string(server_data.service.hostname) << ",";
 			ss << "\"port\":" << server_data.service.port << ",";
 			ss << "\"tcp_only\":" << std::boolalpha << server_data.service.tcp_only << ",";
+			if (not server_data.last_address.empty())
+				ss << "\"last_address\":" << json_string(server_data.last_address) << ",";
 			ss << "\"cookie\":" << json_string(cookie);
 			ss << "},";
 		}
@@ -41,6 +41,9 @@ public:
 		bool visible;
 		bool compatible;
 
+		// Address of the last successful connection, tried first on the next one
+		std::string last_address;
+
 		wivrn_discover::service service;
 	};
 
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <array>
+#include <chrono>
 #include <cstdint>
 #include <glm/glm.hpp>
 #include <imgui.h>
@@ -90,6 +91,13 @@ constexpr float recenter_action_distance = 0.3;
 // Default distance between the headset and the GUI, when the GUI is first shown, when the session state changes, when the lobby is refocused
 constexpr float initial_gui_distance = 0.5;
 
+// Delay without any GUI change before switching to the lowest refresh rate, in nanoseconds
+constexpr XrDuration idle_delay = 30'000'000'000;
+
+// Head motion below which the previous projection layers are resubmitted instead of rendering new ones, the runtime reprojects them
+constexpr float rerender_position_threshold = 0.001; // In metres
+constexpr float rerender_angle_threshold = 0.0017;   // In radians, about 0.1°
+
 // Skybox color
 constexpr std::array<float, 4> sky_color = {0, 0.25, 0.5, 1};
 
@@ -105,6 +113,25 @@ constexpr int zindex_controllers = 1;
 constexpr int zindex_recenter_tip = 2;
 } // namespace constants::lobby
 
+namespace constants::stream
+{
+// How long a lost connection is retried before going back to the lobby
+constexpr std::chrono::seconds resume_timeout{10};
+
+// Delay between reconnection attempts
+constexpr std::chrono::milliseconds resume_retry_delay{200};
+
+// Analog inputs are only sent when they move by more than this
+constexpr float input_deadband = 0.005;
+
+// Changed inputs are sent again in this many packets, so that a short click
+// is not lost with a single packet
+constexpr int input_repeats = 3;
+
+// All inputs are sent at this interval, in case a packet was lost
+constexpr XrDuration input_keyframe_interval = 200'000'000;
+} // namespace constants::stream
+
 namespace constants::style
 {
 constexpr ImVec2 window_padding = {20, 20};
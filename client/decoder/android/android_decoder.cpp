@@ -32,6 +32,7 @@
 #include <ranges>
 #include <spdlog/spdlog.h>
 #include <thread>
+#include <utility>
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_android.h>
 #include <vulkan/vulkan_raii.hpp>
@@ -154,7 +155,7 @@ decoder::decoder(
 				        if (jobs.pop()())
 					        return;
 			        }
-			        catch (const utils::sync_queue_closed & e)
+			        catch (const utils::queue_closed & e)
 			        {
 				        return;
 			        }
@@ -171,7 +172,8 @@ decoder::~decoder()
 	if (media_codec)
 	{
 		AMediaCodec_stop(media_codec.get());
-		jobs.push([]() { return true; });
+		if (not jobs.push([]() { return true; }))
+			jobs.close();
 		if (worker.joinable())
 			worker.join();
 	}
@@ -181,7 +183,10 @@ decoder::~decoder()
 	if (worker.joinable())
 		worker.join();
 
-	spdlog::info("decoder::~decoder");
+	auto stats = jobs.get_stats();
+	spdlog::info("decoder::~decoder, jobs: max depth {}, {} rejected",
+	             stats.max_depth,
+	             stats.dropped);
 }
 
 void decoder::push_data(std::span<std::span<const uint8_t>> data, uint64_t frame_index, bool partial)
@@ -210,7 +215,7 @@ void decoder::push_data(std::span<std::span<const uint8_t>> data, uint64_t frame
 	if (partial)
 		return;
 
-	jobs.push([=, idx = current_input_buffer.idx, data_size = current_input_buffer.data_size, mc = media_codec.get()]() {
+	bool queued = jobs.push([=, idx = current_input_buffer.idx, data_size = current_input_buffer.data_size, mc = media_codec.get()]() {
 		uint64_t timestamp = frame_index * 10'000;
 		auto status = AMediaCodec_queueInputBuffer(mc, idx, 0, data_size, timestamp, 0);
 		if (status != AMEDIA_OK)
@@ -219,6 +224,13 @@ void decoder::push_data(std::span<std::span<const uint8_t>> data, uint64_t frame
 			              std::string(magic_enum::enum_name(status)).c_str());
 		return false;
 	});
+	if (not queued)
+	{
+		// Keep the input buffer for the next frame
+		spdlog::warn("Decoder job queue full, dropping frame {}", frame_index);
+		current_input_buffer.data_size = 0;
+		return;
+	}
 	current_input_buffer = input_buffer{};
 }
 
@@ -267,9 +279,13 @@ void decoder::on_image_available(AImageReader * reader)
 		check(AImage_getTimestamp(image.get(), &fake_timestamp_ns), "AImage_getTimestamp");
 		uint64_t frame_index = (fake_timestamp_ns + 5'000'000) / (10'000'000);
 
-		frame_infos.drop_until([frame_index](auto & x) { return x.feedback.frame_index >= frame_index; });
+		// Skip the information of frames which were not decoded, keep the ones of later frames
+		while (not next_frame_info or next_frame_info->feedback.frame_index < frame_index)
+			next_frame_info = frame_infos.pop();
 
-		auto info = frame_infos.pop_if([frame_index](auto & x) { return x.feedback.frame_index == frame_index; });
+		std::optional<frame_info> info;
+		if (next_frame_info->feedback.frame_index == frame_index)
+			info = std::exchange(next_frame_info, std::nullopt);
 
 		if (!info)
 		{
@@ -486,16 +502,17 @@ void decoder::on_media_input_available(AMediaCodec * media_codec, void * userdat
 	auto self = (decoder *)userdata;
 	size_t size;
 	uint8_t * buffer = AMediaCodec_getInputBuffer(media_codec, index, &size);
-	self->input_buffers.push({
-	        .idx = index,
-	        .capacity = size,
-	        .data = buffer,
-	});
+	if (not self->input_buffers.push({
+	            .idx = index,
+	            .capacity = size,
+	            .data = buffer,
+	    }))
+		spdlog::warn("Decoder input buffer queue full, input buffer {} is not used", index);
 }
 void decoder::on_media_output_available(AMediaCodec * media_codec, void * userdata, int32_t index, AMediaCodecBufferInfo * bufferInfo)
 {
 	auto self = (decoder *)userdata;
-	self->jobs.push([=]() {
+	bool queued = self->jobs.push([=]() {
 		auto status = AMediaCodec_releaseOutputBuffer(media_codec, index, true);
 		// will trigger on_image_available through ImageReader
 		if (status != AMEDIA_OK)
@@ -504,6 +521,12 @@ void decoder::on_media_output_available(AMediaCodec * media_codec, void * userda
 			              std::string(magic_enum::enum_name(status)).c_str());
 		return false;
 	});
+	if (not queued)
+	{
+		// Give the buffer back to the codec without rendering it
+		spdlog::warn("Decoder job queue full, dropping decoded frame");
+		AMediaCodec_releaseOutputBuffer(media_codec, index, false);
+	}
 }
 
 void decoder::blit_handle::deleter::operator()(AImage * aimage)
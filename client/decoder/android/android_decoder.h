@@ -19,10 +19,11 @@
 
 #pragma once
 
-#include "utils/sync_queue.h"
+#include "utils/mpmc_queue.h"
 #include "wivrn_packets.h"
 #include <functional>
 #include <memory>
+#include <optional>
 #include <span>
 #include <thread>
 #include <unordered_map>
@@ -115,9 +116,11 @@ private:
 		uint8_t * data = nullptr;
 	};
 
-	utils::sync_queue<input_buffer> input_buffers;
+	// Filled from the MediaCodec callback thread, which must not block. They hold
+	// at most one item per codec buffer, codecs have far fewer than 64 buffers.
+	utils::mpmc_queue<input_buffer, 64, utils::overflow_policy::reject> input_buffers;
 	input_buffer current_input_buffer; // Only accessed in network thread
-	utils::sync_queue<std::function<bool(void)>> jobs;
+	utils::mpmc_queue<std::function<bool(void)>, 64, utils::overflow_policy::reject> jobs;
 
 	struct frame_info
 	{
@@ -125,7 +128,9 @@ private:
 		wivrn::to_headset::video_stream_data_shard::timing_info_t timing_info;
 		wivrn::to_headset::video_stream_data_shard::view_info_t view_info;
 	};
-	utils::sync_queue<frame_info> frame_infos;
+	// Frames which are not decoded yet, older ones are useless once the queue is full
+	utils::mpmc_queue<frame_info, 32, utils::overflow_policy::drop_oldest> frame_infos;
+	std::optional<frame_info> next_frame_info; // Only accessed in image reader thread
 
 	std::thread worker;
 	static void on_media_error(AMediaCodec *, void * userdata, media_status_t error, int32_t actionCode, const char * detail);
@@ -80,6 +80,14 @@ public:
 		return add(alignment, data_to_add);
 	}
 
+	template <typename T>
+	size_t add_indices(const std::vector<T> & indices)
+	{
+		usage |= vk::BufferUsageFlagBits::eIndexBuffer;
+
+		return add(4, indices);
+	}
+
 	size_t add_indices(const fastgltf::Accessor & accessor)
 	{
 		usage |= vk::BufferUsageFlagBits::eIndexBuffer;
@@ -19,6 +19,9 @@
 
 #include "image_loader.h"
 
+#include "application.h"
+#include "utils/files.h"
+#include <chrono>
 #include <cstdint>
 #include <ktxvulkan.h>
 #include <memory>
@@ -153,6 +156,132 @@ int bytes_per_pixel(vk::Format format)
 
 	__builtin_unreachable();
 }
+
+ktx_transcode_fmt_e choose_transcode_format(const vk::PhysicalDeviceFeatures & features)
+{
+	if (features.textureCompressionASTC_LDR)
+		return KTX_TTF_ASTC_4x4_RGBA;
+
+	if (features.textureCompressionBC)
+		return KTX_TTF_BC7_RGBA;
+
+	if (features.textureCompressionETC2)
+		return KTX_TTF_ETC2_RGBA;
+
+	return KTX_TTF_RGBA32;
+}
+
+// Basis Universal textures are transcoded once and cached on disk, keyed by the hash of the KTX2
+// file and the target format
+const std::array<char, 8> transcode_cache_magic{'W', 'i', 'V', 'R', 'n', 'T', 'X', '1'};
+
+struct transcode_cache_header
+{
+	std::array<char, 8> magic;
+	uint32_t vk_format;
+	uint32_t base_width;
+	uint32_t base_height;
+	uint32_t base_depth;
+	uint32_t num_dimensions;
+	uint32_t num_levels;
+	uint32_t num_layers;
+	uint32_t num_faces;
+	uint32_t is_array;
+	// Explicit so that no uninitialized byte is written to the file
+	uint32_t padding = 0;
+	uint64_t data_size;
+};
+static_assert(sizeof(transcode_cache_header) == 56);
+
+std::filesystem::path transcode_cache_path(std::span<const std::byte> bytes, ktx_transcode_fmt_e format)
+{
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325;
+	for (std::byte b: bytes)
+	{
+		hash ^= uint8_t(b);
+		hash *= 0x100000001b3;
+	}
+
+	return application::get_cache_path() / "textures" / fmt::format("{:016x}-{}.bin", hash, (int)format);
+}
+
+ktxTexture2 * load_transcode_cache(const std::filesystem::path & path)
+{
+	std::vector<std::byte> file;
+	try
+	{
+		file = utils::read_whole_file<std::byte>(path);
+	}
+	catch (...)
+	{
+		return nullptr;
+	}
+
+	transcode_cache_header header;
+	if (file.size() < sizeof(header))
+		return nullptr;
+
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != transcode_cache_magic or file.size() != sizeof(header) + header.data_size)
+		return nullptr;
+
+	ktxTextureCreateInfo info{};
+	info.vkFormat = header.vk_format;
+	info.baseWidth = header.base_width;
+	info.baseHeight = header.base_height;
+	info.baseDepth = header.base_depth;
+	info.numDimensions = header.num_dimensions;
+	info.numLevels = header.num_levels;
+	info.numLayers = header.num_layers;
+	info.numFaces = header.num_faces;
+	info.isArray = header.is_array;
+	info.generateMipmaps = false;
+
+	ktxTexture2 * texture;
+	if (ktxTexture2_Create(&info, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture) != KTX_SUCCESS)
+		return nullptr;
+
+	if (texture->dataSize != header.data_size)
+	{
+		ktxTexture_Destroy(reinterpret_cast<ktxTexture *>(texture));
+		return nullptr;
+	}
+
+	memcpy(texture->pData, file.data() + sizeof(header), header.data_size);
+	return texture;
+}
+
+void save_transcode_cache(const std::filesystem::path & path, ktxTexture2 * texture)
+{
+	transcode_cache_header header{
+	        .magic = transcode_cache_magic,
+	        .vk_format = texture->vkFormat,
+	        .base_width = texture->baseWidth,
+	        .base_height = texture->baseHeight,
+	        .base_depth = texture->baseDepth,
+	        .num_dimensions = texture->numDimensions,
+	        .num_levels = texture->numLevels,
+	        .num_layers = texture->numLayers,
+	        .num_faces = texture->numFaces,
+	        .is_array = texture->isArray,
+	        .data_size = texture->dataSize,
+	};
+
+	std::vector<std::byte> file(sizeof(header) + texture->dataSize);
+	memcpy(file.data(), &header, sizeof(header));
+	memcpy(file.data() + sizeof(header), texture->pData, texture->dataSize);
+
+	try
+	{
+		std::filesystem::create_directories(path.parent_path());
+		utils::write_whole_file(path, file);
+	}
+	catch (std::exception & e)
+	{
+		spdlog::warn("Cannot write transcoded texture to {}: {}", path.native(), e.what());
+	}
+}
 } // namespace
 
 image_loader::image_loader(vk::raii::PhysicalDevice physical_device, vk::raii::Device & device, vk::raii::Queue & queue, vk::raii::CommandPool & cb_pool) :
@@ -410,7 +539,32 @@ void image_loader::do_load_ktx(std::span<const std::byte> bytes)
 
 	if (ktxTexture_NeedsTranscoding(texture))
 	{
-		// TODO
+		ktx_transcode_fmt_e target = choose_transcode_format(application::get_physical_device_features());
+		auto cache_path = transcode_cache_path(bytes, target);
+
+		if (ktxTexture2 * cached = load_transcode_cache(cache_path))
+		{
+			spdlog::debug("Loaded transcoded texture from {}", cache_path.native());
+			ktxTexture_Destroy(texture);
+			texture = reinterpret_cast<ktxTexture *>(cached);
+		}
+		else
+		{
+			auto start = std::chrono::steady_clock::now();
+			err = ktxTexture2_TranscodeBasis(reinterpret_cast<ktxTexture2 *>(texture), target, 0);
+			if (err != KTX_SUCCESS)
+			{
+				ktxTexture_Destroy(texture);
+				spdlog::info("ktxTexture2_TranscodeBasis: error {}", (int)err);
+				throw std::runtime_error("ktxTexture2_TranscodeBasis");
+			}
+
+			spdlog::info("Transcoded texture to {} in {:.1f}ms",
+			             ktxTranscodeFormatString(target),
+			             std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+			save_transcode_cache(cache_path, reinterpret_cast<ktxTexture2 *>(texture));
+		}
 	}
 
 	err = ktxTexture_VkUploadEx(texture, vdi, &vk_texture, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -458,54 +612,69 @@ static constexpr bool starts_with(std::span<const std::byte> data, std::span<con
 	return data.size() >= prefix.size() && !memcmp(data.data(), prefix.data(), prefix.size());
 }
 
-// Load a PNG/JPEG/KTX2 file
-void image_loader::load(std::span<const std::byte> bytes, bool srgb)
+bool image_loader::is_ktx(std::span<const std::byte> bytes)
 {
 	const uint8_t ktx1_magic[] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
 	const uint8_t ktx2_magic[] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
 
-	if (starts_with(bytes, ktx1_magic) || starts_with(bytes, ktx2_magic))
+	return starts_with(bytes, ktx1_magic) || starts_with(bytes, ktx2_magic);
+}
+
+// Decode a PNG/JPEG file
+image_loader::cpu_image image_loader::decode(std::span<const std::byte> bytes, bool srgb)
+{
+	const stbi_uc * image_data = (const stbi_uc *)bytes.data();
+	size_t image_size = bytes.size();
+
+	int w, h, num_channels, channels_in_file;
+	cpu_image image;
+
+	if (!stbi_info_from_memory(image_data, image_size, &w, &h, &num_channels))
+		throw std::runtime_error("Unsupported image format");
+
+	assert(num_channels >= 1 && num_channels <= 4);
+
+	if (num_channels == 3)
+		num_channels = 4;
+
+	if (stbi_is_hdr_from_memory(image_data, image_size))
 	{
-		do_load_ktx(bytes);
+		image.pixels = stbi_ptr(stbi_loadf_from_memory(image_data, image_size, &w, &h, &channels_in_file, num_channels));
+		image.format = get_format<float>(num_channels);
+	}
+	else if (stbi_is_16_bit_from_memory(image_data, image_size))
+	{
+		image.pixels = stbi_ptr(stbi_load_16_from_memory(image_data, image_size, &w, &h, &channels_in_file, num_channels));
+		image.format = get_format<uint16_t>(num_channels);
 	}
 	else
 	{
-		const stbi_uc * image_data = (const stbi_uc *)bytes.data();
-		size_t image_size = bytes.size();
-
-		int w, h, num_channels, channels_in_file;
-		stbi_ptr pixels;
-
-		if (!stbi_info_from_memory(image_data, image_size, &w, &h, &num_channels))
-			throw std::runtime_error("Unsupported image format");
+		image.pixels = stbi_ptr(stbi_load_from_memory(image_data, image_size, &w, &h, &channels_in_file, num_channels));
+		image.format = srgb ? get_format_srgb(num_channels) : get_format<uint8_t>(num_channels);
+	}
 
-		assert(num_channels >= 1 && num_channels <= 4);
+	if (!image.pixels)
+		throw std::runtime_error(std::string("Cannot decode image: ") + stbi_failure_reason());
 
-		if (num_channels == 3)
-			num_channels = 4;
+	image.extent.width = w;
+	image.extent.height = h;
+	image.extent.depth = 1;
 
-		if (stbi_is_hdr_from_memory(image_data, image_size))
-		{
-			pixels = stbi_ptr(stbi_loadf_from_memory(image_data, image_size, &w, &h, &channels_in_file, num_channels));
-			format = get_format<float>(num_channels);
-		}
-		else if (stbi_is_16_bit_from_memory(image_data, image_size))
-		{
-			pixels = stbi_ptr(stbi_load_16_from_memory(image_data, image_size, &w, &h, &channels_in_file, num_channels));
-			format = get_format<uint16_t>(num_channels);
-		}
-		else
-		{
-			pixels = stbi_ptr(stbi_load_from_memory(image_data, image_size, &w, &h, &channels_in_file, num_channels));
-			format = srgb ? get_format_srgb(num_channels) : get_format<uint8_t>(num_channels);
-		}
+	return image;
+}
 
-		extent.width = w;
-		extent.height = h;
-		extent.depth = 1;
+// Load a PNG/JPEG/KTX2 file
+void image_loader::load(std::span<const std::byte> bytes, bool srgb)
+{
+	if (is_ktx(bytes))
+		do_load_ktx(bytes);
+	else
+		load(decode(bytes, srgb));
+}
 
-		do_load_raw(pixels.get(), extent, format);
-	}
+void image_loader::load(const cpu_image & image)
+{
+	do_load_raw(image.pixels.get(), image.extent, image.format);
 }
 
 // Load raw pixel data
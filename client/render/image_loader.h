@@ -42,11 +42,27 @@ struct image_loader
 
 	uint32_t num_mipmaps;
 
+	// Image decoded in CPU memory, decoding does not use Vulkan and can be done on any thread
+	struct cpu_image
+	{
+		std::shared_ptr<void> pixels;
+		vk::Extent3D extent;
+		vk::Format format;
+	};
+
 	image_loader(vk::raii::PhysicalDevice physical_device, vk::raii::Device & device, vk::raii::Queue & queue, vk::raii::CommandPool & cb_pool);
 
+	static bool is_ktx(std::span<const std::byte> bytes);
+
+	// Decode a PNG/JPEG file
+	static cpu_image decode(std::span<const std::byte> bytes, bool srgb);
+
 	// Load a PNG/JPEG/KTX2 file
 	void load(std::span<const std::byte> bytes, bool srgb);
 
+	// Load an image returned by decode
+	void load(const cpu_image & image);
+
 	// Load raw pixel data
 	void load(const void * pixels, size_t size, vk::Extent3D extent, vk::Format format);
 
@@ -25,15 +25,20 @@
 #include "image_loader.h"
 #include "openxr/openxr.h"
 #include "utils/ranges.h"
+#include "vk/pipeline.h"
+#include "vk/shader.h"
 #include "vulkan/vulkan_enums.hpp"
 #include "vulkan/vulkan_handles.hpp"
 #include "vulkan/vulkan_to_string.hpp"
 #include "xr/space.h"
 #include <algorithm>
 #include <backends/imgui_impl_vulkan.h>
+#include <bit>
 #include <boost/locale.hpp>
 #include <cmath>
 #include <cstddef>
+#include <cstring>
+#include <functional>
 #include <glm/gtc/matrix_access.hpp>
 #include <imgui.h>
 #include <imgui_internal.h>
@@ -367,6 +372,7 @@ imgui_context::imgui_context(vk::raii::PhysicalDevice physical_device, vk::raii:
 	ImGui::SetCurrentContext(context);
 	ImPlot::SetCurrentContext(plot_context);
 	ImGui_ImplVulkan_Init(&init_info);
+	create_pipeline();
 
 	initialize_fonts();
 
@@ -382,6 +388,230 @@ imgui_context::imgui_context(vk::raii::PhysicalDevice physical_device, vk::raii:
 	style.Colors[ImGuiCol_ModalWindowDimBg] = {0, 0, 0, 0};
 }
 
+// The ImGui Vulkan backend is only used for the font texture, the draw data is rendered here so
+// that the vertex and index buffers can be kept mapped and reused between frames
+void imgui_context::create_pipeline()
+{
+	vk::PushConstantRange push_constant_range{
+	        .stageFlags = vk::ShaderStageFlagBits::eVertex,
+	        .offset = 0,
+	        .size = 4 * sizeof(float),
+	};
+
+	vk::PipelineLayoutCreateInfo pipeline_layout_info;
+	pipeline_layout_info.setSetLayouts(*ds_layout);
+	pipeline_layout_info.setPushConstantRanges(push_constant_range);
+
+	pipeline_layout = vk::raii::PipelineLayout(device, pipeline_layout_info);
+
+	vk::raii::ShaderModule vertex_shader = load_shader(device, "imgui.vert");
+	vk::raii::ShaderModule fragment_shader = load_shader(device, "imgui.frag");
+
+	vk::pipeline_builder pipeline_info{
+	        .flags = {},
+	        .Stages = {
+	                {
+	                        .stage = vk::ShaderStageFlagBits::eVertex,
+	                        .module = *vertex_shader,
+	                        .pName = "main",
+	                },
+	                {
+	                        .stage = vk::ShaderStageFlagBits::eFragment,
+	                        .module = *fragment_shader,
+	                        .pName = "main",
+	                },
+	        },
+	        .VertexBindingDescriptions = {
+	                vk::VertexInputBindingDescription{
+	                        .binding = 0,
+	                        .stride = sizeof(ImDrawVert),
+	                        .inputRate = vk::VertexInputRate::eVertex,
+	                },
+	        },
+	        .VertexAttributeDescriptions = {
+	                vk::VertexInputAttributeDescription{
+	                        .location = 0,
+	                        .binding = 0,
+	                        .format = vk::Format::eR32G32Sfloat,
+	                        .offset = offsetof(ImDrawVert, pos),
+	                },
+	                vk::VertexInputAttributeDescription{
+	                        .location = 1,
+	                        .binding = 0,
+	                        .format = vk::Format::eR32G32Sfloat,
+	                        .offset = offsetof(ImDrawVert, uv),
+	                },
+	                vk::VertexInputAttributeDescription{
+	                        .location = 2,
+	                        .binding = 0,
+	                        .format = vk::Format::eR8G8B8A8Unorm,
+	                        .offset = offsetof(ImDrawVert, col),
+	                },
+	        },
+	        .InputAssemblyState = {{
+	                .topology = vk::PrimitiveTopology::eTriangleList,
+	        }},
+	        .Viewports = {{}},
+	        .Scissors = {{}},
+	        .RasterizationState = {{
+	                .polygonMode = vk::PolygonMode::eFill,
+	                .cullMode = vk::CullModeFlagBits::eNone,
+	                .frontFace = vk::FrontFace::eCounterClockwise,
+	                .lineWidth = 1,
+	        }},
+	        .MultisampleState = {{
+	                .rasterizationSamples = vk::SampleCountFlagBits::e1,
+	        }},
+	        .ColorBlendState = {.flags = {}},
+	        .ColorBlendAttachments = {{
+	                .blendEnable = true,
+	                .srcColorBlendFactor = vk::BlendFactor::eSrcAlpha,
+	                .dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+	                .colorBlendOp = vk::BlendOp::eAdd,
+	                .srcAlphaBlendFactor = vk::BlendFactor::eOne,
+	                .dstAlphaBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+	                .alphaBlendOp = vk::BlendOp::eAdd,
+	                .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+	        }},
+	        .DynamicStates = {
+	                vk::DynamicState::eViewport,
+	                vk::DynamicState::eScissor,
+	        },
+	        .layout = *pipeline_layout,
+	        .renderPass = *renderpass,
+	        .subpass = 0,
+	};
+
+	pipeline = vk::raii::Pipeline(device, application::get_pipeline_cache(), pipeline_info);
+}
+
+void imgui_context::reserve(buffer_allocation & buffer, size_t size, vk::BufferUsageFlags usage)
+{
+	if (buffer and buffer.info().size >= size)
+		return;
+
+	// Grow geometrically to avoid reallocating every time a window is added
+	buffer = buffer_allocation{
+	        device,
+	        vk::BufferCreateInfo{
+	                .size = std::bit_ceil(std::max<size_t>(size, 65536)),
+	                .usage = usage,
+	        },
+	        VmaAllocationCreateInfo{
+	                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+	                .usage = VMA_MEMORY_USAGE_AUTO,
+	        },
+	        "imgui_context::reserve"};
+}
+
+void imgui_context::setup_render_state(const ImDrawData & draw_data, command_buffer & cb)
+{
+	cb.command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline);
+
+	if (draw_data.TotalVtxCount > 0)
+	{
+		cb.command_buffer.bindVertexBuffers(0, (vk::Buffer)cb.vertex_buffer, (vk::DeviceSize)0);
+		cb.command_buffer.bindIndexBuffer((vk::Buffer)cb.index_buffer, 0, sizeof(ImDrawIdx) == 2 ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+	}
+
+	cb.command_buffer.setViewport(0, vk::Viewport{
+	                                         .x = 0,
+	                                         .y = 0,
+	                                         .width = draw_data.DisplaySize.x * draw_data.FramebufferScale.x,
+	                                         .height = draw_data.DisplaySize.y * draw_data.FramebufferScale.y,
+	                                         .minDepth = 0,
+	                                         .maxDepth = 1,
+	                                 });
+
+	std::array<float, 4> scale_translate{
+	        2.0f / draw_data.DisplaySize.x,
+	        2.0f / draw_data.DisplaySize.y,
+	        -1.0f - draw_data.DisplayPos.x * 2.0f / draw_data.DisplaySize.x,
+	        -1.0f - draw_data.DisplayPos.y * 2.0f / draw_data.DisplaySize.y,
+	};
+	cb.command_buffer.pushConstants<std::array<float, 4>>(*pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, scale_translate);
+}
+
+void imgui_context::render_draw_data(const ImDrawData & draw_data, command_buffer & cb)
+{
+	int fb_width = draw_data.DisplaySize.x * draw_data.FramebufferScale.x;
+	int fb_height = draw_data.DisplaySize.y * draw_data.FramebufferScale.y;
+	if (fb_width <= 0 or fb_height <= 0)
+		return;
+
+	// All lists share the same buffers, the fence of this command buffer has been waited for so
+	// they are not in use by the GPU
+	if (draw_data.TotalVtxCount > 0)
+	{
+		reserve(cb.vertex_buffer, draw_data.TotalVtxCount * sizeof(ImDrawVert), vk::BufferUsageFlagBits::eVertexBuffer);
+		reserve(cb.index_buffer, draw_data.TotalIdxCount * sizeof(ImDrawIdx), vk::BufferUsageFlagBits::eIndexBuffer);
+
+		ImDrawVert * vertices = cb.vertex_buffer.data<ImDrawVert>();
+		ImDrawIdx * indices = cb.index_buffer.data<ImDrawIdx>();
+		for (const ImDrawList * list: draw_data.CmdLists)
+		{
+			memcpy(vertices, list->VtxBuffer.Data, list->VtxBuffer.size_in_bytes());
+			memcpy(indices, list->IdxBuffer.Data, list->IdxBuffer.size_in_bytes());
+			vertices += list->VtxBuffer.Size;
+			indices += list->IdxBuffer.Size;
+		}
+	}
+
+	setup_render_state(draw_data, cb);
+
+	ImVec2 clip_off = draw_data.DisplayPos;
+	ImVec2 clip_scale = draw_data.FramebufferScale;
+
+	vk::DescriptorSet current_ds;
+	uint32_t vertex_offset = 0;
+	uint32_t index_offset = 0;
+	for (const ImDrawList * list: draw_data.CmdLists)
+	{
+		for (const ImDrawCmd & cmd: list->CmdBuffer)
+		{
+			if (cmd.UserCallback)
+			{
+				if (cmd.UserCallback == ImDrawCallback_ResetRenderState)
+				{
+					setup_render_state(draw_data, cb);
+					current_ds = nullptr;
+				}
+				else
+					cmd.UserCallback(list, &cmd);
+				continue;
+			}
+
+			ImVec2 clip_min((cmd.ClipRect.x - clip_off.x) * clip_scale.x, (cmd.ClipRect.y - clip_off.y) * clip_scale.y);
+			ImVec2 clip_max((cmd.ClipRect.z - clip_off.x) * clip_scale.x, (cmd.ClipRect.w - clip_off.y) * clip_scale.y);
+
+			clip_min.x = std::max(clip_min.x, 0.0f);
+			clip_min.y = std::max(clip_min.y, 0.0f);
+			clip_max.x = std::min<float>(clip_max.x, fb_width);
+			clip_max.y = std::min<float>(clip_max.y, fb_height);
+
+			if (clip_max.x <= clip_min.x or clip_max.y <= clip_min.y)
+				continue;
+
+			cb.command_buffer.setScissor(0, vk::Rect2D{
+			                                        .offset = {(int32_t)clip_min.x, (int32_t)clip_min.y},
+			                                        .extent = {(uint32_t)(clip_max.x - clip_min.x), (uint32_t)(clip_max.y - clip_min.y)},
+			                                });
+
+			vk::DescriptorSet ds{reinterpret_cast<VkDescriptorSet>(cmd.TextureId)};
+			if (ds != current_ds)
+			{
+				cb.command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline_layout, 0, ds, {});
+				current_ds = ds;
+			}
+
+			cb.command_buffer.drawIndexed(cmd.ElemCount, 1, cmd.IdxOffset + index_offset, cmd.VtxOffset + vertex_offset, 0);
+		}
+
+		vertex_offset += list->VtxBuffer.Size;
+		index_offset += list->IdxBuffer.Size;
+	}
+}
+
 void imgui_context::add_chars(std::string_view sv)
 {
 	for (auto it = sv.begin(); it != sv.end();)
@@ -858,6 +1088,7 @@ void imgui_context::new_frame(XrTime display_time)
 		ImGui_ImplVulkan_DestroyFontsTexture();
 		initialize_fonts();
 		ImGui_ImplVulkan_CreateFontsTexture();
+		force_redraw = true;
 	}
 
 	// Start the Dear ImGui frame
@@ -874,15 +1105,50 @@ void imgui_context::new_frame(XrTime display_time)
 	if (show_demo_window)
 		ImGui::ShowDemoWindow(&show_demo_window);
 #endif
+}
 
-	image_index = swapchain.acquire();
-	swapchain.wait();
+static void hash_combine(size_t & seed, size_t value)
+{
+	seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
 }
 
-std::vector<std::pair<int, XrCompositionLayerQuad>> imgui_context::end_frame()
+template <typename T>
+static size_t hash_bytes(const ImVector<T> & v)
 {
-	vk::Image destination = swapchain.images()[image_index].image;
+	return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char *>(v.Data), v.size_in_bytes()));
+}
+
+// Everything that can change the rendered image, as long as the textures are not modified
+static size_t hash_draw_data(const ImDrawData & draw_data)
+{
+	size_t hash = 0;
+	hash_combine(hash, std::hash<float>{}(draw_data.DisplaySize.x));
+	hash_combine(hash, std::hash<float>{}(draw_data.DisplaySize.y));
+
+	for (const ImDrawList * list: draw_data.CmdLists)
+	{
+		hash_combine(hash, hash_bytes(list->VtxBuffer));
+		hash_combine(hash, hash_bytes(list->IdxBuffer));
+
+		for (const ImDrawCmd & cmd: list->CmdBuffer)
+		{
+			hash_combine(hash, std::hash<float>{}(cmd.ClipRect.x));
+			hash_combine(hash, std::hash<float>{}(cmd.ClipRect.y));
+			hash_combine(hash, std::hash<float>{}(cmd.ClipRect.z));
+			hash_combine(hash, std::hash<float>{}(cmd.ClipRect.w));
+			hash_combine(hash, std::hash<ImTextureID>{}(cmd.TextureId));
+			hash_combine(hash, cmd.VtxOffset);
+			hash_combine(hash, cmd.IdxOffset);
+			hash_combine(hash, cmd.ElemCount);
+			hash_combine(hash, std::hash<void *>{}(reinterpret_cast<void *>(cmd.UserCallback)));
+		}
+	}
+
+	return hash;
+}
 
+std::vector<std::pair<int, XrCompositionLayerQuad>> imgui_context::end_frame()
+{
 	ImGui::SetCurrentContext(context);
 	ImPlot::SetCurrentContext(plot_context);
 
@@ -973,6 +1239,26 @@ std::vector<std::pair<int, XrCompositionLayerQuad>> imgui_context::end_frame()
 
 	ImGui::Render();
 
+	// The swapchain keeps the last released image, only render when the GUI changed
+	size_t draw_data_hash = hash_draw_data(*ImGui::GetDrawData());
+	if (force_redraw or draw_data_hash != last_draw_data_hash)
+	{
+		last_draw_data_hash = draw_data_hash;
+		last_change_time = last_display_time;
+		force_redraw = false;
+		render();
+	}
+
+	return layers_quads();
+}
+
+void imgui_context::render()
+{
+	int image_index = swapchain.acquire();
+	swapchain.wait();
+
+	vk::Image destination = swapchain.images()[image_index].image;
+
 	current_command_buffer = (current_command_buffer + 1) % command_buffers.size();
 
 	auto & f = get_frame(destination);
@@ -997,7 +1283,7 @@ std::vector<std::pair<int, XrCompositionLayerQuad>> imgui_context::end_frame()
 	                           .pClearValues = &clear},
 	                   vk::SubpassContents::eInline);
 
-	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), *cb);
+	render_draw_data(*ImGui::GetDrawData(), get_command_buffer());
 
 	cb.endRenderPass();
 
@@ -1010,7 +1296,10 @@ std::vector<std::pair<int, XrCompositionLayerQuad>> imgui_context::end_frame()
 	             *fence);
 
 	swapchain.release();
+}
 
+std::vector<std::pair<int, XrCompositionLayerQuad>> imgui_context::layers_quads()
+{
 	std::vector<std::pair<int, XrCompositionLayerQuad>> quads;
 	quads.reserve(layers_.size());
 
@@ -1121,6 +1410,7 @@ ImTextureID imgui_context::load_texture(const std::string & filename, vk::raii::
 	device.updateDescriptorSets(ds_write, nullptr);
 
 	ImTextureID id = *ds;
+	force_redraw = true;
 
 	textures.emplace(
 	        id,
@@ -1152,6 +1442,7 @@ ImTextureID imgui_context::load_texture(const std::string & filename)
 void imgui_context::free_texture(ImTextureID texture)
 {
 	textures.erase(texture);
+	force_redraw = true;
 }
 
 void imgui_context::set_current()
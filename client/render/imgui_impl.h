@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "vk/allocation.h"
 #include "wivrn_config.h"
 #include "xr/hand_tracker.h"
 #include "xr/space.h"
@@ -40,6 +41,10 @@ class imgui_context
 	{
 		vk::raii::CommandBuffer command_buffer = nullptr;
 		vk::raii::Fence fence = nullptr;
+
+		// Persistently mapped and only reallocated when they are too small
+		buffer_allocation vertex_buffer;
+		buffer_allocation index_buffer;
 	};
 
 	struct texture_data
@@ -118,10 +123,11 @@ private:
 	uint32_t queue_family_index;
 	vk::raii::Queue & queue;
 
-	vk::raii::Pipeline pipeline = nullptr;
 	vk::raii::DescriptorPool descriptor_pool;
 	vk::raii::DescriptorSetLayout ds_layout;
 	vk::raii::RenderPass renderpass;
+	vk::raii::PipelineLayout pipeline_layout = nullptr;
+	vk::raii::Pipeline pipeline = nullptr;
 	vk::raii::CommandPool command_pool;
 
 	std::unordered_map<ImTextureID, texture_data> textures;
@@ -143,7 +149,11 @@ private:
 	std::vector<viewport> layers_;
 
 	xr::swapchain & swapchain;
-	int image_index;
+
+	// Damage tracking: the swapchain image is only redrawn when the draw data changes
+	size_t last_draw_data_hash = 0;
+	bool force_redraw = true;
+	XrTime last_change_time = 0;
 
 	ImGuiContext * context;
 	ImPlotContext * plot_context;
@@ -170,6 +180,13 @@ private:
 	std::vector<controller_state> read_controllers_state(XrTime display_time);
 	size_t choose_focused_controller(const std::vector<controller_state> & new_states) const;
 
+	void create_pipeline();
+	void reserve(buffer_allocation & buffer, size_t size, vk::BufferUsageFlags usage);
+	void setup_render_state(const ImDrawData & draw_data, command_buffer & cb);
+	void render_draw_data(const ImDrawData & draw_data, command_buffer & cb);
+	void render();
+	std::vector<std::pair<int, XrCompositionLayerQuad>> layers_quads();
+
 public:
 	imgui_context(
 	        vk::raii::PhysicalDevice physical_device,
@@ -193,6 +210,13 @@ public:
 	std::vector<std::pair<int, XrCompositionLayerQuad>> end_frame();
 
 	ImFont * large_font;
+
+	// Time since the GUI was last redrawn
+	XrDuration idle_time() const
+	{
+		return last_display_time - last_change_time;
+	}
+
 	size_t get_focused_controller() const
 	{
 		return focused_controller;
@@ -0,0 +1,249 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024 Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "mesh_optimizer.h"
+#include "application.h"
+#include "utils/files.h"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <meshoptimizer.h>
+#include <optional>
+#include <span>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+// Each level of detail has at most this fraction of the indices of the previous one
+constexpr float lod_ratio = 0.5;
+constexpr size_t max_lods = 4;
+
+// Do not simplify below this number of triangles
+constexpr size_t min_lod_triangles = 64;
+
+// Maximum simplification error, relative to the mesh extent
+constexpr float max_lod_error = 0.05;
+
+// Overdraw optimization can make the vertex cache efficiency up to 5% worse
+constexpr float overdraw_threshold = 1.05;
+
+const std::array<char, 8> mesh_cache_magic{'W', 'i', 'V', 'R', 'n', 'M', 'S', '1'};
+
+// Change when the optimization or the file format change, to invalidate the cache
+constexpr uint32_t mesh_cache_version = 2;
+
+// Everything that changes the output of optimize_mesh besides the mesh itself,
+// all fields are 32 bits so that there is no padding in the hashed bytes
+struct mesh_cache_parameters
+{
+	uint32_t version;
+	uint32_t meshoptimizer_version;
+	uint32_t vertex_size;
+	uint32_t max_lods;
+	uint32_t min_lod_triangles;
+	float lod_ratio;
+	float max_lod_error;
+	float overdraw_threshold;
+};
+static_assert(sizeof(mesh_cache_parameters) == 8 * 4);
+
+struct mesh_cache_header
+{
+	std::array<char, 8> magic;
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t lod0_index_count;
+	uint32_t lod_count;
+};
+
+uint64_t fnv1a(uint64_t hash, std::span<const std::byte> bytes)
+{
+	for (std::byte b: bytes)
+	{
+		hash ^= uint8_t(b);
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+std::filesystem::path mesh_cache_path(std::span<const scene_data::vertex> vertices, std::span<const uint32_t> indices)
+{
+	const mesh_cache_parameters parameters{
+	        .version = mesh_cache_version,
+	        .meshoptimizer_version = MESHOPTIMIZER_VERSION,
+	        .vertex_size = sizeof(scene_data::vertex),
+	        .max_lods = max_lods,
+	        .min_lod_triangles = min_lod_triangles,
+	        .lod_ratio = lod_ratio,
+	        .max_lod_error = max_lod_error,
+	        .overdraw_threshold = overdraw_threshold,
+	};
+	uint64_t hash = 0xcbf29ce484222325;
+	hash = fnv1a(hash, std::as_bytes(std::span(&parameters, 1)));
+	hash = fnv1a(hash, std::as_bytes(vertices));
+	hash = fnv1a(hash, std::as_bytes(indices));
+
+	return application::get_cache_path() / "meshes" / fmt::format("{:016x}.bin", hash);
+}
+
+std::optional<optimized_mesh> load_mesh_cache(const std::filesystem::path & path)
+{
+	std::vector<std::byte> file;
+	try
+	{
+		file = utils::read_whole_file<std::byte>(path);
+	}
+	catch (...)
+	{
+		return std::nullopt;
+	}
+
+	mesh_cache_header header;
+	if (file.size() < sizeof(header))
+		return std::nullopt;
+
+	memcpy(&header, file.data(), sizeof(header));
+
+	size_t vertices_size = header.vertex_count * sizeof(scene_data::vertex);
+	size_t indices_size = header.index_count * sizeof(uint32_t);
+	size_t lods_size = header.lod_count * sizeof(scene_data::primitive::lod);
+
+	if (header.magic != mesh_cache_magic or file.size() != sizeof(header) + vertices_size + indices_size + lods_size)
+		return std::nullopt;
+
+	optimized_mesh mesh;
+	mesh.vertices.resize(header.vertex_count);
+	mesh.indices.resize(header.index_count);
+	mesh.index_count = header.lod0_index_count;
+	mesh.lods.resize(header.lod_count);
+
+	const std::byte * data = file.data() + sizeof(header);
+	memcpy(mesh.vertices.data(), data, vertices_size);
+	memcpy(mesh.indices.data(), data + vertices_size, indices_size);
+	memcpy(mesh.lods.data(), data + vertices_size + indices_size, lods_size);
+
+	return mesh;
+}
+
+void save_mesh_cache(const std::filesystem::path & path, const optimized_mesh & mesh)
+{
+	mesh_cache_header header{
+	        .magic = mesh_cache_magic,
+	        .vertex_count = (uint32_t)mesh.vertices.size(),
+	        .index_count = (uint32_t)mesh.indices.size(),
+	        .lod0_index_count = mesh.index_count,
+	        .lod_count = (uint32_t)mesh.lods.size(),
+	};
+
+	size_t vertices_size = mesh.vertices.size() * sizeof(scene_data::vertex);
+	size_t indices_size = mesh.indices.size() * sizeof(uint32_t);
+	size_t lods_size = mesh.lods.size() * sizeof(scene_data::primitive::lod);
+
+	std::vector<std::byte> file(sizeof(header) + vertices_size + indices_size + lods_size);
+	std::byte * data = file.data();
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + sizeof(header), mesh.vertices.data(), vertices_size);
+	memcpy(data + sizeof(header) + vertices_size, mesh.indices.data(), indices_size);
+	memcpy(data + sizeof(header) + vertices_size + indices_size, mesh.lods.data(), lods_size);
+
+	try
+	{
+		std::filesystem::create_directories(path.parent_path());
+		utils::write_whole_file(path, file);
+	}
+	catch (std::exception & e)
+	{
+		spdlog::warn("Cannot write optimized mesh to {}: {}", path.native(), e.what());
+	}
+}
+} // namespace
+
+optimized_mesh optimize_mesh(std::vector<scene_data::vertex> vertices, std::vector<uint32_t> indices)
+{
+	auto cache_path = mesh_cache_path(vertices, indices);
+	if (auto cached = load_mesh_cache(cache_path))
+		return std::move(*cached);
+
+	auto start = std::chrono::steady_clock::now();
+
+	const uint32_t * source_indices = indices.empty() ? nullptr : indices.data();
+	size_t index_count = indices.empty() ? vertices.size() : indices.size();
+
+	// Merge identical vertices, this also converts unindexed meshes to indexed ones
+	std::vector<uint32_t> remap(vertices.size());
+	size_t vertex_count = meshopt_generateVertexRemap(remap.data(), source_indices, index_count, vertices.data(), vertices.size(), sizeof(scene_data::vertex));
+
+	optimized_mesh mesh;
+	mesh.vertices.resize(vertex_count);
+	meshopt_remapVertexBuffer(mesh.vertices.data(), vertices.data(), vertices.size(), sizeof(scene_data::vertex), remap.data());
+
+	std::vector<uint32_t> lod0(index_count);
+	meshopt_remapIndexBuffer(lod0.data(), source_indices, index_count, remap.data());
+
+	const float * positions = &mesh.vertices[0].position.x;
+	size_t stride = sizeof(scene_data::vertex);
+
+	meshopt_optimizeVertexCache(lod0.data(), lod0.data(), lod0.size(), vertex_count);
+	meshopt_optimizeOverdraw(lod0.data(), lod0.data(), lod0.size(), positions, vertex_count, stride, overdraw_threshold);
+
+	mesh.indices = lod0;
+	mesh.index_count = lod0.size();
+
+	// Each level is simplified from the full resolution mesh so that errors do not accumulate
+	float scale = meshopt_simplifyScale(positions, vertex_count, stride);
+	size_t previous_count = lod0.size();
+	for (size_t i = 0; i < max_lods; i++)
+	{
+		size_t target_count = size_t(previous_count * lod_ratio) / 3 * 3;
+		if (target_count < min_lod_triangles * 3)
+			break;
+
+		std::vector<uint32_t> lod(lod0.size());
+		float error = 0;
+		lod.resize(meshopt_simplify(lod.data(), lod0.data(), lod0.size(), positions, vertex_count, stride, target_count, max_lod_error, 0, &error));
+
+		// The simplifier is stuck on topology or error limits, further levels would not be smaller
+		if (lod.size() > previous_count * 0.9)
+			break;
+
+		meshopt_optimizeVertexCache(lod.data(), lod.data(), lod.size(), vertex_count);
+
+		mesh.lods.push_back({
+		        .first_index = (uint32_t)mesh.indices.size(),
+		        .index_count = (uint32_t)lod.size(),
+		        .error = error * scale,
+		});
+		mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+		previous_count = lod.size();
+	}
+
+	// Order vertices by first use, the full resolution mesh comes first in the index buffer
+	mesh.vertices.resize(meshopt_optimizeVertexFetch(mesh.vertices.data(), mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), vertex_count, stride));
+
+	spdlog::debug("Optimized mesh in {:.1f}ms: {} to {} vertices, {} triangles, {} levels of detail",
+	              std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count(),
+	              vertices.size(),
+	              mesh.vertices.size(),
+	              mesh.index_count / 3,
+	              mesh.lods.size());
+
+	save_mesh_cache(cache_path, mesh);
+
+	return mesh;
+}
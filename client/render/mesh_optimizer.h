@@ -0,0 +1,39 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024 Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "render/scene_data.h"
+#include <cstdint>
+#include <vector>
+
+struct optimized_mesh
+{
+	std::vector<scene_data::vertex> vertices;
+
+	// Indices of all levels of detail, the full resolution mesh comes first
+	std::vector<uint32_t> indices;
+	uint32_t index_count;
+
+	std::vector<scene_data::primitive::lod> lods;
+};
+
+// Reorders a triangle list for the vertex cache, overdraw and vertex fetch and generates simplified
+// levels of detail. The result is cached on disk, keyed by the content of the input.
+// If indices is empty, the vertices are assumed to be unindexed.
+optimized_mesh optimize_mesh(std::vector<scene_data::vertex> vertices, std::vector<uint32_t> indices);
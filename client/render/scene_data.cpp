@@ -19,18 +19,24 @@
 
 #include "render/scene_data.h"
 
+#include "application.h"
 #include "image_loader.h"
 #include "render/gpu_buffer.h"
+#include "render/mesh_optimizer.h"
+#include "utils/async.h"
 #include "utils/fmt_glm.h"
 #include "utils/ranges.h"
 #include <boost/pfr/core.hpp>
+#include <chrono>
 #include <fastgltf/base64.hpp>
 #include <fastgltf/core.hpp>
 #include <fastgltf/glm_element_traits.hpp>
 #include <fastgltf/tools.hpp>
 #include <fastgltf/types.hpp>
 #include <fastgltf/util.hpp>
+#include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <limits>
 #include <ranges>
 #include <spdlog/spdlog.h>
 #include <stdexcept>
@@ -463,6 +469,75 @@ public:
 		                  source);
 	}
 
+	// PNG and JPEG images are decoded in the thread pool before being uploaded
+	std::unordered_map<int, std::optional<image_loader::cpu_image>> decoded_images;
+	void decode_all_images(const std::unordered_map<int, bool> & srgb_images)
+	{
+		std::vector<std::pair<int, utils::future<image_loader::cpu_image, std::monostate>>> futures;
+
+		// The tasks reference the loaded assets, wait for them even if a later
+		// image source throws
+		struct wait_all
+		{
+			decltype(futures) & futures;
+			~wait_all()
+			{
+				for (auto & [index, future]: futures)
+				{
+					if (not future.valid())
+						continue;
+					try
+					{
+						future.get();
+					}
+					catch (...)
+					{
+					}
+				}
+			}
+		} guard{futures};
+
+		for (auto [index, srgb]: srgb_images)
+		{
+			auto [image_data, mime_type] = visit_source(gltf.images.at(index).data);
+
+			switch (guess_mime_type(image_data))
+			{
+				case fastgltf::MimeType::JPEG:
+				case fastgltf::MimeType::PNG:
+					futures.emplace_back(
+					        index,
+					        utils::async<image_loader::cpu_image, std::monostate>(
+					                application::get_thread_pool(),
+					                utils::thread_pool::priority::normal,
+					                [](auto token, std::span<const std::byte> bytes, bool srgb) {
+						                return image_loader::decode(bytes, srgb);
+					                },
+					                std::span<const std::byte>(image_data.data(), image_data.size()),
+					                srgb));
+					break;
+
+				default:
+					break;
+			}
+		}
+
+		// Wait for all tasks even if some of them fail, they reference the loaded assets
+		for (auto & [index, future]: futures)
+		{
+			try
+			{
+				decoded_images.emplace(index, future.get());
+			}
+			catch (std::exception & e)
+			{
+				spdlog::info("Cannot decode image: {}", e.what());
+				decoded_images.emplace(index, std::nullopt);
+			}
+			future.reset();
+		}
+	}
+
 	std::unordered_map<int, std::shared_ptr<vk::raii::ImageView>> images;
 	std::shared_ptr<vk::raii::ImageView> load_image(int index, bool srgb)
 	{
@@ -470,8 +545,27 @@ public:
 		if (it != images.end())
 			return it->second;
 
-		auto [image_data, mime_type] = visit_source(gltf.images[index].data);
-		auto image = do_load_image(physical_device, device, queue, cb_pool, image_data, srgb);
+		std::shared_ptr<vk::raii::ImageView> image;
+
+		if (auto decoded = decoded_images.find(index); decoded != decoded_images.end())
+		{
+			if (decoded->second)
+			{
+				image_loader loader(physical_device, device, queue, cb_pool);
+				loader.load(*decoded->second);
+
+				spdlog::debug("Loaded image {}x{}, format {}, {} mipmaps", loader.extent.width, loader.extent.height, vk::to_string(loader.format), loader.num_mipmaps);
+				image = loader.image_view;
+			}
+
+			// Release the CPU memory
+			decoded_images.erase(decoded);
+		}
+		else
+		{
+			auto [image_data, mime_type] = visit_source(gltf.images[index].data);
+			image = do_load_image(physical_device, device, queue, cb_pool, image_data, srgb);
+		}
 
 		images.emplace(index, image);
 		return image;
@@ -491,6 +585,19 @@ public:
 				srgb_array.at(gltf_material.emissiveTexture->textureIndex) = true;
 		}
 
+		// Decode all images in parallel, if an image is used by several textures, the first one
+		// decides if it is sRGB
+		std::unordered_map<int, bool> srgb_images;
+		for (auto && [srgb, gltf_texture]: std::views::zip(srgb_array, gltf.textures))
+		{
+			if (gltf_texture.basisuImageIndex)
+				srgb_images.emplace(*gltf_texture.basisuImageIndex, srgb);
+
+			if (gltf_texture.imageIndex)
+				srgb_images.emplace(*gltf_texture.imageIndex, srgb);
+		}
+		decode_all_images(srgb_images);
+
 		std::vector<std::shared_ptr<scene_data::texture>> textures;
 		textures.reserve(gltf.textures.size());
 		for (auto && [srgb, gltf_texture]: std::views::zip(srgb_array, gltf.textures))
@@ -616,12 +723,56 @@ public:
 			auto & mesh_ref = meshes.emplace_back();
 
 			mesh_ref.primitives.reserve(gltf_mesh.primitives.size());
+			mesh_ref.aabb_min = glm::vec3(std::numeric_limits<float>::max());
+			mesh_ref.aabb_max = glm::vec3(std::numeric_limits<float>::lowest());
 
 			for (const fastgltf::Primitive & gltf_primitive: gltf_mesh.primitives)
 			{
 				auto & primitive_ref = mesh_ref.primitives.emplace_back();
 
-				if (gltf_primitive.indicesAccessor)
+				std::vector<scene_data::vertex> vertices;
+
+				copy_vertex_attributes(gltf, gltf_primitive, "POSITION", vertices, &scene_data::vertex::position);
+				copy_vertex_attributes(gltf, gltf_primitive, "NORMAL", vertices, &scene_data::vertex::normal);
+				copy_vertex_attributes(gltf, gltf_primitive, "TANGENT", vertices, &scene_data::vertex::tangent);
+				copy_vertex_attributes(gltf, gltf_primitive, "TEXCOORD_", vertices, &scene_data::vertex::texcoord);
+				copy_vertex_attributes(gltf, gltf_primitive, "COLOR", vertices, &scene_data::vertex::color);
+				copy_vertex_attributes(gltf, gltf_primitive, "JOINTS_", vertices, &scene_data::vertex::joints);
+				copy_vertex_attributes(gltf, gltf_primitive, "WEIGHTS_", vertices, &scene_data::vertex::weights);
+
+				if (gltf_primitive.type == fastgltf::PrimitiveType::Triangles and !vertices.empty())
+				{
+					// Triangle lists are optimized and get simplified levels of detail
+					std::vector<uint32_t> indices;
+					if (gltf_primitive.indicesAccessor)
+					{
+						fastgltf::Accessor & indices_accessor = gltf.accessors.at(*gltf_primitive.indicesAccessor);
+						indices.resize(indices_accessor.count);
+						fastgltf::iterateAccessorWithIndex<uint32_t>(gltf, indices_accessor, [&](uint32_t value, std::size_t idx) {
+							indices[idx] = value;
+						});
+					}
+
+					optimized_mesh optimized = optimize_mesh(std::move(vertices), std::move(indices));
+					vertices = std::move(optimized.vertices);
+
+					primitive_ref.indexed = true;
+					primitive_ref.index_count = optimized.index_count;
+					primitive_ref.lods = std::move(optimized.lods);
+
+					if (vertices.size() <= std::numeric_limits<uint16_t>::max())
+					{
+						std::vector<uint16_t> indices16(optimized.indices.begin(), optimized.indices.end());
+						primitive_ref.index_offset = staging_buffer.add_indices(indices16);
+						primitive_ref.index_type = vk::IndexType::eUint16;
+					}
+					else
+					{
+						primitive_ref.index_offset = staging_buffer.add_indices(optimized.indices);
+						primitive_ref.index_type = vk::IndexType::eUint32;
+					}
+				}
+				else if (gltf_primitive.indicesAccessor)
 				{
 					fastgltf::Accessor & indices_accessor = gltf.accessors.at(*gltf_primitive.indicesAccessor);
 
@@ -656,19 +807,19 @@ public:
 					primitive_ref.indexed = false;
 				}
 
-				std::vector<scene_data::vertex> vertices;
-
-				copy_vertex_attributes(gltf, gltf_primitive, "POSITION", vertices, &scene_data::vertex::position);
-				copy_vertex_attributes(gltf, gltf_primitive, "NORMAL", vertices, &scene_data::vertex::normal);
-				copy_vertex_attributes(gltf, gltf_primitive, "TANGENT", vertices, &scene_data::vertex::tangent);
-				copy_vertex_attributes(gltf, gltf_primitive, "TEXCOORD_", vertices, &scene_data::vertex::texcoord);
-				copy_vertex_attributes(gltf, gltf_primitive, "COLOR", vertices, &scene_data::vertex::color);
-				copy_vertex_attributes(gltf, gltf_primitive, "JOINTS_", vertices, &scene_data::vertex::joints);
-				copy_vertex_attributes(gltf, gltf_primitive, "WEIGHTS_", vertices, &scene_data::vertex::weights);
-
 				primitive_ref.vertex_offset = staging_buffer.add_vertices(vertices);
 				primitive_ref.vertex_count = vertices.size();
 
+				primitive_ref.aabb_min = glm::vec3(std::numeric_limits<float>::max());
+				primitive_ref.aabb_max = glm::vec3(std::numeric_limits<float>::lowest());
+				for (const scene_data::vertex & vertex: vertices)
+				{
+					primitive_ref.aabb_min = glm::min(primitive_ref.aabb_min, vertex.position);
+					primitive_ref.aabb_max = glm::max(primitive_ref.aabb_max, vertex.position);
+				}
+				mesh_ref.aabb_min = glm::min(mesh_ref.aabb_min, primitive_ref.aabb_min);
+				mesh_ref.aabb_max = glm::max(mesh_ref.aabb_max, primitive_ref.aabb_max);
+
 				primitive_ref.cull_mode = vk::CullModeFlagBits::eBack;       // TBC
 				primitive_ref.front_face = vk::FrontFace::eCounterClockwise; // TBC
 				primitive_ref.topology = convert(gltf_primitive.type);
@@ -801,6 +952,7 @@ scene_data scene_loader::operator()(const std::filesystem::path & gltf_path)
 	fastgltf::GltfDataBuffer data_buffer;
 	data_buffer.copyBytes(reinterpret_cast<const uint8_t *>(asset_file.data()), asset_file.size());
 
+	auto t0 = std::chrono::steady_clock::now();
 	fastgltf::Asset asset = load_gltf_asset(data_buffer, gltf_path.parent_path());
 	loader_context ctx(gltf_path.parent_path(), asset, physical_device, device, queue, cb_pool);
 
@@ -815,19 +967,36 @@ scene_data scene_loader::operator()(const std::filesystem::path & gltf_path)
 	gpu_buffer staging_buffer(physical_device_properties, asset);
 
 	// Load all textures
+	auto t1 = std::chrono::steady_clock::now();
 	auto textures = ctx.load_all_textures();
 
 	// Load all materials
+	auto t2 = std::chrono::steady_clock::now();
 	auto materials = ctx.load_all_materials(textures, staging_buffer, *default_material);
 
 	// Load all meshes
+	auto t3 = std::chrono::steady_clock::now();
 	data.meshes = ctx.load_all_meshes(materials, staging_buffer);
 
+	auto t4 = std::chrono::steady_clock::now();
 	data.scene_nodes = ctx.topological_sort(ctx.load_all_nodes());
 
 	// Copy the staging buffer to the GPU
+	auto t5 = std::chrono::steady_clock::now();
 	spdlog::debug("Uploading scene data ({} bytes) to GPU memory", staging_buffer.size());
 	auto buffer = std::make_shared<buffer_allocation>(staging_buffer.copy_to_gpu());
+	auto t6 = std::chrono::steady_clock::now();
+
+	using ms = std::chrono::duration<float, std::milli>;
+	spdlog::info("Loaded {} in {:.1f}ms: parsing {:.1f}ms, textures {:.1f}ms, materials {:.1f}ms, meshes {:.1f}ms, nodes {:.1f}ms, upload {:.1f}ms",
+	             gltf_path.native(),
+	             ms(t6 - t0).count(),
+	             ms(t1 - t0).count(),
+	             ms(t2 - t1).count(),
+	             ms(t3 - t2).count(),
+	             ms(t4 - t3).count(),
+	             ms(t5 - t4).count(),
+	             ms(t6 - t5).count());
 
 	for (auto & i: materials)
 		i->buffer = buffer;
@@ -153,12 +153,30 @@ struct scene_data
 		vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
 
 		std::shared_ptr<material> material_;
+
+		// Axis-aligned bounding box in mesh coordinates, computed at load time
+		glm::vec3 aabb_min;
+		glm::vec3 aabb_max;
+
+		// Simplified versions of the primitive, from the most to the least detailed. They use the
+		// same vertices and index buffer as the full resolution primitive.
+		struct lod
+		{
+			uint32_t first_index;
+			uint32_t index_count;
+			float error; // Maximum distance to the full resolution primitive, in mesh coordinates
+		};
+		std::vector<lod> lods;
 	};
 
 	struct mesh
 	{
 		std::vector<primitive> primitives;
 		std::shared_ptr<buffer_allocation> buffer;
+
+		// Union of the bounding boxes of all primitives, used for frustum culling
+		glm::vec3 aabb_min;
+		glm::vec3 aabb_max;
 	};
 
 	struct node
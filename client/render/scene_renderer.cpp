@@ -28,14 +28,19 @@
 #include "vk/allocation.h"
 #include "vk/pipeline.h"
 #include "vk/shader.h"
+#include <algorithm>
 #include <boost/pfr/core.hpp>
+#include <chrono>
 #include <glm/gtc/matrix_access.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <glm/vector_relational.hpp>
+#include <limits>
 #include <map>
 #include <memory>
 #include <ranges>
 #include <spdlog/spdlog.h>
+#include <utility>
 #include <vk_mem_alloc.h>
 
 extern const std::map<std::string, std::vector<uint32_t>> shaders;
@@ -144,13 +149,13 @@ static std::array layout_bindings_0{
         },
         vk::DescriptorSetLayoutBinding{
                 .binding = 1,
-                .descriptorType = vk::DescriptorType::eUniformBuffer,
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
                 .descriptorCount = 1,
                 .stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
         },
         vk::DescriptorSetLayoutBinding{
                 .binding = 2,
-                .descriptorType = vk::DescriptorType::eUniformBuffer,
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
                 .descriptorCount = 1,
                 .stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
         },
@@ -651,6 +656,8 @@ void scene_renderer::start_frame()
 {
 	current_frame_index = (current_frame_index + 1) % frame_resources.size();
 
+	last_stats = std::exchange(stats, {});
+
 	auto & f = current_frame();
 	if (auto result = device.waitForFences(*f.fence, true, 1'000'000'000); result != vk::Result::eSuccess)
 		throw std::runtime_error("vkWaitForfences: " + vk::to_string(result));
@@ -685,7 +692,7 @@ void scene_renderer::start_frame()
 		        device,
 		        vk::BufferCreateInfo{
 		                .size = 1048576,
-		                .usage = vk::BufferUsageFlagBits::eUniformBuffer,
+		                .usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
 		        },
 		        VmaAllocationCreateInfo{
 		                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
@@ -810,12 +817,122 @@ void scene_renderer::update_material_descriptor_set(scene_data::material & mater
 // 	}
 // }
 
+namespace
+{
+struct draw_item
+{
+	vk::Pipeline pipeline;
+	scene_data::material * material;
+	scene_data::mesh * mesh;
+	scene_data::primitive * primitive;
+	size_t node_index;
+	bool skinned;
+	bool blend_enable;
+
+	// Joint matrices for skinned meshes, shared by all views
+	vk::DeviceSize joints_offset;
+	vk::DeviceSize joints_size;
+};
+
+// Side planes of the view frustum, in world coordinates. For a perspective projection their
+// intersection only contains points in front of the camera, so the near and far planes are not
+// needed (the far plane is at infinity in the lobby anyway).
+std::array<glm::vec4, 4> frustum_planes(const glm::mat4 & viewproj)
+{
+	glm::vec4 x = glm::row(viewproj, 0);
+	glm::vec4 y = glm::row(viewproj, 1);
+	glm::vec4 w = glm::row(viewproj, 3);
+
+	return {w + x, w - x, w + y, w - y};
+}
+
+bool is_in_frustum(const std::array<glm::vec4, 4> & planes, const glm::mat4 & model, glm::vec3 aabb_min, glm::vec3 aabb_max)
+{
+	if (glm::any(glm::greaterThan(aabb_min, aabb_max)))
+		return false;
+
+	for (const glm::vec4 & world_plane: planes)
+	{
+		// Move the plane to the mesh coordinates, this is exact even with non uniform scaling
+		glm::vec4 plane = world_plane * model;
+
+		// Corner of the bounding box that is the furthest along the plane normal
+		glm::vec3 corner{
+		        plane.x >= 0 ? aabb_max.x : aabb_min.x,
+		        plane.y >= 0 ? aabb_max.y : aabb_min.y,
+		        plane.z >= 0 ? aabb_max.z : aabb_min.z,
+		};
+
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0)
+			return false;
+	}
+
+	return true;
+}
+
+// Opaque primitives are grouped by pipeline, material and primitive to minimize state changes and
+// to allow instancing, blended primitives are drawn afterwards in scene order
+bool draw_order(const draw_item & a, const draw_item & b)
+{
+	if (a.blend_enable != b.blend_enable)
+		return b.blend_enable;
+
+	if (a.blend_enable)
+		return false;
+
+	return std::tie(a.pipeline, a.material, a.primitive) < std::tie(b.pipeline, b.material, b.primitive);
+}
+
+// Draw item with the level of detail selected for the current view
+struct visible_draw
+{
+	const draw_item * item;
+	uint32_t first_index;
+	uint32_t index_count;
+};
+
+// Projected simplification error that is allowed for a level of detail, in pixels
+constexpr float lod_max_pixel_error = 1;
+
+// Chooses the least detailed level whose error is small enough, lod_scale converts errors in mesh
+// coordinates to multiples of the allowed error
+visible_draw select_lod(const draw_item & item, float lod_scale)
+{
+	visible_draw draw{
+	        .item = &item,
+	        .first_index = 0,
+	        .index_count = item.primitive->index_count,
+	};
+
+	for (const scene_data::primitive::lod & lod: item.primitive->lods)
+	{
+		if (lod.error * lod_scale > 1)
+			break;
+
+		draw.first_index = lod.first_index;
+		draw.index_count = lod.index_count;
+	}
+
+	return draw;
+}
+
+bool can_instance(const visible_draw & a, const visible_draw & b)
+{
+	return !a.item->skinned && !b.item->skinned && a.item->pipeline == b.item->pipeline && a.item->material == b.item->material && a.item->primitive == b.item->primitive && a.first_index == b.first_index;
+}
+} // namespace
+
 void scene_renderer::render(scene_data & scene, const std::array<float, 4> & clear_color, std::span<frame_info> frames)
 {
+	auto cpu_begin = std::chrono::steady_clock::now();
+
 	per_frame_resources & resources = current_frame();
 
-	size_t buffer_alignment = std::max<size_t>(sizeof(glm::mat4), physical_device_properties.limits.minUniformBufferOffsetAlignment);
-	// size_t buffer_alignment = std::max<size_t>(sizeof(glm::mat4), physical_device_properties.limits.minStorageBufferOffsetAlignment);
+	size_t buffer_alignment = std::max<size_t>({
+	        sizeof(glm::mat4),
+	        physical_device_properties.limits.minUniformBufferOffsetAlignment,
+	        physical_device_properties.limits.minStorageBufferOffsetAlignment,
+	});
 
 	vk::raii::CommandBuffer & cb = resources.cb;
 
@@ -826,8 +943,6 @@ void scene_renderer::render(scene_data & scene, const std::array<float, 4> & cle
 	        vk::ClearDepthStencilValue{0.0, 0},
 	};
 
-	auto vertex_layout = scene_data::vertex::describe();
-
 	std::vector<glm::mat4> transform_to_root(scene.scene_nodes.size());
 	std::vector<bool> reverse_side(scene.scene_nodes.size());
 	std::vector<bool> visible(scene.scene_nodes.size());
@@ -858,8 +973,87 @@ void scene_renderer::render(scene_data & scene, const std::array<float, 4> & cle
 
 	// print_scene_hierarchy(scene, transform_to_root);
 
+	// The draw list does not depend on the view, build it once for all views
+	std::vector<draw_item> draw_list;
+	for (const auto & [index, node]: utils::enumerate(scene.scene_nodes))
+	{
+		if (!node.mesh_id)
+			continue;
+
+		if (!visible[index])
+			continue;
+
+		scene_data::mesh & mesh = scene.meshes.at(*node.mesh_id);
+
+		// The joint palette only depends on the node hierarchy, compute it once for all views
+		vk::DeviceSize joints_offset = 0;
+		vk::DeviceSize joints_size = sizeof(glm::mat4);
+		if (!node.joints.empty())
+		{
+			joints_offset = resources.uniform_buffer_offset;
+			joints_size = sizeof(glm::mat4) * node.joints.size();
+			glm::mat4 * joint_matrices = reinterpret_cast<glm::mat4 *>(ubo + resources.uniform_buffer_offset);
+			resources.uniform_buffer_offset += utils::align_up(buffer_alignment, joints_size);
+
+			glm::mat4 inverse_transform = glm::inverse(transform_to_root[index]);
+			for (auto && [idx, joint]: utils::enumerate(node.joints))
+			{
+				joint_matrices[idx] = inverse_transform * transform_to_root[joint.first] * joint.second;
+			}
+		}
+
+		for (scene_data::primitive & primitive: mesh.primitives)
+		{
+			// Get the material
+			std::shared_ptr<scene_data::material> material = primitive.material_ ? primitive.material_ : default_material;
+
+			if (material->ds_dirty || !material->ds)
+				update_material_descriptor_set(*material);
+
+			// Get the pipeline
+			pipeline_info info{
+			        .shader_name = material->shader_name,
+			        .cull_mode = primitive.cull_mode,
+			        .front_face = primitive.front_face,
+			        .topology = primitive.topology,
+			        .blend_enable = material->blend_enable,
+
+			        .nb_texcoords = 2, // TODO
+			        .skinning = !node.joints.empty(),
+			};
+
+			if (material->double_sided)
+				info.cull_mode = vk::CullModeFlagBits::eNone;
+
+			if (reverse_side[index])
+				info.front_face = reverse(info.front_face);
+
+			draw_list.push_back(draw_item{
+			        .pipeline = *get_pipeline(info),
+			        .material = material.get(),
+			        .mesh = &mesh,
+			        .primitive = &primitive,
+			        .node_index = index,
+			        .skinned = !node.joints.empty(),
+			        .blend_enable = material->blend_enable,
+			        .joints_offset = joints_offset,
+			        .joints_size = joints_size,
+			});
+
+			resources.resources.push_back(material->ds);
+		}
+	}
+
+	std::ranges::stable_sort(draw_list, draw_order);
+
+	std::vector<bool> node_in_frustum(scene.scene_nodes.size());
+	std::vector<float> node_lod_scale(scene.scene_nodes.size());
+	std::vector<visible_draw> visible_draws;
+	visible_draws.reserve(draw_list.size());
+
 	for (const auto && [frame_index, frame]: utils::enumerate(frames))
 	{
+		stats.view_count++;
 		scene_renderer::output_image & output = get_output_image_data(frame.destination, frame.depth_buffer);
 		glm::mat4 viewproj = frame.projection * frame.view;
 
@@ -880,6 +1074,65 @@ void scene_renderer::render(scene_data & scene, const std::array<float, 4> & cle
 		frame_ubo.proj = frame.projection;
 		frame_ubo.view = frame.view;
 
+		// Frustum culling, done per node using the mesh bounding box. Skinned meshes are never culled
+		// because their bounding box is only valid in the bind pose.
+		auto planes = frustum_planes(viewproj);
+
+		// Level of detail selection: the error of a level is scaled by the node transform and
+		// projected at the distance of the closest point of the bounding sphere
+		glm::vec3 camera_position = glm::column(glm::inverse(frame.view), 3);
+		float max_error = lod_max_pixel_error * 2 / output_size.height;
+
+		for (const auto & [index, node]: utils::enumerate(scene.scene_nodes))
+		{
+			if (node.mesh_id and visible[index])
+			{
+				const scene_data::mesh & mesh = scene.meshes.at(*node.mesh_id);
+				const glm::mat4 & model = transform_to_root[index];
+				node_in_frustum[index] = !node.joints.empty() || is_in_frustum(planes, model, mesh.aabb_min, mesh.aabb_max);
+
+				if (!node.joints.empty() or !node_in_frustum[index])
+				{
+					node_lod_scale[index] = std::numeric_limits<float>::infinity();
+					continue;
+				}
+
+				float scale = std::max({glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))});
+				glm::vec3 center = model * glm::vec4((mesh.aabb_min + mesh.aabb_max) / 2.f, 1);
+				float radius = glm::length(mesh.aabb_max - mesh.aabb_min) / 2 * scale;
+				float distance = std::max(glm::length(center - camera_position) - radius, 0.01f);
+
+				node_lod_scale[index] = scale * frame.projection[1][1] / (distance * max_error);
+			}
+		}
+
+		visible_draws.clear();
+		for (const draw_item & item: draw_list)
+		{
+			if (node_in_frustum[item.node_index])
+				visible_draws.push_back(select_lod(item, node_lod_scale[item.node_index]));
+			else
+				stats.culled_count++;
+		}
+
+		// Per-instance data for the whole view, indexed in the shader with gl_InstanceIndex
+		vk::DeviceSize instances_offset = resources.uniform_buffer_offset;
+		instance_gpu_data * instances = reinterpret_cast<instance_gpu_data *>(ubo + resources.uniform_buffer_offset);
+		resources.uniform_buffer_offset += utils::align_up(buffer_alignment, std::max<size_t>(1, visible_draws.size()) * sizeof(instance_gpu_data));
+
+		for (auto && [instance_index, item]: utils::enumerate(visible_draws))
+		{
+			const scene_data::node & node = scene.scene_nodes[item.item->node_index];
+			glm::mat4 & transform = transform_to_root[item.item->node_index];
+
+			instances[instance_index] = instance_gpu_data{
+			        .model = transform,
+			        .modelview = frame.view * transform,
+			        .modelviewproj = viewproj * transform,
+			        .clipping_planes = node.clipping_planes,
+			};
+		}
+
 		cb.beginRenderPass(
 		        vk::RenderPassBeginInfo{
 		                .renderPass = *renderpass,
@@ -893,122 +1146,97 @@ void scene_renderer::render(scene_data & scene, const std::array<float, 4> & cle
 		        },
 		        vk::SubpassContents::eInline);
 
-		for (const auto & [index, node]: utils::enumerate(scene.scene_nodes))
-		{
-			if (!node.mesh_id)
-				continue;
+		vk::DescriptorBufferInfo buffer_info_1{
+		        .buffer = resources.uniform_buffer,
+		        .offset = frame_ubo_offset,
+		        .range = sizeof(frame_gpu_data)};
+		vk::DescriptorBufferInfo buffer_info_2{
+		        .buffer = resources.uniform_buffer,
+		        .offset = instances_offset,
+		        .range = std::max<size_t>(1, visible_draws.size()) * sizeof(instance_gpu_data)};
+		vk::DescriptorBufferInfo buffer_info_3{
+		        .buffer = resources.uniform_buffer,
+		        .offset = 0,
+		        .range = sizeof(glm::mat4)};
+
+		std::array descriptors{
+		        vk::WriteDescriptorSet{
+		                .dstBinding = 0,
+		                .descriptorCount = 1,
+		                .descriptorType = vk::DescriptorType::eUniformBuffer,
+		                .pBufferInfo = &buffer_info_1,
+		        },
+		        vk::WriteDescriptorSet{
+		                .dstBinding = 1,
+		                .descriptorCount = 1,
+		                .descriptorType = vk::DescriptorType::eStorageBuffer,
+		                .pBufferInfo = &buffer_info_2,
+		        },
+		        vk::WriteDescriptorSet{
+		                .dstBinding = 2,
+		                .descriptorCount = 1,
+		                .descriptorType = vk::DescriptorType::eStorageBuffer,
+		                .pBufferInfo = &buffer_info_3,
+		        },
+		};
 
-			if (!visible[index])
-				continue;
+		cb.pushDescriptorSetKHR(vk::PipelineBindPoint::eGraphics, *pipeline_layout, 0, descriptors);
 
-			scene_data::mesh & mesh = scene.meshes.at(*node.mesh_id);
-			glm::mat4 & transform = transform_to_root[index];
+		vk::Pipeline current_pipeline;
+		scene_data::material * current_material = nullptr;
+		scene_data::primitive * current_primitive = nullptr;
 
-			vk::DeviceSize instance_ubo_offset = resources.uniform_buffer_offset;
-			instance_gpu_data & object_ubo = *reinterpret_cast<instance_gpu_data *>(ubo + resources.uniform_buffer_offset);
-			resources.uniform_buffer_offset += utils::align_up(buffer_alignment, sizeof(instance_gpu_data));
+		for (size_t first = 0; first < visible_draws.size();)
+		{
+			const visible_draw & draw = visible_draws[first];
+			const draw_item & item = *draw.item;
 
-			vk::DeviceSize joints_ubo_offset = 0;
-			if (!node.joints.empty())
-			{
-				joints_ubo_offset = resources.uniform_buffer_offset;
-				glm::mat4 * joint_matrices = reinterpret_cast<glm::mat4 *>(ubo + resources.uniform_buffer_offset);
-				resources.uniform_buffer_offset += utils::align_up(buffer_alignment, sizeof(glm::mat4) * 32);
-				assert(node.joints.size() <= 32);
+			size_t count = 1;
+			while (first + count < visible_draws.size() and can_instance(draw, visible_draws[first + count]))
+				count++;
 
-				for (auto && [idx, joint]: utils::enumerate(node.joints))
-				{
-					joint_matrices[idx] = glm::inverse(transform) * transform_to_root[joint.first] * joint.second;
-				}
+			if (item.pipeline != current_pipeline)
+			{
+				cb.bindPipeline(vk::PipelineBindPoint::eGraphics, item.pipeline);
+				current_pipeline = item.pipeline;
 			}
 
-			object_ubo.model = transform;
-			object_ubo.modelview = frame.view * transform;
-			object_ubo.modelviewproj = viewproj * transform;
-			object_ubo.clipping_planes = node.clipping_planes;
-
-			for (scene_data::primitive & primitive: mesh.primitives)
+			if (item.primitive != current_primitive)
 			{
-				// Get the material
-				std::shared_ptr<scene_data::material> material = primitive.material_ ? primitive.material_ : default_material;
-
-				if (material->ds_dirty || !material->ds)
-					update_material_descriptor_set(*material);
+				scene_data::primitive & primitive = *item.primitive;
 
-				// Get the pipeline
-				pipeline_info info{
-				        .shader_name = material->shader_name,
-				        .cull_mode = primitive.cull_mode,
-				        .front_face = primitive.front_face,
-				        .topology = primitive.topology,
-				        .blend_enable = material->blend_enable,
-
-				        .nb_texcoords = 2, // TODO
-				        .skinning = !node.joints.empty(),
-				};
-
-				if (material->double_sided)
-					info.cull_mode = vk::CullModeFlagBits::eNone;
+				if (primitive.indexed)
+					cb.bindIndexBuffer(*item.mesh->buffer, primitive.index_offset, primitive.index_type);
 
-				if (reverse_side[index])
-					info.front_face = reverse(info.front_face);
+				cb.bindVertexBuffers(0, (vk::Buffer)*item.mesh->buffer, primitive.vertex_offset);
+				current_primitive = item.primitive;
+			}
 
-				cb.bindPipeline(vk::PipelineBindPoint::eGraphics, *get_pipeline(info));
+			if (item.skinned and (buffer_info_3.offset != item.joints_offset or buffer_info_3.range != item.joints_size))
+			{
+				buffer_info_3.offset = item.joints_offset;
+				buffer_info_3.range = item.joints_size;
+				cb.pushDescriptorSetKHR(vk::PipelineBindPoint::eGraphics, *pipeline_layout, 0, descriptors[2]);
+			}
 
-				if (primitive.indexed)
-					cb.bindIndexBuffer(*mesh.buffer, primitive.index_offset, primitive.index_type);
-
-				cb.bindVertexBuffers(0, (vk::Buffer)*mesh.buffer, primitive.vertex_offset);
-
-				vk::DescriptorBufferInfo buffer_info_1{
-				        .buffer = resources.uniform_buffer,
-				        .offset = frame_ubo_offset,
-				        .range = sizeof(frame_gpu_data)
-
-				};
-				vk::DescriptorBufferInfo buffer_info_2{
-				        .buffer = resources.uniform_buffer,
-				        .offset = instance_ubo_offset,
-				        .range = sizeof(instance_gpu_data)};
-				vk::DescriptorBufferInfo buffer_info_3{
-				        .buffer = resources.uniform_buffer,
-				        .offset = joints_ubo_offset,
-				        .range = sizeof(glm::mat4) * 32};
-
-				std::array descriptors{
-				        vk::WriteDescriptorSet{
-				                .dstBinding = 0,
-				                .descriptorCount = 1,
-				                .descriptorType = vk::DescriptorType::eUniformBuffer,
-				                .pBufferInfo = &buffer_info_1,
-				        },
-				        vk::WriteDescriptorSet{
-				                .dstBinding = 1,
-				                .descriptorCount = 1,
-				                .descriptorType = vk::DescriptorType::eUniformBuffer,
-				                .pBufferInfo = &buffer_info_2,
-				        },
-				        vk::WriteDescriptorSet{
-				                .dstBinding = 2,
-				                .descriptorCount = 1,
-				                .descriptorType = vk::DescriptorType::eUniformBuffer,
-				                .pBufferInfo = &buffer_info_3,
-				        },
-				};
-
-				cb.pushDescriptorSetKHR(vk::PipelineBindPoint::eGraphics, *pipeline_layout, 0, descriptors);
-
-				// Set 1: material
-				cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline_layout, 1, **material->ds, {});
+			// Set 1: material
+			if (item.material != current_material)
+			{
+				cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline_layout, 1, **item.material->ds, {});
+				current_material = item.material;
+			}
 
-				if (primitive.indexed)
-					cb.drawIndexed(primitive.index_count, 1, 0, 0, 0);
-				else
-					cb.draw(primitive.vertex_count, 1, 0, 0);
+			if (item.primitive->indexed)
+				cb.drawIndexed(draw.index_count, count, draw.first_index, 0, first);
+			else
+				cb.draw(item.primitive->vertex_count, count, 0, first);
 
-				resources.resources.push_back(material->ds);
-			}
+			stats.draw_count++;
+			first += count;
 		}
+
 		cb.endRenderPass();
 	}
+
+	cpu_time_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - cpu_begin).count();
 }
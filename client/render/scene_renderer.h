@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <glm/mat4x4.hpp>
@@ -105,7 +106,7 @@ class scene_renderer
 	output_image & get_output_image_data(vk::Image output_color, vk::Image output_depth);
 	vk::raii::Pipeline & get_pipeline(const pipeline_info & info);
 
-	vk::raii::DescriptorSetLayout layout_0; // Descriptor set 0: per-frame/view data (UBO) and per-instance data (UBO + SSBO)
+	vk::raii::DescriptorSetLayout layout_0; // Descriptor set 0: per-frame/view data (UBO), per-instance data and joint matrices (SSBO)
 	vk::raii::DescriptorSetLayout layout_1; // Descriptor set 1: per-material data (5 combined image samplers and 1 uniform buffer)
 
 	// Descriptor set 1: per-material data (5 combined image samplers and 1 uniform buffer)
@@ -170,6 +171,16 @@ class scene_renderer
 	int current_frame_index;
 	vk::raii::QueryPool query_pool = nullptr;
 	double gpu_time_s = 0;
+	double cpu_time_s = 0;
+	struct frame_stats
+	{
+		size_t draw_count = 0;
+		size_t culled_count = 0;
+		size_t view_count = 0;
+	};
+	// Accumulated during the current frame, and totals of the last completed frame
+	frame_stats stats;
+	frame_stats last_stats;
 	bool keep_depth_buffer = false;
 
 	per_frame_resources & current_frame();
@@ -216,6 +227,23 @@ public:
 		return gpu_time_s;
 	}
 
+	// Time spent recording the command buffer in the last call to render
+	double get_cpu_time() const
+	{
+		return cpu_time_s;
+	}
+
+	// Number of draw calls and of culled primitives per view in the last frame
+	size_t get_draw_count() const
+	{
+		return last_stats.draw_count / std::max<size_t>(1, last_stats.view_count);
+	}
+
+	size_t get_culled_count() const
+	{
+		return last_stats.culled_count / std::max<size_t>(1, last_stats.view_count);
+	}
+
 	std::shared_ptr<scene_data::material> get_default_material()
 	{
 		return default_material;
@@ -19,7 +19,9 @@
 #include "text_rasterizer.h"
 #include "application.h"
 #include "vk/allocation.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <limits>
 #include <system_error>
 #include <vector>
@@ -111,9 +113,10 @@ text_rasterizer::text_rasterizer(vk::raii::Device & device, vk::raii::PhysicalDe
 		if (err)
 			throw std::system_error(err, error_category);
 
-		err = FT_Set_Char_Size(face, 0, 200 * 64, 72, 72);
+		err = FT_Set_Pixel_Sizes(face, 0, default_pixel_size);
 		if (err)
 			throw std::system_error(err, error_category);
+		pixel_size = default_pixel_size;
 
 		font = hb_ft_font_create(face, nullptr);
 
@@ -161,7 +164,7 @@ image_allocation text_rasterizer::create_image(vk::Extent2D size)
 	                               .usage = VMA_MEMORY_USAGE_AUTO,
 	                       }};
 
-	application::set_debug_reports_name<vk::Image>(alloc, "text_rasterizer image");
+	application::set_debug_reports_name<vk::Image>(alloc, "text_rasterizer atlas");
 	return alloc;
 }
 
@@ -188,7 +191,76 @@ text_rasterizer::~text_rasterizer()
 	FT_Done_FreeType(freetype);
 }
 
-text text_rasterizer::render(std::string_view s)
+const text_rasterizer::atlas_glyph & text_rasterizer::get_glyph(hb_codepoint_t index)
+{
+	glyph_key key{face, pixel_size, index};
+	auto it = glyphs.find(key);
+	if (it != glyphs.end())
+		return it->second;
+
+	FT_Error err = FT_Load_Glyph(face, index, FT_LOAD_DEFAULT);
+	if (err)
+		throw std::system_error(err, error_category);
+
+	err = FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL);
+	if (err)
+		throw std::system_error(err, error_category);
+
+	FT_GlyphSlot slot = face->glyph;
+	FT_Bitmap & bitmap = slot->bitmap;
+
+	// Keep one empty pixel around glyphs so that filtering does not read their neighbours
+	uint32_t width = bitmap.width + 1;
+	uint32_t height = bitmap.rows + 1;
+	if (width > atlas_width)
+		throw std::runtime_error("Glyph too large for the atlas");
+
+	if (shelf_x + width > atlas_width)
+	{
+		shelf_y += shelf_height;
+		shelf_x = 0;
+		shelf_height = 0;
+	}
+
+	while (shelf_y + height > atlas_height)
+	{
+		if (atlas_height >= atlas_max_height)
+			throw std::runtime_error("Glyph atlas is full");
+		atlas_height = atlas_height ? atlas_height * 2 : 256;
+		atlas_pixels.resize(atlas_width * atlas_height, 0);
+		atlas_grown = true;
+	}
+
+	for (unsigned int iy = 0; iy < bitmap.rows; iy++)
+		memcpy(atlas_pixels.data() + (shelf_y + iy) * atlas_width + shelf_x, bitmap.buffer + iy * bitmap.pitch, bitmap.width);
+
+	if (dirty_begin == dirty_end)
+	{
+		dirty_begin = shelf_y;
+		dirty_end = shelf_y + bitmap.rows;
+	}
+	else
+	{
+		dirty_begin = std::min(dirty_begin, shelf_y);
+		dirty_end = std::max(dirty_end, shelf_y + bitmap.rows);
+	}
+
+	atlas_glyph g{
+	        .rect = {
+	                .offset = {int32_t(shelf_x), int32_t(shelf_y)},
+	                .extent = {bitmap.width, bitmap.rows},
+	        },
+	        .left = slot->bitmap_left,
+	        .top = slot->bitmap_top,
+	};
+
+	shelf_x += width;
+	shelf_height = std::max(shelf_height, height);
+
+	return glyphs.emplace(key, g).first->second;
+}
+
+text_rasterizer::layout text_rasterizer::shape(std::string_view s)
 {
 	hb_buffer_reset(buffer);
 
@@ -207,96 +279,83 @@ text text_rasterizer::render(std::string_view s)
 	hb_glyph_info_t * glyphInfo = hb_buffer_get_glyph_infos(buffer, &glyphCount);
 	hb_glyph_position_t * glyphPos = hb_buffer_get_glyph_positions(buffer, &glyphCount);
 
+	if (glyphCount == 0)
+		return {};
+
 	int x_min = std::numeric_limits<int>::max();
 	int x_max = std::numeric_limits<int>::min();
 	int y_min = std::numeric_limits<int>::max();
 	int y_max = std::numeric_limits<int>::min();
 
-	FT_Int32 flags = FT_LOAD_DEFAULT;
-
-	std::vector<uint8_t> rendered_text;
+	struct placed_glyph
+	{
+		const atlas_glyph * glyph;
+		int x0;
+		int y0;
+	};
+	std::vector<placed_glyph> placed;
+	placed.reserve(glyphCount);
 
-	for (int pass = 0; pass < 2; pass++)
+	FT_F26Dot6 x = 0;
+	FT_F26Dot6 y = 0;
+	for (size_t i = 0; i < glyphCount; ++i)
 	{
-		FT_F26Dot6 x = 0;
-		FT_F26Dot6 y = 0;
-		for (size_t i = 0; i < glyphCount; ++i)
-		{
-			FT_Error err = FT_Load_Glyph(face, glyphInfo[i].codepoint, flags);
-			if (err)
-				throw std::system_error(err, error_category);
-
-			err = FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL);
-			if (err)
-				throw std::system_error(err, error_category);
-
-			FT_GlyphSlot slot = face->glyph;
-			FT_Bitmap bitmap = face->glyph->bitmap;
-
-			int x0 = (x + glyphPos[i].x_offset) / 64 + slot->bitmap_left;
-			int y0 = (y + glyphPos[i].y_offset) / 64 + slot->bitmap_top;
-			int x1 = x0 + bitmap.width;
-			int y1 = y0 - bitmap.rows;
-
-			assert(x1 >= x0);
-			assert(y1 <= y0);
-
-			switch (pass)
-			{
-				case 0:
-					x_min = std::min(x_min, x0);
-					x_max = std::max(x_max, x1);
-					y_min = std::min(y_min, y1);
-					y_max = std::max(y_max, y0);
-					break;
-
-				case 1: {
-					uint8_t * src = bitmap.buffer;
-					for (unsigned int iy = 0; iy < bitmap.rows; iy++)
-					{
-						uint8_t * dst = rendered_text.data() +
-						                (y_max - y0 + iy) * (x_max - x_min) + (x0 - x_min);
-
-						for (unsigned int ix = 0; ix < bitmap.width; ix++)
-						{
-							*dst = std::max(*dst, *src);
-							dst++;
-							src++;
-						}
-					}
-				}
-				break;
-			}
-
-			x += glyphPos[i].x_advance;
-			y += glyphPos[i].y_advance;
-		}
+		const atlas_glyph & g = get_glyph(glyphInfo[i].codepoint);
 
-		if (pass == 0)
-		{
-			assert(x_max > x_min);
-			assert(y_max > y_min);
-			rendered_text.resize((x_max - x_min) * (y_max - y_min), 0);
-		}
+		int x0 = (x + glyphPos[i].x_offset) / 64 + g.left;
+		int y0 = (y + glyphPos[i].y_offset) / 64 + g.top;
+		int x1 = x0 + g.rect.extent.width;
+		int y1 = y0 - g.rect.extent.height;
+
+		x_min = std::min(x_min, x0);
+		x_max = std::max(x_max, x1);
+		y_min = std::min(y_min, y1);
+		y_max = std::max(y_max, y0);
+
+		placed.push_back({&g, x0, y0});
+
+		x += glyphPos[i].x_advance;
+		y += glyphPos[i].y_advance;
 	}
-#ifdef TEST
-	return {.bitmap = std::move(rendered_text),
+
+	layout result{
 	        .size = {
 	                .width = uint32_t(x_max - x_min),
 	                .height = uint32_t(y_max - y_min),
-	        }};
-#else
+	        },
+	};
 
-	text return_value;
+	for (const auto & [g, x0, y0]: placed)
+	{
+		if (g->rect.extent.width == 0 or g->rect.extent.height == 0)
+			continue;
+
+		result.glyphs.push_back({
+		        .atlas_rect = g->rect,
+		        .position = {x0 - x_min, y_max - y0},
+		});
+	}
+
+	return result;
+}
 
-	return_value.size.width = x_max - x_min;
-	return_value.size.height = y_max - y_min;
-	return_value.image = create_image(return_value.size);
+void text_rasterizer::upload()
+{
+#ifndef TEST
+	if (not atlas_grown and dirty_begin == dirty_end)
+		return;
 
-	buffer_allocation staging_buffer = create_buffer(rendered_text.size());
+	if (atlas_grown)
+	{
+		// The new image has no content, upload all the glyphs
+		atlas_image = std::make_shared<image_allocation>(create_image({atlas_width, atlas_height}));
+		staging_buffer = create_buffer(atlas_pixels.size());
+		dirty_begin = 0;
+		dirty_end = shelf_y + shelf_height;
+	}
 
-	void * mapped = staging_buffer.map();
-	memcpy(mapped, rendered_text.data(), rendered_text.size());
+	size_t offset = size_t(dirty_begin) * atlas_width;
+	memcpy((uint8_t *)staging_buffer.map() + offset, atlas_pixels.data() + offset, size_t(dirty_end - dirty_begin) * atlas_width);
 
 	vk::raii::CommandBuffers cmdbufs(device, {
 	                                                 .commandPool = *command_pool,
@@ -308,12 +367,13 @@ text text_rasterizer::render(std::string_view s)
 
 	cmdbuf.begin({});
 
+	// New glyphs are written where no existing text samples the atlas
 	vk::ImageMemoryBarrier barrier{
 	        .srcAccessMask = vk::AccessFlagBits::eNone,
 	        .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
-	        .oldLayout = vk::ImageLayout::eUndefined,
-	        .newLayout = vk::ImageLayout::eTransferDstOptimal,
-	        .image = return_value.image,
+	        .oldLayout = atlas_grown ? vk::ImageLayout::eUndefined : text::layout,
+	        .newLayout = text::layout,
+	        .image = *atlas_image,
 	        .subresourceRange = {
 	                .aspectMask = vk::ImageAspectFlagBits::eColor,
 	                .baseMipLevel = 0,
@@ -322,10 +382,10 @@ text text_rasterizer::render(std::string_view s)
 	                .layerCount = 1,
 	        },
 	};
-	cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags{}, {}, {}, barrier);
+	cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags{}, {}, {}, barrier);
 
 	vk::BufferImageCopy copy_info{
-	        .bufferOffset = 0,
+	        .bufferOffset = offset,
 	        .bufferRowLength = 0,
 	        .bufferImageHeight = 0,
 	        .imageSubresource = {
@@ -334,21 +394,19 @@ text text_rasterizer::render(std::string_view s)
 	                .baseArrayLayer = 0,
 	                .layerCount = 1,
 	        },
-	        .imageOffset = {0, 0, 0},
+	        .imageOffset = {0, int32_t(dirty_begin), 0},
 	        .imageExtent = {
-	                .width = uint32_t(x_max - x_min),
-	                .height = uint32_t(y_max - y_min),
+	                .width = atlas_width,
+	                .height = dirty_end - dirty_begin,
 	                .depth = 1,
 	        },
 	};
-	cmdbuf.copyBufferToImage(staging_buffer, return_value.image, vk::ImageLayout::eTransferDstOptimal, copy_info);
+	cmdbuf.copyBufferToImage(staging_buffer, *atlas_image, text::layout, copy_info);
 
 	barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-	barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
-	barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-	barrier.newLayout = text::layout;
-	barrier.subresourceRange.baseMipLevel = 0;
-	cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlags{}, {}, {}, barrier);
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+	barrier.oldLayout = text::layout;
+	cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags{}, {}, {}, barrier);
 
 	cmdbuf.end();
 
@@ -358,8 +416,60 @@ text text_rasterizer::render(std::string_view s)
 	if (device.waitForFences(*fence, VK_TRUE, UINT64_MAX) == vk::Result::eTimeout)
 		throw std::runtime_error("Vulkan fence timeout");
 	device.resetFences(*fence);
+#endif
+
+	dirty_begin = 0;
+	dirty_end = 0;
+	atlas_grown = false;
+}
 
-	return return_value;
+text text_rasterizer::render(std::string_view s, unsigned int size)
+{
+	if (size != pixel_size)
+	{
+		FT_Error err = FT_Set_Pixel_Sizes(face, 0, size);
+		if (err)
+			throw std::system_error(err, error_category);
+		hb_ft_font_changed(font);
+		pixel_size = size;
+	}
+
+	auto key = std::pair(size, std::string(s));
+	auto it = layouts.find(key);
+	if (it == layouts.end())
+	{
+		if (layouts.size() >= max_cached_layouts)
+			layouts.clear();
+		it = layouts.emplace(std::move(key), shape(s)).first;
+	}
+	const layout & l = it->second;
+
+	upload();
+
+#ifdef TEST
+	text result{
+	        .size = l.size,
+	        .glyphs = l.glyphs,
+	};
+	result.bitmap.resize(l.size.width * l.size.height, 0);
+	for (const auto & g: l.glyphs)
+	{
+		for (uint32_t iy = 0; iy < g.atlas_rect.extent.height; iy++)
+		{
+			const uint8_t * src = atlas_pixels.data() + (g.atlas_rect.offset.y + iy) * atlas_width + g.atlas_rect.offset.x;
+			uint8_t * dst = result.bitmap.data() + (g.position.y + iy) * l.size.width + g.position.x;
+			for (uint32_t ix = 0; ix < g.atlas_rect.extent.width; ix++)
+				dst[ix] = std::max(dst[ix], src[ix]);
+		}
+	}
+	return result;
+#else
+	return text{
+	        .size = l.size,
+	        .glyphs = l.glyphs,
+	        .image = atlas_image,
+	        .image_size = {atlas_width, atlas_height},
+	};
 #endif
 }
 
@@ -21,21 +21,39 @@
 #include <vulkan/vulkan_raii.hpp>
 
 #include "vk/allocation.h"
+#include <compare>
+#include <cstdint>
 #include <freetype/freetype.h>
 #include <ft2build.h>
 #include <hb.h>
+#include <map>
+#include <memory>
+#include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 struct text
 {
+	// Size of the laid out text, in pixels
 	vk::Extent2D size;
 
+	// Rectangle of a glyph in the atlas, and position of its top left corner in the text
+	struct glyph
+	{
+		vk::Rect2D atlas_rect;
+		vk::Offset2D position;
+	};
+	std::vector<glyph> glyphs;
+
 #ifndef TEST
 	static inline const vk::Format format = vk::Format::eR8Unorm;
-	static inline const vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	// The atlas is sampled while new glyphs are uploaded to unused areas
+	static inline const vk::ImageLayout layout = vk::ImageLayout::eGeneral;
 	static inline const vk::ImageTiling tiling = vk::ImageTiling::eOptimal;
-	image_allocation image;
+	// Glyph atlas, kept alive when the atlas grows into a new image
+	std::shared_ptr<image_allocation> image;
+	vk::Extent2D image_size;
 
 #else
 	std::vector<uint8_t> bitmap;
@@ -52,17 +70,67 @@ class text_rasterizer
 
 	FT_Library freetype{};
 	FT_Face face{};
+	unsigned int pixel_size = 0;
 
 	hb_font_t * font{};
 	hb_buffer_t * buffer{};
 
+	// Glyphs are packed in rows of a fixed width image, its height doubles
+	// when it is full. Glyphs are never evicted, so their position is stable.
+	struct glyph_key
+	{
+		FT_Face face;
+		unsigned int size;
+		hb_codepoint_t index;
+		auto operator<=>(const glyph_key &) const = default;
+	};
+	struct atlas_glyph
+	{
+		vk::Rect2D rect;
+		int left;
+		int top;
+	};
+	static constexpr uint32_t atlas_width = 2048;
+	static constexpr uint32_t atlas_max_height = 8192;
+	std::map<glyph_key, atlas_glyph> glyphs;
+	std::vector<uint8_t> atlas_pixels;
+	uint32_t atlas_height = 0;
+	uint32_t shelf_x = 0;
+	uint32_t shelf_y = 0;
+	uint32_t shelf_height = 0;
+	// Rows written since the last upload
+	uint32_t dirty_begin = 0;
+	uint32_t dirty_end = 0;
+	bool atlas_grown = false;
+
+#ifndef TEST
+	std::shared_ptr<image_allocation> atlas_image;
+	buffer_allocation staging_buffer;
+#endif
+
+	// Laid out strings by pixel size, cleared when full
+	static constexpr size_t max_cached_layouts = 256;
+	struct layout
+	{
+		vk::Extent2D size;
+		std::vector<text::glyph> glyphs;
+	};
+	std::map<std::pair<unsigned int, std::string>, layout> layouts;
+
+	const atlas_glyph & get_glyph(hb_codepoint_t index);
+	layout shape(std::string_view s);
+	void upload();
+
 	image_allocation create_image(vk::Extent2D size);
 	buffer_allocation create_buffer(size_t size);
 	vk::raii::DeviceMemory allocate_memory(vk::Buffer buffer, vk::MemoryPropertyFlags flags);
 
 public:
+	static constexpr unsigned int default_pixel_size = 200;
+
 	text_rasterizer(vk::raii::Device & device, vk::raii::PhysicalDevice & physical_device, vk::raii::CommandPool & command_pool, vk::raii::Queue & queue);
 	~text_rasterizer();
 
-	text render(std::string_view s);
+	// Only new glyphs are rasterized and uploaded, and known strings are not shaped again
+	text render(std::string_view s, unsigned int pixel_size = default_pixel_size);
 };
@@ -29,6 +29,7 @@
 #include "render/scene_renderer.h"
 #include "stream.h"
 #include "utils/contains.h"
+#include "utils/happy_eyeballs.h"
 #include "version.h"
 #include "wivrn_client.h"
 #include "wivrn_packets.h"
@@ -39,6 +40,8 @@
 
 #include "wivrn_discover.h"
 #include <cstdint>
+#include <cstring>
+#include <future>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/matrix.hpp>
 #include <magic_enum.hpp>
@@ -46,6 +49,9 @@
 #include <simdjson.h>
 #include <spdlog/spdlog.h>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <utils/ranges.h>
 #include <vulkan/vulkan_raii.hpp>
 
@@ -177,23 +183,45 @@ scenes::lobby::lobby()
 	keyboard.set_layout(application::get_config().virtual_keyboard_layout);
 }
 
-static std::string ip_address_to_string(const in_addr & addr)
+static std::vector<utils::ip_address> resolve(const std::string & hostname)
 {
-	char buf[100];
-	inet_ntop(AF_INET, &addr, buf, sizeof(buf));
-	return buf;
-}
+	addrinfo hint{
+	        .ai_flags = AI_ADDRCONFIG,
+	        .ai_family = AF_UNSPEC,
+	        .ai_socktype = SOCK_STREAM,
+	};
+	addrinfo * addresses;
+	if (int err = getaddrinfo(hostname.c_str(), nullptr, &hint, &addresses))
+	{
+		spdlog::error("Cannot resolve hostname {}: {}", hostname, gai_strerror(err));
+		throw std::runtime_error(fmt::format(_F("Cannot resolve hostname: {}"), _(gai_strerror(err))));
+	}
 
-static std::string ip_address_to_string(const in6_addr & addr)
-{
-	char buf[100];
-	inet_ntop(AF_INET6, &addr, buf, sizeof(buf));
-	return buf;
+	std::vector<utils::ip_address> result;
+	for (auto i = addresses; i; i = i->ai_next)
+	{
+		switch (i->ai_family)
+		{
+			case AF_INET:
+				result.push_back(((sockaddr_in *)i->ai_addr)->sin_addr);
+				break;
+			case AF_INET6: {
+				auto & sa6 = *(sockaddr_in6 *)i->ai_addr;
+				result.push_back(utils::make_ip_address(sa6.sin6_addr, sa6.sin6_scope_id));
+				break;
+			}
+		}
+	}
+
+	freeaddrinfo(addresses);
+	return result;
 }
 
-std::unique_ptr<wivrn_session> connect_to_session(wivrn_discover::service service, bool manual_connection)
+// discovered is true when the service comes from a current mDNS answer, its addresses and TXT record are
+// then up to date. Otherwise the hostname is resolved while the last address that worked is tried.
+std::unique_ptr<wivrn_session> connect_to_session(wivrn_discover::service service, bool discovered, std::optional<utils::ip_address> last_address)
 {
-	if (!manual_connection)
+	if (discovered)
 	{
 		char protocol_string[17];
 		sprintf(protocol_string, "%016lx", wivrn::protocol_version);
@@ -213,65 +241,58 @@ std::unique_ptr<wivrn_session> connect_to_session(wivrn_discover::service servic
 			throw std::runtime_error(fmt::format(_F("Incompatible WiVRn server protocol (client: {}, server: {})"), protocol_string, protocol->second));
 	}
 
-	// Only the automatically discovered servers already have their IP addresses available
-	if (manual_connection)
+	// The resolver thread owns its state and is joined when leaving this function, it
+	// cannot outlive the connection attempt
+	std::future<std::vector<utils::ip_address>> resolved;
+	std::jthread resolver;
+	if (not discovered)
 	{
-		addrinfo hint{
-		        .ai_flags = AI_ADDRCONFIG,
-		        .ai_family = AF_UNSPEC,
-		        .ai_socktype = SOCK_STREAM,
-		};
-		addrinfo * addresses;
-		if (int err = getaddrinfo(service.hostname.c_str(), nullptr, &hint, &addresses))
-		{
-			spdlog::error("Cannot resolve hostname {}: {}", service.hostname, gai_strerror(err));
-			throw std::runtime_error(fmt::format(_F("Cannot resolve hostname: {}"), _(gai_strerror(err))));
-		}
-
-		for (auto i = addresses; i; i = i->ai_next)
-		{
-			switch (i->ai_family)
+		std::promise<std::vector<utils::ip_address>> promise;
+		resolved = promise.get_future();
+		resolver = std::jthread([promise = std::move(promise), hostname = service.hostname]() mutable {
+			try
 			{
-				case AF_INET:
-					service.addresses.push_back(((sockaddr_in *)i->ai_addr)->sin_addr);
-					break;
-				case AF_INET6:
-					service.addresses.push_back(((sockaddr_in6 *)i->ai_addr)->sin6_addr);
-					break;
+				promise.set_value(resolve(hostname));
 			}
-		}
-
-		freeaddrinfo(addresses);
+			catch (...)
+			{
+				promise.set_exception(std::current_exception());
+			}
+		});
 	}
 
-	std::string error;
+	// The last address that worked is tried first, for discovered servers too, the other
+	// addresses join the race after connection_attempt_delay
+	std::vector<utils::ip_address> addresses;
+	if (last_address)
+		addresses.push_back(*last_address);
 	for (const auto & address: service.addresses)
 	{
-		std::string address_string = std::visit([](auto & address) {
-			return ip_address_to_string(address);
-		},
-		                                        address);
-
-		try
-		{
-			spdlog::debug("Trying address {}", address_string);
+		if (auto * address4 = std::get_if<in_addr>(&address))
+			addresses.push_back(*address4);
+		else
+			addresses.push_back(utils::make_ip_address(std::get<in6_addr>(address)));
+	}
 
-			return std::visit([port = service.port, tcp_only = service.tcp_only](auto & address) {
-				return std::make_unique<wivrn_session>(address, port, tcp_only);
-			},
-			                  address);
-		}
-		catch (std::exception & e)
+	utils::connection connection;
+	try
+	{
+		connection = utils::happy_eyeballs(addresses, service.port, std::move(resolved));
+	}
+	catch (utils::connection_error & e)
+	{
+		std::string error;
+		for (const auto & [address, message]: e.errors)
 		{
-			spdlog::warn("Cannot connect to {} ({}): {}", service.hostname, address_string, e.what());
-			std::string txt = fmt::format(_F("Cannot connect to {} ({}): {}"), service.hostname, address_string, e.what());
+			spdlog::warn("Cannot connect to {} ({}): {}", service.hostname, utils::to_string(address), message);
 			if (not error.empty())
 				error += "\n";
-			error += txt;
+			error += fmt::format(_F("Cannot connect to {} ({}): {}"), service.hostname, utils::to_string(address), message);
 		}
+		throw std::runtime_error(error.empty() ? e.what() : error);
 	}
 
-	throw std::runtime_error(error);
+	return std::make_unique<wivrn_session>(connection.fd, connection.address, service.port, service.tcp_only);
 }
 
 static glm::mat4 projection_matrix(XrFovf fov, float zn = 0.02)
@@ -376,13 +397,36 @@ void scenes::lobby::connect(const configuration::server_data & data)
 	server_name = data.service.name;
 	async_error.reset();
 
+	connecting_cookie.clear();
+	for (const auto & [cookie, server]: application::get_config().servers)
+	{
+		if (&server == &data)
+			connecting_cookie = cookie;
+	}
+
 	async_session = utils::async<std::unique_ptr<wivrn_session>, std::string>(
-	        [](auto token, wivrn_discover::service service, bool manual) {
+	        [](auto token, wivrn_discover::service service, bool discovered, std::optional<utils::ip_address> last_address) {
 		        token.set_progress(_("Waiting for connection"));
-		        return connect_to_session(service, manual);
+		        return connect_to_session(service, discovered, last_address);
 	        },
 	        data.service,
-	        data.manual);
+	        not data.manual and data.visible,
+	        utils::parse_ip_address(data.last_address));
+}
+
+void scenes::lobby::remember_address(const wivrn_session & session)
+{
+	auto & config = application::get_config();
+	auto server = config.servers.find(connecting_cookie);
+	if (server == config.servers.end())
+		return;
+
+	std::string address = utils::to_string(session.address);
+	if (server->second.last_address == address)
+		return;
+
+	server->second.last_address = address;
+	config.save();
 }
 
 std::optional<glm::vec3> scenes::lobby::check_recenter_gesture(const std::array<xr::hand_tracker::joint, XR_HAND_JOINT_COUNT_EXT> & joints)
@@ -606,6 +650,67 @@ static glm::vec4 compute_ray_limits(const XrPosef & pose, float margin = 0)
 	return glm::vec4(normal, -glm::dot(p, normal) - margin);
 }
 
+static void hash_combine(size_t & seed, size_t value)
+{
+	seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+template <typename T>
+static void hash_floats(size_t & seed, const T & value)
+{
+	static_assert(std::is_trivially_copyable_v<T>);
+	hash_combine(seed, std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char *>(&value), sizeof(value))));
+}
+
+// Everything in the scene that can change the rendered image, the meshes and materials are not modified once loaded
+static size_t hash_scene(const scene_data & scene, const std::array<float, 4> & clear_color)
+{
+	size_t hash = 0;
+	hash_floats(hash, clear_color);
+
+	for (const scene_data::node & node: scene.scene_nodes)
+	{
+		hash_combine(hash, node.visible);
+		if (not node.visible)
+			continue;
+
+		hash_floats(hash, node.position);
+		hash_floats(hash, node.orientation);
+		hash_floats(hash, node.scale);
+		hash_floats(hash, node.clipping_planes);
+		hash_combine(hash, node.layer_mask);
+	}
+
+	return hash;
+}
+
+bool scenes::lobby::layer_cache::matches(const std::vector<XrView> & new_views, size_t new_scene_hash) const
+{
+	if (not valid or scene_hash != new_scene_hash or views.size() != new_views.size())
+		return false;
+
+	for (auto && [old_view, new_view]: std::views::zip(views, new_views))
+	{
+		if (memcmp(&old_view.fov, &new_view.fov, sizeof(XrFovf)))
+			return false;
+
+		glm::vec3 old_position{old_view.pose.position.x, old_view.pose.position.y, old_view.pose.position.z};
+		glm::vec3 new_position{new_view.pose.position.x, new_view.pose.position.y, new_view.pose.position.z};
+		if (glm::distance(old_position, new_position) > constants::lobby::rerender_position_threshold)
+			return false;
+
+		glm::quat old_orientation{old_view.pose.orientation.w, old_view.pose.orientation.x, old_view.pose.orientation.y, old_view.pose.orientation.z};
+		glm::quat new_orientation{new_view.pose.orientation.w, new_view.pose.orientation.x, new_view.pose.orientation.y, new_view.pose.orientation.z};
+
+		// The vector part of the relative rotation is sin(angle/2), accurate for small angles
+		glm::quat delta = new_orientation * glm::conjugate(old_orientation);
+		if (2 * glm::length(glm::vec3(delta.x, delta.y, delta.z)) > constants::lobby::rerender_angle_threshold)
+			return false;
+	}
+
+	return true;
+}
+
 void scenes::lobby::render(const XrFrameState & frame_state)
 {
 	if (async_session.valid() && async_session.poll() == utils::future_status::ready)
@@ -614,7 +719,10 @@ void scenes::lobby::render(const XrFrameState & frame_state)
 		{
 			auto session = async_session.get();
 			if (session)
+			{
+				remember_address(*session);
 				next_scene = stream::create(std::move(session), 1'000'000'000.f / frame_state.predictedDisplayPeriod);
+			}
 
 			async_session.reset();
 		}
@@ -761,6 +869,7 @@ void scenes::lobby::render(const XrFrameState & frame_state)
 	}
 
 	std::vector<std::pair<int, XrCompositionLayerQuad>> imgui_layers = draw_gui(frame_state.predictedDisplayTime);
+	update_idle_refresh_rate();
 
 	// Get the planes that limit the ray size from the composition layers
 	std::vector<glm::vec4> ray_limits;
@@ -773,12 +882,6 @@ void scenes::lobby::render(const XrFrameState & frame_state)
 	input->apply(world_space, frame_state.predictedDisplayTime, hide_left_controller, hide_right_controller, ray_limits);
 
 	assert(renderer);
-	renderer->start_frame();
-
-	std::vector<XrCompositionLayerProjectionView> lobby_layer_views;
-	std::vector<XrCompositionLayerDepthInfoKHR> lobby_depth_layer_views;
-	std::vector<XrCompositionLayerProjectionView> controllers_layer_views;
-	std::vector<XrCompositionLayerDepthInfoKHR> controllers_depth_layer_views;
 
 	std::array<float, 4> clear_color;
 
@@ -789,69 +892,119 @@ void scenes::lobby::render(const XrFrameState & frame_state)
 	else
 		clear_color = constants::lobby::sky_color;
 
-	if (composition_layer_depth_test_supported)
-	{
-		std::tie(lobby_layer_views, lobby_depth_layer_views) = render_layer(
-		        views,
-		        swapchains_lobby,
-		        swapchains_lobby_depth,
-		        *renderer,
-		        *lobby_scene,
-		        clear_color);
-		for (auto [color, depth]: std::views::zip(lobby_layer_views, lobby_depth_layer_views))
-			color.next = &depth;
-
-		std::tie(controllers_layer_views, controllers_depth_layer_views) = render_layer(
-		        views,
-		        swapchains_controllers,
-		        swapchains_controllers_depth,
-		        *renderer,
-		        *controllers_scene,
-		        {0, 0, 0, 0});
-		for (auto [color, depth]: std::views::zip(controllers_layer_views, controllers_depth_layer_views))
-			color.next = &depth;
-
-		renderer->end_frame();
-
-		// After end_frame because the command buffers are submitted in end_frame
-		for (auto & swapchain: swapchains_lobby)
-			swapchain.release();
-
-		for (auto & swapchain: swapchains_lobby_depth)
-			swapchain.release();
-
-		for (auto & swapchain: swapchains_controllers)
-			swapchain.release();
-
-		for (auto & swapchain: swapchains_controllers_depth)
-			swapchain.release();
-	}
-	else
+	// The swapchains keep the last released image: only record new command buffers when the
+	// scene or the head pose changed, otherwise resubmit the previous layers and let the runtime
+	// reproject them
+	size_t lobby_hash = hash_scene(*lobby_scene, clear_color);
+	size_t controllers_hash = hash_scene(*controllers_scene, {0, 0, 0, 0});
+	bool render_lobby = not lobby_layer_cache.matches(views, lobby_hash);
+	bool render_controllers = not controllers_layer_cache.matches(views, controllers_hash);
+
+	if (render_lobby or render_controllers)
 	{
-		lobby_layer_views = render_layer(
-		        views,
-		        swapchains_lobby,
-		        *renderer,
-		        *lobby_scene,
-		        clear_color);
-
-		controllers_layer_views = render_layer(
-		        views,
-		        swapchains_controllers,
-		        *renderer,
-		        *controllers_scene,
-		        {0, 0, 0, 0});
-
-		renderer->end_frame();
-
-		// After end_frame because the command buffers are submitted in end_frame
-		for (auto & swapchain: swapchains_lobby)
-			swapchain.release();
-
-		for (auto & swapchain: swapchains_controllers)
-			swapchain.release();
+		renderer->start_frame();
+
+		if (composition_layer_depth_test_supported)
+		{
+			if (render_lobby)
+			{
+				std::tie(lobby_layer_cache.color, lobby_layer_cache.depth) = render_layer(
+				        views,
+				        swapchains_lobby,
+				        swapchains_lobby_depth,
+				        *renderer,
+				        *lobby_scene,
+				        clear_color);
+				for (auto [color, depth]: std::views::zip(lobby_layer_cache.color, lobby_layer_cache.depth))
+					color.next = &depth;
+			}
+
+			if (render_controllers)
+			{
+				std::tie(controllers_layer_cache.color, controllers_layer_cache.depth) = render_layer(
+				        views,
+				        swapchains_controllers,
+				        swapchains_controllers_depth,
+				        *renderer,
+				        *controllers_scene,
+				        {0, 0, 0, 0});
+				for (auto [color, depth]: std::views::zip(controllers_layer_cache.color, controllers_layer_cache.depth))
+					color.next = &depth;
+			}
+
+			renderer->end_frame();
+
+			// After end_frame because the command buffers are submitted in end_frame
+			if (render_lobby)
+			{
+				for (auto & swapchain: swapchains_lobby)
+					swapchain.release();
+
+				for (auto & swapchain: swapchains_lobby_depth)
+					swapchain.release();
+			}
+
+			if (render_controllers)
+			{
+				for (auto & swapchain: swapchains_controllers)
+					swapchain.release();
+
+				for (auto & swapchain: swapchains_controllers_depth)
+					swapchain.release();
+			}
+		}
+		else
+		{
+			if (render_lobby)
+				lobby_layer_cache.color = render_layer(
+				        views,
+				        swapchains_lobby,
+				        *renderer,
+				        *lobby_scene,
+				        clear_color);
+
+			if (render_controllers)
+				controllers_layer_cache.color = render_layer(
+				        views,
+				        swapchains_controllers,
+				        *renderer,
+				        *controllers_scene,
+				        {0, 0, 0, 0});
+
+			renderer->end_frame();
+
+			// After end_frame because the command buffers are submitted in end_frame
+			if (render_lobby)
+			{
+				for (auto & swapchain: swapchains_lobby)
+					swapchain.release();
+			}
+
+			if (render_controllers)
+			{
+				for (auto & swapchain: swapchains_controllers)
+					swapchain.release();
+			}
+		}
+
+		if (render_lobby)
+		{
+			lobby_layer_cache.valid = true;
+			lobby_layer_cache.scene_hash = lobby_hash;
+			lobby_layer_cache.views = views;
+		}
+
+		if (render_controllers)
+		{
+			controllers_layer_cache.valid = true;
+			controllers_layer_cache.scene_hash = controllers_hash;
+			controllers_layer_cache.views = views;
+		}
 	}
 
+	const auto & lobby_layer_views = lobby_layer_cache.color;
+	const auto & controllers_layer_views = controllers_layer_cache.color;
+
 	XrCompositionLayerProjection lobby_layer{
 	        .type = XR_TYPE_COMPOSITION_LAYER_PROJECTION,
 	        .layerFlags = XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT,
@@ -942,6 +1095,41 @@ void scenes::lobby::render(const XrFrameState & frame_state)
 	session.end_frame(frame_state.predictedDisplayTime, layers, blend_mode);
 }
 
+void scenes::lobby::update_idle_refresh_rate()
+{
+	if (not instance.has_extension(XR_FB_DISPLAY_REFRESH_RATE_EXTENSION_NAME))
+		return;
+
+	bool idle = imgui_ctx->idle_time() > constants::lobby::idle_delay;
+	if (idle == idle_refresh_rate)
+		return;
+
+	idle_refresh_rate = idle;
+
+	try
+	{
+		if (idle)
+		{
+			auto refresh_rates = session.get_refresh_rates();
+			if (refresh_rates.empty())
+				return;
+
+			float lowest = std::ranges::min(refresh_rates);
+			spdlog::info("Lobby is idle, setting refresh rate to {}", lowest);
+			session.set_refresh_rate(lowest);
+		}
+		else
+		{
+			spdlog::info("Lobby is active, restoring refresh rate");
+			session.set_refresh_rate(application::get_config().preferred_refresh_rate);
+		}
+	}
+	catch (std::exception & e)
+	{
+		spdlog::warn("Failed to change refresh rate: {}", e.what());
+	}
+}
+
 void scenes::lobby::on_focused()
 {
 	recenter_gui = true;
@@ -1145,6 +1333,19 @@ void scenes::lobby::setup_passthrough()
 
 void scenes::lobby::on_unfocused()
 {
+	if (idle_refresh_rate)
+	{
+		idle_refresh_rate = false;
+		try
+		{
+			session.set_refresh_rate(application::get_config().preferred_refresh_rate);
+		}
+		catch (std::exception & e)
+		{
+			spdlog::warn("Failed to restore refresh rate: {}", e.what());
+		}
+	}
+
 	discover.reset();
 
 	renderer->wait_idle(); // Must be before the scene data because the renderer uses its descriptor sets
@@ -1159,6 +1360,8 @@ void scenes::lobby::on_unfocused()
 	right_hand.reset();
 
 	renderer.reset();
+	lobby_layer_cache = {};
+	controllers_layer_cache = {};
 	swapchains_lobby.clear();
 	swapchains_controllers.clear();
 	swapchains_lobby_depth.clear();
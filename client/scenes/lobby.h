@@ -61,6 +61,7 @@ class lobby : public scene_impl<lobby>
 	std::optional<std::string> async_error;
 	std::shared_ptr<stream> next_scene;
 	std::string server_name;
+	std::string connecting_cookie;
 	bool autoconnect_enabled = true;
 
 	std::optional<scene_renderer> renderer;
@@ -84,6 +85,20 @@ class lobby : public scene_impl<lobby>
 	std::vector<xr::swapchain> swapchains_lobby_depth;
 	std::vector<xr::swapchain> swapchains_controllers;
 	std::vector<xr::swapchain> swapchains_controllers_depth;
+
+	// Last rendered projection layer, resubmitted as is while neither the scene nor the head pose change
+	struct layer_cache
+	{
+		bool valid = false;
+		size_t scene_hash = 0;
+		std::vector<XrView> views;
+		std::vector<XrCompositionLayerProjectionView> color;
+		std::vector<XrCompositionLayerDepthInfoKHR> depth;
+
+		bool matches(const std::vector<XrView> & views, size_t scene_hash) const;
+	};
+	layer_cache lobby_layer_cache;
+	layer_cache controllers_layer_cache;
 	xr::swapchain swapchain_imgui;
 	vk::Format swapchain_format;
 	vk::Format depth_format;
@@ -104,6 +119,10 @@ class lobby : public scene_impl<lobby>
 
 	void update_server_list();
 
+	// Lowest refresh rate is requested when the GUI has not changed for a while
+	bool idle_refresh_rate = false;
+	void update_idle_refresh_rate();
+
 	std::vector<std::pair<int, XrCompositionLayerQuad>> draw_gui(XrTime predicted_display_time);
 
 	XrAction recenter_left_action = XR_NULL_HANDLE;
@@ -147,6 +166,7 @@ class lobby : public scene_impl<lobby>
 	void vibrate_on_hover();
 
 	void connect(const configuration::server_data & data);
+	void remember_address(const wivrn_session & session);
 
 	std::optional<glm::vec3> check_recenter_gesture(const std::array<xr::hand_tracker::joint, XR_HAND_JOINT_COUNT_EXT> & joints);
 	std::optional<glm::vec3> check_recenter_action(XrTime predicted_display_time, glm::vec3 head_position);
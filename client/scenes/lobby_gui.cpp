@@ -381,7 +381,8 @@ void scenes::lobby::gui_server_list()
 		button_position.x -= button_size.x + style.WindowPadding.x;
 		ImGui::SetCursorPos(button_position);
 
-		bool enable_connect_button = (data.visible and data.compatible) or data.manual;
+		// Discovered servers that are not currently announced can still be reached at their last address
+		bool enable_connect_button = (data.visible and data.compatible) or data.manual or (not data.visible and not data.last_address.empty());
 		ImGui::BeginDisabled(!enable_connect_button);
 		if (enable_connect_button)
 		{
@@ -407,7 +408,7 @@ void scenes::lobby::gui_server_list()
 		{
 			if (!data.compatible && !data.manual)
 				tooltip(_("Incompatible server version"));
-			else if (!data.visible && !data.manual)
+			else if (!data.visible && !data.manual && data.last_address.empty())
 				tooltip(_("Server not available"));
 		}
 
@@ -657,6 +658,12 @@ void scenes::lobby::gui_debug()
 
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(20, 20));
 
+	ImGui::Text("Scene: %zu draw calls, %zu culled primitives per view, CPU %.2f ms, GPU %.2f ms",
+	            renderer->get_draw_count(),
+	            renderer->get_culled_count(),
+	            renderer->get_cpu_time() * 1'000,
+	            renderer->get_gpu_time() * 1'000);
+
 	ImGui::Checkbox("Display debug axes", &display_debug_axes);
 	vibrate_on_hover();
 
@@ -134,7 +134,9 @@ std::shared_ptr<scenes::stream> scenes::stream::create(std::unique_ptr<wivrn_ses
 
 	info.supported_codecs = decoder_impl::supported_codecs();
 
-	self->network_session->send_control(info);
+	self->headset_info = info;
+	if (not self->network_session->send_control(info))
+		throw std::runtime_error("Connection lost before sending the headset information");
 
 	self->network_thread = utils::named_thread("network_thread", &stream::process_packets, self.get());
 
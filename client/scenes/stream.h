@@ -80,6 +80,7 @@ private:
 	};
 
 	std::unique_ptr<wivrn_session> network_session;
+	from_headset::headset_info_packet headset_info;
 	std::atomic<bool> exiting = false;
 	std::thread network_thread;
 	std::mutex tracking_control_mutex;
@@ -110,6 +111,12 @@ private:
 	};
 	std::array<haptics_action, 2> haptics_actions;
 	std::vector<std::tuple<device_id, XrAction, XrActionType>> input_actions;
+	// Last value sent for each input, only changes are sent between keyframes
+	std::array<float, size_t(device_id::EYE_GAZE) + 1> inputs_sent{};
+	// Number of packets that still have to repeat each input
+	std::array<uint8_t, size_t(device_id::EYE_GAZE) + 1> inputs_repeat{};
+	uint32_t inputs_sequence = 0;
+	XrTime inputs_keyframe_time = 0;
 
 	state state_ = state::initializing;
 
@@ -145,6 +152,7 @@ public:
 	void operator()(to_headset::tracking_control &&);
 	void operator()(to_headset::audio_stream_description &&);
 	void operator()(to_headset::video_stream_description &&);
+	void operator()(to_headset::refresh_rate_change &&);
 	void operator()(audio_data &&);
 
 	void push_blit_handle(wivrn::shard_accumulator * decoder, std::shared_ptr<wivrn::shard_accumulator::blit_handle> handle);
@@ -165,6 +173,7 @@ public:
 
 private:
 	void process_packets();
+	bool resume_session();
 	void tracking();
 	void read_actions();
 
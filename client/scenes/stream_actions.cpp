@@ -18,12 +18,47 @@
  */
 
 #include "application.h"
+#include "constants.h"
 #include "stream.h"
+#include <cmath>
 #include <spdlog/spdlog.h>
 
 void scenes::stream::read_actions()
 {
-	from_headset::inputs inputs;
+	XrTime now = instance.now();
+	bool keyframe = now - inputs_keyframe_time >= constants::stream::input_keyframe_interval;
+	if (keyframe)
+		inputs_keyframe_time = now;
+
+	from_headset::inputs inputs{
+	        .sequence = inputs_sequence++,
+	};
+
+	auto add = [&](device_id id, float value, XrTime last_change_time, bool analog) {
+		float & sent = inputs_sent[size_t(id)];
+		uint8_t & repeat = inputs_repeat[size_t(id)];
+		bool changed;
+		if (analog)
+			// Always send the end positions so that released triggers read 0
+			changed = std::abs(value - sent) > constants::stream::input_deadband or
+			          (value != sent and (value == 0 or std::abs(value) == 1));
+		else
+			changed = value != sent;
+
+		if (changed)
+			repeat = constants::stream::input_repeats;
+		else if (repeat > 0)
+		{
+			--repeat;
+			changed = true;
+		}
+
+		if (changed or keyframe)
+		{
+			sent = value;
+			inputs.values.push_back({id, value, last_change_time});
+		}
+	};
 
 	for (const auto & [id, action, action_type]: input_actions)
 	{
@@ -32,14 +67,14 @@ void scenes::stream::read_actions()
 			case XR_ACTION_TYPE_BOOLEAN_INPUT: {
 				auto value = application::read_action_bool(action);
 				if (value)
-					inputs.values.push_back({id, (float)value->second, value->first});
+					add(id, (float)value->second, value->first, false);
 			}
 			break;
 
 			case XR_ACTION_TYPE_FLOAT_INPUT: {
 				auto value = application::read_action_float(action);
 				if (value)
-					inputs.values.push_back({id, value->second, value->first});
+					add(id, value->second, value->first, true);
 			}
 			break;
 
@@ -47,8 +82,8 @@ void scenes::stream::read_actions()
 				auto value = application::read_action_vec2(action);
 				if (value)
 				{
-					inputs.values.push_back({id, value->second.x, value->first});
-					inputs.values.push_back({(device_id)((int)id + 1), value->second.y, value->first});
+					add(id, value->second.x, value->first, true);
+					add((device_id)((int)id + 1), value->second.y, value->first, true);
 				}
 			}
 			break;
@@ -58,13 +93,21 @@ void scenes::stream::read_actions()
 				break;
 		}
 	}
+
+	if (inputs.values.empty())
+		return;
+
 	try
 	{
-		network_session->send_stream(inputs);
+		// Send everything next time if the packet was dropped during a reconnection
+		if (not network_session->send_stream(inputs))
+			inputs_keyframe_time = 0;
 	}
 	catch (std::exception & e)
 	{
 		spdlog::warn("Exception while sending inputs packet: {}", e.what());
+		// Send everything next time
+		inputs_keyframe_time = 0;
 	}
 }
 
@@ -20,8 +20,12 @@
 #include "stream.h"
 
 #include "application.h"
+#include "constants.h"
 #include "utils/named_thread.h"
+#include <cstring>
+#include <ranges>
 #include <spdlog/spdlog.h>
+#include <thread>
 
 void scenes::stream::process_packets()
 {
@@ -36,12 +40,69 @@ void scenes::stream::process_packets()
 		}
 		catch (std::exception & e)
 		{
-			spdlog::info("Exception in network thread, exiting: {}", e.what());
-			exit();
+			spdlog::info("Exception in network thread: {}", e.what());
+			if (not resume_session())
+			{
+				spdlog::info("Cannot resume session, exiting");
+				exit();
+			}
 		}
 	}
 }
 
+bool scenes::stream::resume_session()
+{
+	// Nothing to keep if the video stream was not set up yet
+	uint64_t token = network_session->session_token;
+	if (not video_stream_description or token == 0)
+		return false;
+
+	auto deadline = std::chrono::steady_clock::now() + constants::stream::resume_timeout;
+	while (not exiting and std::chrono::steady_clock::now() < deadline)
+	{
+		try
+		{
+			network_session->reconnect(deadline);
+
+			// Decoders, blit pipelines and swapchains are kept if the server accepts the token
+			auto info = headset_info;
+			info.resume_token = token;
+			if (not network_session->send_control(info))
+				throw std::runtime_error("connection lost after the handshake");
+
+			spdlog::info("Session resumed");
+			return true;
+		}
+		catch (std::exception & e)
+		{
+			spdlog::info("Reconnection failed: {}", e.what());
+			std::this_thread::sleep_for(constants::stream::resume_retry_delay);
+		}
+	}
+
+	return false;
+}
+
+static bool same_description(const to_headset::video_stream_description & a, const to_headset::video_stream_description & b)
+{
+	if (a.width != b.width or a.height != b.height or a.fps != b.fps or a.items.size() != b.items.size())
+		return false;
+
+	if (memcmp(a.foveation.data(), b.foveation.data(), sizeof(a.foveation)) != 0)
+		return false;
+
+	for (const auto & [i, j]: std::views::zip(a.items, b.items))
+	{
+		if (i.width != j.width or i.height != j.height or
+		    i.video_width != j.video_width or i.video_height != j.video_height or
+		    i.offset_x != j.offset_x or i.offset_y != j.offset_y or
+		    i.codec != j.codec or i.range != j.range or i.color_model != j.color_model)
+			return false;
+	}
+
+	return true;
+}
+
 void scenes::stream::operator()(to_headset::video_stream_data_shard && shard)
 {
 	std::shared_lock lock(decoder_mutex);
@@ -61,7 +122,11 @@ void scenes::stream::operator()(to_headset::audio_stream_description && desc)
 
 void scenes::stream::operator()(to_headset::video_stream_description && desc)
 {
-	setup(desc);
+	// Sent again after a reconnection, the decoders only need the next IDR frame
+	if (video_stream_description and not decoders.empty() and same_description(*video_stream_description, desc))
+		spdlog::info("Video stream description unchanged, keeping decoders");
+	else
+		setup(desc);
 
 	if (not tracking_thread)
 	{
@@ -69,6 +134,22 @@ void scenes::stream::operator()(to_headset::video_stream_description && desc)
 	}
 }
 
+void scenes::stream::operator()(to_headset::refresh_rate_change && change)
+{
+	if (not instance.has_extension(XR_FB_DISPLAY_REFRESH_RATE_EXTENSION_NAME))
+		return;
+
+	try
+	{
+		spdlog::info("Server requested refresh rate {}", change.fps);
+		session.set_refresh_rate(change.fps);
+	}
+	catch (std::exception & e)
+	{
+		spdlog::warn("Failed to set refresh rate to {}: {}", change.fps, e.what());
+	}
+}
+
 void scenes::stream::operator()(to_headset::timesync_query && query)
 {
 	from_headset::timesync_response response{};
@@ -194,6 +194,19 @@ void scenes::stream::tracking()
 	const bool hand_tracking = config.check_feature(feature::hand_tracking);
 	const bool face_tracking = config.check_feature(feature::face_tracking);
 
+	// A failed send marks the connection as lost and the network thread resumes the session,
+	// tracking data is dropped until then. Any other exception stops the stream.
+	auto send = [&](auto && packet) {
+		try
+		{
+			network_session->send_stream(std::forward<decltype(packet)>(packet));
+		}
+		catch (std::exception & e)
+		{
+			spdlog::warn("Cannot send tracking data: {}", e.what());
+		}
+	};
+
 	while (not exiting)
 	{
 		try
@@ -300,7 +313,7 @@ void scenes::stream::tracking()
 				timer t2(instance);
 
 				auto status = get_battery_status();
-				network_session->send_stream(from_headset::battery{
+				send(from_headset::battery{
 				        .charge = status.charge.value_or(-1),
 				        .present = status.charge.has_value(),
 				        .charging = status.charging,
@@ -337,7 +350,7 @@ void scenes::stream::tracking()
 					wivrn_session::stream_socket_t::serialize(packets.emplace_back(), i);
 			}
 
-			network_session->send_stream(std::span(packets));
+			send(std::span(packets));
 
 			t0 += tracking_period;
 		}
@@ -0,0 +1,56 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#version 450
+
+#ifdef VERT_SHADER
+layout(push_constant) uniform push_constants
+{
+	vec2 scale;
+	vec2 translate;
+}
+pc;
+
+layout(location = 0) in vec2 in_position;
+layout(location = 1) in vec2 in_uv;
+layout(location = 2) in vec4 in_color;
+
+layout(location = 0) out vec4 out_color;
+layout(location = 1) out vec2 out_uv;
+
+void main()
+{
+	out_color = in_color;
+	out_uv = in_uv;
+	gl_Position = vec4(in_position * pc.scale + pc.translate, 0, 1);
+}
+#endif
+
+#ifdef FRAG_SHADER
+layout(set = 0, binding = 0) uniform sampler2D tex;
+
+layout(location = 0) in vec4 in_color;
+layout(location = 1) in vec2 in_uv;
+
+layout(location = 0) out vec4 out_color;
+
+void main()
+{
+	out_color = in_color * texture(tex, in_uv);
+}
+#endif
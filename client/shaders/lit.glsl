@@ -39,17 +39,22 @@ layout(set = 0, binding = 0) uniform scene_ssbo
 	vec4 light_color;
 } scene;
 
-layout(set = 0, binding = 1) uniform mesh_ssbo
+struct instance_data
 {
 	mat4 model;
 	mat4 modelview;
 	mat4 modelviewproj;
 	vec4 clipping_plane[nb_clipping];
-} mesh;
+};
 
-layout(set = 0, binding = 2) uniform joints_ssbo
+layout(set = 0, binding = 1) readonly buffer instances_ssbo
 {
-	mat4 joint_matrices[32];
+	instance_data instances[];
+};
+
+layout(set = 0, binding = 2) readonly buffer joints_ssbo
+{
+	mat4 joint_matrices[];
 } joints;
 
 #ifdef FRAG_SHADER
@@ -114,6 +119,8 @@ out gl_PerVertex
 
 void main()
 {
+	instance_data mesh = instances[gl_InstanceIndex];
+
 	for(int i = 0; i < nb_texcoords; i++)
 		texcoord[i] = in_texcoord[i];
 
@@ -27,6 +27,8 @@
 #include <optional>
 #include <thread>
 
+#include "utils/thread_pool.h"
+
 namespace utils
 {
 enum class future_status
@@ -229,4 +231,30 @@ future<Result, Progress> async(F && f, Args &&... args)
 
 	return fut;
 }
+
+// Same as above but runs f in a thread pool instead of a dedicated thread, if the future is
+// cancelled before the task is started then f is not called
+template <typename Result, typename Progress, typename F, typename... Args>
+future<Result, Progress> async(thread_pool & pool, thread_pool::priority prio, F && f, Args &&... args)
+{
+	future<Result, Progress> fut;
+
+	fut.shared_state = std::make_shared<typename future<Result, Progress>::state>();
+
+	pool.submit(prio, [f, args..., token = async_token<Result, Progress>(fut.shared_state)]() mutable {
+		if (token.is_cancelled())
+			return;
+
+		try
+		{
+			token.set_result(std::invoke(f, token, args...));
+		}
+		catch (...)
+		{
+			token.set_exception(std::current_exception());
+		}
+	});
+
+	return fut;
+}
 } // namespace utils
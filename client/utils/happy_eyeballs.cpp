@@ -0,0 +1,337 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "happy_eyeballs.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <net/if.h>
+#include <netdb.h>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace
+{
+bool same_address(const utils::ip_address & a, const utils::ip_address & b)
+{
+	if (a.index() != b.index())
+		return false;
+
+	if (auto * a4 = std::get_if<in_addr>(&a))
+		return a4->s_addr == std::get<in_addr>(b).s_addr;
+
+	const auto & a6 = std::get<sockaddr_in6>(a);
+	const auto & b6 = std::get<sockaddr_in6>(b);
+	return memcmp(&a6.sin6_addr, &b6.sin6_addr, sizeof(in6_addr)) == 0 and a6.sin6_scope_id == b6.sin6_scope_id;
+}
+
+std::vector<utils::ip_address> unique(const std::vector<utils::ip_address> & addresses)
+{
+	std::vector<utils::ip_address> result;
+	for (const auto & address: addresses)
+	{
+		if (std::ranges::none_of(result, [&](const utils::ip_address & i) { return same_address(i, address); }))
+			result.push_back(address);
+	}
+	return result;
+}
+
+// Alternate between address families, starting with the family of the first address
+std::vector<utils::ip_address> interleave(const std::vector<utils::ip_address> & addresses)
+{
+	if (addresses.empty())
+		return {};
+
+	std::vector<utils::ip_address> first_family;
+	std::vector<utils::ip_address> second_family;
+	for (const auto & address: addresses)
+	{
+		if (address.index() == addresses.front().index())
+			first_family.push_back(address);
+		else
+			second_family.push_back(address);
+	}
+
+	std::vector<utils::ip_address> result;
+	result.reserve(addresses.size());
+	for (size_t i = 0; i < std::max(first_family.size(), second_family.size()); i++)
+	{
+		if (i < first_family.size())
+			result.push_back(first_family[i]);
+		if (i < second_family.size())
+			result.push_back(second_family[i]);
+	}
+
+	return result;
+}
+
+struct attempt
+{
+	int fd;
+	utils::ip_address address;
+};
+
+// Starts a non-blocking connection, returns the error message if it failed immediately
+std::optional<std::string> start_connection(const utils::ip_address & address, int port, std::vector<attempt> & attempts)
+{
+	sockaddr_storage sa{};
+	socklen_t sa_len;
+	int family;
+
+	if (auto * address4 = std::get_if<in_addr>(&address))
+	{
+		auto & sa4 = reinterpret_cast<sockaddr_in &>(sa);
+		sa4.sin_family = AF_INET;
+		sa4.sin_addr = *address4;
+		sa4.sin_port = htons(port);
+		sa_len = sizeof(sa4);
+		family = AF_INET;
+	}
+	else
+	{
+		auto & sa6 = reinterpret_cast<sockaddr_in6 &>(sa);
+		sa6 = std::get<sockaddr_in6>(address);
+		sa6.sin6_family = AF_INET6;
+		sa6.sin6_port = htons(port);
+		sa_len = sizeof(sa6);
+		family = AF_INET6;
+	}
+
+	int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return strerror(errno);
+
+	if (connect(fd, (sockaddr *)&sa, sa_len) < 0 and errno != EINPROGRESS)
+	{
+		int err = errno;
+		::close(fd);
+		return strerror(err);
+	}
+
+	spdlog::debug("Trying address {}", utils::to_string(address));
+	attempts.push_back({fd, address});
+	return std::nullopt;
+}
+} // namespace
+
+utils::ip_address utils::make_ip_address(const in6_addr & address, uint32_t scope_id)
+{
+	return sockaddr_in6{
+	        .sin6_family = AF_INET6,
+	        .sin6_addr = address,
+	        .sin6_scope_id = scope_id,
+	};
+}
+
+std::string utils::to_string(const ip_address & address)
+{
+	char buf[INET6_ADDRSTRLEN];
+	if (auto * address4 = std::get_if<in_addr>(&address))
+	{
+		inet_ntop(AF_INET, address4, buf, sizeof(buf));
+		return buf;
+	}
+
+	const auto & address6 = std::get<sockaddr_in6>(address);
+	inet_ntop(AF_INET6, &address6.sin6_addr, buf, sizeof(buf));
+	if (address6.sin6_scope_id == 0)
+		return buf;
+
+	// Same format as getaddrinfo accepts, so that the result can be parsed back
+	char interface[IF_NAMESIZE];
+	if (if_indextoname(address6.sin6_scope_id, interface))
+		return std::string(buf) + "%" + interface;
+	return std::string(buf) + "%" + std::to_string(address6.sin6_scope_id);
+}
+
+std::optional<utils::ip_address> utils::parse_ip_address(const std::string & address)
+{
+	addrinfo hint{
+	        .ai_flags = AI_NUMERICHOST,
+	        .ai_family = AF_UNSPEC,
+	        .ai_socktype = SOCK_STREAM,
+	};
+	addrinfo * addresses;
+	if (address.empty() or getaddrinfo(address.c_str(), nullptr, &hint, &addresses))
+		return std::nullopt;
+
+	std::optional<ip_address> result;
+	switch (addresses->ai_family)
+	{
+		case AF_INET:
+			result = ((sockaddr_in *)addresses->ai_addr)->sin_addr;
+			break;
+		case AF_INET6: {
+			auto & sa6 = *(sockaddr_in6 *)addresses->ai_addr;
+			result = make_ip_address(sa6.sin6_addr, sa6.sin6_scope_id);
+			break;
+		}
+	}
+
+	freeaddrinfo(addresses);
+	return result;
+}
+
+utils::connection_error::connection_error(std::vector<std::pair<ip_address, std::string>> errors_) :
+        std::runtime_error([&]() {
+	        std::string message;
+	        for (const auto & [address, error]: errors_)
+	        {
+		        if (not message.empty())
+			        message += "\n";
+		        message += to_string(address) + ": " + error;
+	        }
+	        return message.empty() ? std::string("No address to connect to") : message;
+        }()),
+        errors(std::move(errors_))
+{
+}
+
+utils::connection utils::happy_eyeballs(std::vector<ip_address> addresses, int port, std::future<std::vector<ip_address>> resolved, std::chrono::steady_clock::duration timeout)
+{
+	std::vector<ip_address> known = unique(addresses);
+	std::vector<ip_address> pending = interleave(known);
+	std::vector<attempt> attempts;
+	std::vector<std::pair<ip_address, std::string>> errors;
+	std::exception_ptr resolve_error;
+
+	auto close_all = [&]() {
+		for (auto & i: attempts)
+			::close(i.fd);
+		attempts.clear();
+	};
+
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+	auto next_attempt = std::chrono::steady_clock::now();
+
+	while (true)
+	{
+		auto now = std::chrono::steady_clock::now();
+
+		if (resolved.valid() and resolved.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			try
+			{
+				std::vector<ip_address> new_addresses;
+				for (const auto & address: resolved.get())
+				{
+					if (std::ranges::none_of(known, [&](const ip_address & i) { return same_address(i, address); }))
+					{
+						known.push_back(address);
+						new_addresses.push_back(address);
+					}
+				}
+
+				pending.insert(pending.end(), new_addresses.begin(), new_addresses.end());
+				pending = interleave(pending);
+			}
+			catch (...)
+			{
+				resolve_error = std::current_exception();
+			}
+		}
+
+		if (not pending.empty() and (now >= next_attempt or attempts.empty()))
+		{
+			ip_address address = pending.front();
+			pending.erase(pending.begin());
+
+			if (auto error = start_connection(address, port, attempts))
+				errors.emplace_back(address, *error);
+			else
+				next_attempt = now + connection_attempt_delay;
+
+			continue;
+		}
+
+		if (attempts.empty() and pending.empty() and not resolved.valid())
+		{
+			if (errors.empty() and resolve_error)
+				std::rethrow_exception(resolve_error);
+
+			throw connection_error(std::move(errors));
+		}
+
+		if (now >= deadline)
+		{
+			for (auto & i: attempts)
+				errors.emplace_back(i.address, strerror(ETIMEDOUT));
+			close_all();
+			throw connection_error(std::move(errors));
+		}
+
+		// Wait until a connection completes, the next attempt is due or the name is resolved
+		auto wake_up = deadline;
+		if (not pending.empty())
+			wake_up = std::min(wake_up, next_attempt);
+		if (resolved.valid())
+			wake_up = std::min(wake_up, now + std::chrono::milliseconds(20));
+
+		std::vector<pollfd> fds;
+		fds.reserve(attempts.size());
+		for (auto & i: attempts)
+			fds.push_back({.fd = i.fd, .events = POLLOUT});
+
+		int timeout = std::chrono::ceil<std::chrono::milliseconds>(wake_up - now).count();
+		if (::poll(fds.data(), fds.size(), std::max(timeout, 0)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			int err = errno;
+			close_all();
+			throw std::system_error(err, std::system_category());
+		}
+
+		for (size_t i = fds.size(); i-- > 0;)
+		{
+			if (fds[i].revents == 0)
+				continue;
+
+			int err = 0;
+			socklen_t len = sizeof(err);
+			if (getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+				err = errno;
+
+			if (err == 0)
+			{
+				connection result{attempts[i].fd, attempts[i].address};
+				attempts.erase(attempts.begin() + i);
+				close_all();
+
+				int flags = fcntl(result.fd, F_GETFL);
+				fcntl(result.fd, F_SETFL, flags & ~O_NONBLOCK);
+
+				spdlog::info("Connected to {}", to_string(result.address));
+				return result;
+			}
+
+			errors.emplace_back(attempts[i].address, strerror(err));
+			::close(attempts[i].fd);
+			attempts.erase(attempts.begin() + i);
+
+			// Do not wait for the delay when an attempt fails
+			next_attempt = now;
+		}
+	}
+}
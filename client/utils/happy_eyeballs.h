@@ -0,0 +1,71 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <netinet/in.h>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace utils
+{
+// IPv6 addresses keep their scope id, link-local addresses cannot be reached without it
+using ip_address = std::variant<in_addr, sockaddr_in6>;
+
+ip_address make_ip_address(const in6_addr & address, uint32_t scope_id = 0);
+
+std::string to_string(const ip_address & address);
+std::optional<ip_address> parse_ip_address(const std::string & address);
+
+// Delay before starting the next connection attempt, and overall timeout (RFC 8305)
+constexpr std::chrono::milliseconds connection_attempt_delay{250};
+constexpr std::chrono::seconds connection_timeout{10};
+
+class connection_error : public std::runtime_error
+{
+public:
+	std::vector<std::pair<ip_address, std::string>> errors;
+
+	connection_error(std::vector<std::pair<ip_address, std::string>> errors);
+};
+
+struct connection
+{
+	int fd;
+	ip_address address;
+};
+
+// Races TCP connections to all addresses: a new attempt is started every connection_attempt_delay,
+// or as soon as the previous one fails, alternating between IPv6 and IPv4. The first connection
+// to succeed is returned as a blocking socket and the others are closed.
+//
+// The addresses in resolved are added to the candidates when they become available, so that a
+// cached address can be tried while the name is still being resolved. Duplicate addresses are
+// only tried once.
+connection happy_eyeballs(std::vector<ip_address> addresses,
+                          int port,
+                          std::future<std::vector<ip_address>> resolved = {},
+                          std::chrono::steady_clock::duration timeout = connection_timeout);
+} // namespace utils
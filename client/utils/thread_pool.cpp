@@ -0,0 +1,95 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "thread_pool.h"
+
+#include "utils/named_thread.h"
+#include <algorithm>
+#include <cassert>
+#include <spdlog/spdlog.h>
+
+utils::thread_pool::thread_pool(size_t nb_threads, const std::string & name)
+{
+	if (nb_threads == 0)
+		nb_threads = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 4);
+
+	threads.reserve(nb_threads);
+	for (size_t i = 0; i < nb_threads; i++)
+		threads.push_back(utils::named_thread(name + std::to_string(i), &thread_pool::worker, this));
+}
+
+utils::thread_pool::~thread_pool()
+{
+	{
+		std::unique_lock _{lock};
+		exiting = true;
+		cv.notify_all();
+	}
+
+	for (auto & thread: threads)
+		thread.join();
+}
+
+void utils::thread_pool::submit(priority prio, std::function<void()> task)
+{
+	std::unique_lock _{lock};
+	tasks[(int)prio].push_back(std::move(task));
+	cv.notify_one();
+}
+
+void utils::thread_pool::worker()
+{
+	while (true)
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock _{lock};
+			cv.wait(_, [&] {
+				return exiting or std::ranges::any_of(tasks, [](auto & queue) { return !queue.empty(); });
+			});
+
+			// Queued tasks are still run when the pool is destroyed, so that
+			// nothing waits forever on their result
+			if (std::ranges::all_of(tasks, [](auto & queue) { return queue.empty(); }))
+			{
+				assert(exiting);
+				return;
+			}
+
+			for (auto & queue: tasks)
+			{
+				if (!queue.empty())
+				{
+					task = std::move(queue.front());
+					queue.pop_front();
+					break;
+				}
+			}
+		}
+
+		try
+		{
+			task();
+		}
+		catch (std::exception & e)
+		{
+			spdlog::error("Exception in thread pool task: {}", e.what());
+		}
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace utils
+{
+// Fixed size pool of worker threads, for short CPU bound tasks such as asset decoding.
+// Long running or blocking tasks should use their own thread (see utils::async).
+class thread_pool
+{
+public:
+	enum class priority
+	{
+		high,
+		normal,
+		low,
+	};
+
+	explicit thread_pool(size_t nb_threads = 0, const std::string & name = "worker");
+	// Runs the tasks that are still queued before returning
+	~thread_pool();
+
+	thread_pool(const thread_pool &) = delete;
+	thread_pool & operator=(const thread_pool &) = delete;
+
+	// Tasks with a higher priority are started first, tasks with the same priority are started in order
+	void submit(priority prio, std::function<void()> task);
+
+	size_t size() const
+	{
+		return threads.size();
+	}
+
+private:
+	std::mutex lock;
+	std::condition_variable cv;
+	std::array<std::deque<std::function<void()>>, 3> tasks;
+	bool exiting = false;
+
+	std::vector<std::thread> threads;
+
+	void worker();
+};
+} // namespace utils
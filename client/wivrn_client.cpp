@@ -19,7 +19,9 @@
 
 #include "wivrn_client.h"
 #include "spdlog/common.h"
+#include "utils/happy_eyeballs.h"
 #include "wivrn_packets.h"
+#include <algorithm>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
 #include <linux/ipv6.h>
@@ -32,15 +34,13 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
-#ifndef IPTOS_DSCP_EF
-// constant is not defined in Android ip.h
-#define IPTOS_DSCP_EF 0xb8
-#endif
-
 using namespace std::chrono_literals;
 
 namespace
 {
+// How long the server has to answer the handshake
+constexpr auto handshake_timeout = 5s;
+
 template <typename T>
 void init_stream(T & stream)
 {
@@ -49,7 +49,7 @@ void init_stream(T & stream)
 } // namespace
 
 template <typename T>
-void wivrn_session::handshake(T address, bool tcp_only)
+void wivrn_session::handshake(T address, std::chrono::steady_clock::time_point timeout)
 {
 	// Wait for handshake on control socket,
 	// then send ours on stream or control socket,
@@ -58,12 +58,11 @@ void wivrn_session::handshake(T address, bool tcp_only)
 	fds.events = POLLIN;
 	fds.fd = control.get_fd();
 
-	auto timeout = std::chrono::steady_clock::now() + 5s;
-
 	// Loop because TCP socket may return partial data
 	while (true)
 	{
-		int r = ::poll(&fds, 1, 5000);
+		auto remaining = std::chrono::ceil<std::chrono::milliseconds>(timeout - std::chrono::steady_clock::now());
+		int r = ::poll(&fds, 1, std::max<int>(remaining.count(), 0));
 		if (r < 0)
 			throw std::system_error(errno, std::system_category());
 
@@ -75,12 +74,15 @@ void wivrn_session::handshake(T address, bool tcp_only)
 			try
 			{
 				auto h = std::get<to_headset::handshake>(*packet);
+				session_token = h.session_token;
 				if (h.stream_port > 0 && !tcp_only)
 				{
 					stream = decltype(stream)();
 					stream.connect(address, h.stream_port);
 					init_stream(stream);
 				}
+				if (h.dscp)
+					set_dscp(*h.dscp);
 				break;
 			}
 			catch (std::exception & e)
@@ -95,7 +97,10 @@ void wivrn_session::handshake(T address, bool tcp_only)
 	}
 
 	// may be on control socket if forced TCP
-	send_stream(from_headset::handshake{});
+	if (stream)
+		stream.send(from_headset::handshake{});
+	else
+		control.send(from_headset::handshake{});
 
 	// Wait for second handshake
 	while (true)
@@ -103,7 +108,10 @@ void wivrn_session::handshake(T address, bool tcp_only)
 		if (poll(
 		            [](const auto && packet) { return std::is_same_v<std::remove_cvref_t<decltype(packet)>, to_headset::handshake>; },
 		            std::chrono::milliseconds(100)))
+		{
+			active = true;
 			return;
+		}
 		if (std::chrono::steady_clock::now() >= timeout)
 			throw std::runtime_error("Failed to establish connection");
 
@@ -113,18 +121,74 @@ void wivrn_session::handshake(T address, bool tcp_only)
 	}
 }
 
+void wivrn_session::set_dscp(const dscp_map & dscp)
+{
+	try
+	{
+		// Microphone audio goes on the control socket, unless everything does
+		if (stream)
+		{
+			stream.set_dscp(dscp);
+			control.set_dscp(dscp[size_t(traffic_class::audio)]);
+		}
+		else
+			control.set_dscp(dscp[size_t(traffic_class::video)]);
+	}
+	catch (std::exception & e)
+	{
+		spdlog::warn("Failed to set DSCP: {}", e.what());
+	}
+}
+
 wivrn_session::wivrn_session(in6_addr address, int port, bool tcp_only) :
-        control(address, port), stream(-1), address(address)
+        control(address, port), stream(-1), address(utils::make_ip_address(address)), port(port), tcp_only(tcp_only)
 {
 	char buffer[100];
 	spdlog::info("Connection to {}:{}", inet_ntop(AF_INET6, &address, buffer, sizeof(buffer)), port);
-	handshake(address, tcp_only);
+	handshake(address, std::chrono::steady_clock::now() + handshake_timeout);
 }
 
 wivrn_session::wivrn_session(in_addr address, int port, bool tcp_only) :
-        control(address, port), stream(-1), address(address)
+        control(address, port), stream(-1), address(address), port(port), tcp_only(tcp_only)
 {
 	char buffer[100];
 	spdlog::info("Connection to {}:{}", inet_ntop(AF_INET, &address, buffer, sizeof(buffer)), port);
-	handshake(address, tcp_only);
+	handshake(address, std::chrono::steady_clock::now() + handshake_timeout);
+}
+
+wivrn_session::wivrn_session(int fd, utils::ip_address address, int port, bool tcp_only) :
+        control(fd), stream(-1), address(address), port(port), tcp_only(tcp_only)
+{
+	std::visit([&](auto address) { handshake(address, std::chrono::steady_clock::now() + handshake_timeout); }, address);
+}
+
+void wivrn_session::connection_lost()
+{
+	active = false;
+	::shutdown(control.get_fd(), SHUT_RDWR);
+}
+
+void wivrn_session::reconnect(std::chrono::steady_clock::time_point deadline)
+{
+	// Unblock the threads still sending on the old sockets, senders return
+	// immediately until the handshake marks the connection as active again
+	connection_lost();
+
+	std::visit([&](auto address) {
+		spdlog::info("Reconnecting to {}:{}", utils::to_string(address), port);
+		auto remaining = deadline - std::chrono::steady_clock::now();
+		if (remaining <= 0s)
+			throw std::runtime_error("Reconnection timed out");
+		control_socket_t new_control(utils::happy_eyeballs({address}, port, {}, std::min<std::chrono::steady_clock::duration>(remaining, utils::connection_timeout)).fd);
+
+		{
+			// Only wait for the senders that were using the old sockets, not for the connection
+			std::unique_lock lock(socket_mutex);
+			control = std::move(new_control);
+			stream = stream_socket_t(-1);
+		}
+
+		handshake(address, std::min(deadline, std::chrono::steady_clock::now() + handshake_timeout));
+	},
+	           address);
 }
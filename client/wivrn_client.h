@@ -19,9 +19,12 @@
 
 #pragma once
 
+#include "utils/happy_eyeballs.h"
 #include "wivrn_packets.h"
 #include "wivrn_sockets.h"
+#include <atomic>
 #include <poll.h>
+#include <shared_mutex>
 
 using namespace wivrn;
 
@@ -35,21 +38,62 @@ private:
 	control_socket_t control;
 	stream_socket_t stream;
 
+	// Held exclusively while the sockets are replaced by reconnect, senders
+	// only use the sockets when the connection is active
+	std::shared_mutex socket_mutex;
+	std::atomic<bool> active = false;
+
 	template <typename T>
-	void handshake(T address, bool tcp_only);
+	void handshake(T address, std::chrono::steady_clock::time_point deadline);
+
+	// Stops sending and wakes up the network thread so that it reconnects
+	void connection_lost();
+
+	void set_dscp(const dscp_map &);
 
 public:
-	std::variant<in_addr, in6_addr> address;
+	utils::ip_address address;
+	const int port;
+	const bool tcp_only;
+
+	// Sent by the server in the handshake, used to resume the session after a reconnection
+	uint64_t session_token = 0;
 
 	wivrn_session(in6_addr address, int port, bool tcp_only);
 	wivrn_session(in_addr address, int port, bool tcp_only);
+	// Takes ownership of an already connected TCP socket
+	wivrn_session(int fd, utils::ip_address address, int port, bool tcp_only);
 	wivrn_session(const wivrn_session &) = delete;
 	wivrn_session & operator=(const wivrn_session &) = delete;
 
+	// Connects again to the same server, packets sent in the meantime are dropped.
+	// Throws if the connection is not established before deadline
+	void reconnect(std::chrono::steady_clock::time_point deadline);
+
+	bool is_active() const
+	{
+		return active;
+	}
+
+	// Returns false if the packet was dropped because the connection is lost, until reconnect succeeds.
+	// Throws if sending fails, the connection is then marked as lost
 	template <typename T>
-	void send_control(T && packet)
+	bool send_control(T && packet)
 	{
-		control.send(std::forward<T>(packet));
+		std::shared_lock lock(socket_mutex);
+		if (not active)
+			return false;
+
+		try
+		{
+			control.send(std::forward<T>(packet));
+			return true;
+		}
+		catch (...)
+		{
+			connection_lost();
+			throw;
+		}
 	}
 
 	template <typename T>
@@ -58,13 +102,28 @@ public:
 		control.serialize<T>(p, data);
 	}
 
+	// Returns false if the packet was dropped because the connection is lost, until reconnect succeeds.
+	// Throws if sending fails, the connection is then marked as lost
 	template <typename T>
-	void send_stream(T && packet)
+	bool send_stream(T && packet)
 	{
-		if (stream)
-			stream.send(std::forward<T>(packet));
-		else
-			control.send(std::forward<T>(packet));
+		std::shared_lock lock(socket_mutex);
+		if (not active)
+			return false;
+
+		try
+		{
+			if (stream)
+				stream.send(std::forward<T>(packet));
+			else
+				control.send(std::forward<T>(packet));
+			return true;
+		}
+		catch (...)
+		{
+			connection_lost();
+			throw;
+		}
 	}
 
 	template <typename T>
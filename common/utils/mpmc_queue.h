@@ -0,0 +1,285 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace utils
+{
+class queue_closed : public std::exception
+{
+public:
+	const char * what() const noexcept override
+	{
+		return "queue_closed";
+	}
+};
+
+// What push does when the queue is full
+enum class overflow_policy
+{
+	// wait for a consumer to make room
+	block,
+	// discard the oldest item
+	drop_oldest,
+	// discard the new item
+	reject,
+};
+
+// Bounded multiple producers/multiple consumers queue
+// Each cell has a sequence number telling whether it is ready to be written
+// or read for a given position, producers and consumers only contend on the
+// position counters. Blocking calls sleep on atomic::wait, the lowest bit of
+// the event counters tells if a thread may be sleeping so that pushes and pops
+// only make a system call when needed.
+template <typename T, size_t capacity, overflow_policy policy = overflow_policy::block>
+class mpmc_queue
+{
+	static_assert(capacity >= 2 and (capacity & (capacity - 1)) == 0, "capacity must be a power of 2");
+
+	struct alignas(64) cell
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	std::array<cell, capacity> cells;
+
+	alignas(64) std::atomic<size_t> write_position = 0;
+	alignas(64) std::atomic<size_t> read_position = 0;
+
+	// Changed after a push/pop when consumers/producers are waiting,
+	// lowest bit is set by waiting threads
+	alignas(64) std::atomic<uint32_t> push_events = 0;
+	alignas(64) std::atomic<uint32_t> pop_events = 0;
+
+	std::atomic<bool> closed = false;
+
+	// Statistics
+	std::atomic<size_t> max_depth = 0;
+	std::atomic<uint64_t> dropped = 0;
+	std::atomic<uint64_t> waits = 0;
+	std::atomic<int64_t> wait_ns = 0;
+
+	template <typename U>
+	bool try_push_impl(U && item)
+	{
+		size_t pos = write_position.load(std::memory_order_relaxed);
+		while (true)
+		{
+			cell & c = cells[pos % capacity];
+			size_t seq = c.sequence.load(std::memory_order_acquire);
+			if (seq == pos)
+			{
+				if (write_position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					c.value = std::forward<U>(item);
+					c.sequence.store(pos + 1, std::memory_order_release);
+					update_max_depth(pos + 1);
+					notify(push_events);
+					return true;
+				}
+			}
+			else if (seq < pos)
+				return false; // full
+			else
+				pos = write_position.load(std::memory_order_relaxed);
+		}
+	}
+
+	void update_max_depth(size_t end)
+	{
+		size_t depth = end - read_position.load(std::memory_order_relaxed);
+		size_t current = max_depth.load(std::memory_order_relaxed);
+		while (depth > current and depth <= capacity and not max_depth.compare_exchange_weak(current, depth, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	static void notify(std::atomic<uint32_t> & events)
+	{
+		// Pairs with the fence in wait: either the waiting thread sees the
+		// new item, or its bit is seen here
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (events.load(std::memory_order_relaxed) & 1)
+		{
+			// Adding 1 clears the bit and changes the value
+			events.fetch_add(1);
+			events.notify_all();
+		}
+	}
+
+	// Waits until events changes, after checking ready one last time
+	template <typename Ready>
+	void wait(std::atomic<uint32_t> & events, Ready && ready)
+	{
+		uint32_t seen = events.fetch_or(1) | 1;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (ready() or closed)
+			return;
+
+		auto start = std::chrono::steady_clock::now();
+		events.wait(seen);
+		waits.fetch_add(1, std::memory_order_relaxed);
+		wait_ns.fetch_add(std::chrono::nanoseconds(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+	}
+
+	bool empty_hint() const
+	{
+		size_t pos = read_position.load(std::memory_order_relaxed);
+		return cells[pos % capacity].sequence.load(std::memory_order_acquire) != pos + 1;
+	}
+
+	bool full_hint() const
+	{
+		size_t pos = write_position.load(std::memory_order_relaxed);
+		return cells[pos % capacity].sequence.load(std::memory_order_acquire) != pos;
+	}
+
+	template <typename U>
+	bool push_impl(U && item)
+	{
+		while (not closed)
+		{
+			if (try_push_impl(std::forward<U>(item)))
+				return true;
+
+			if constexpr (policy == overflow_policy::block)
+			{
+				wait(pop_events, [this]() { return not full_hint(); });
+			}
+			else if constexpr (policy == overflow_policy::drop_oldest)
+			{
+				if (try_pop())
+					dropped.fetch_add(1, std::memory_order_relaxed);
+			}
+			else
+			{
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+		}
+		return false;
+	}
+
+public:
+	struct stats
+	{
+		size_t depth;
+		size_t max_depth;
+		// Items discarded by drop_oldest or reject
+		uint64_t dropped;
+		// Number and total duration of blocking waits, for producers and consumers
+		uint64_t waits;
+		int64_t wait_ns;
+	};
+
+	mpmc_queue()
+	{
+		for (size_t i = 0; i < capacity; ++i)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	mpmc_queue(const mpmc_queue &) = delete;
+	mpmc_queue & operator=(const mpmc_queue &) = delete;
+
+	std::optional<T> try_pop()
+	{
+		size_t pos = read_position.load(std::memory_order_relaxed);
+		while (true)
+		{
+			cell & c = cells[pos % capacity];
+			size_t seq = c.sequence.load(std::memory_order_acquire);
+			if (seq == pos + 1)
+			{
+				if (read_position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					std::optional<T> item = std::move(c.value);
+					c.sequence.store(pos + capacity, std::memory_order_release);
+					notify(pop_events);
+					return item;
+				}
+			}
+			else if (seq < pos + 1)
+				return std::nullopt; // empty
+			else
+				pos = read_position.load(std::memory_order_relaxed);
+		}
+	}
+
+	// Returns false if the item was not queued, because the queue is closed
+	// or full with the reject policy
+	bool push(T && item)
+	{
+		return push_impl(std::move(item));
+	}
+
+	bool push(const T & item)
+	{
+		return push_impl(item);
+	}
+
+	// Throws queue_closed once the queue is closed
+	T pop()
+	{
+		while (not closed)
+		{
+			if (auto item = try_pop())
+				return std::move(*item);
+
+			wait(push_events, [this]() { return not empty_hint(); });
+		}
+		throw queue_closed{};
+	}
+
+	void close()
+	{
+		closed = true;
+		push_events.fetch_add(2);
+		push_events.notify_all();
+		pop_events.fetch_add(2);
+		pop_events.notify_all();
+	}
+
+	size_t size() const
+	{
+		size_t w = write_position.load(std::memory_order_relaxed);
+		size_t r = read_position.load(std::memory_order_relaxed);
+		return w > r ? w - r : 0;
+	}
+
+	stats get_stats() const
+	{
+		return {
+		        .depth = size(),
+		        .max_depth = max_depth.load(std::memory_order_relaxed),
+		        .dropped = dropped.load(std::memory_order_relaxed),
+		        .waits = waits.load(std::memory_order_relaxed),
+		        .wait_ns = wait_ns.load(std::memory_order_relaxed),
+		};
+	}
+};
+} // namespace utils
@@ -18,50 +18,115 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <cstddef>
 #include <optional>
+#include <span>
 
 namespace utils
 {
 
-// single writer/single reader rung buffer
+// single writer/single reader ring buffer
+// Positions only increase, each one is on its own cache line together with the
+// last value of the other position seen by its owner, so that the other line
+// is only read when the buffer looks full (for the writer) or empty (for the reader).
 template <typename T, size_t capacity>
 class ring_buffer
 {
-	std::array<T, capacity> container;
-	// last position read
-	std::atomic<size_t> read_index = 0;
-	// last position written
-	std::atomic<size_t> write_index = 0;
+	// next position to write, and read position last seen by the writer
+	alignas(64) std::atomic<size_t> write_position = 0;
+	size_t writer_read_position = 0;
+
+	// next position to read, and write position last seen by the reader
+	alignas(64) std::atomic<size_t> read_position = 0;
+	size_t reader_write_position = 0;
+
+	alignas(64) std::array<T, capacity> container;
+
+	// Number of elements that can be written, from the writer thread
+	size_t writable(size_t w, size_t wanted)
+	{
+		if (capacity - (w - writer_read_position) < wanted)
+			writer_read_position = read_position.load(std::memory_order_acquire);
+		return capacity - (w - writer_read_position);
+	}
+
+	// Number of elements that can be read, from the reader thread
+	size_t readable(size_t r, size_t wanted)
+	{
+		if (reader_write_position - r < wanted)
+			reader_write_position = write_position.load(std::memory_order_acquire);
+		return reader_write_position - r;
+	}
 
 public:
 	bool write(T && t)
 	{
-		size_t next_write = (write_index + 1) % capacity;
-		if (next_write == read_index)
+		size_t w = write_position.load(std::memory_order_relaxed);
+		if (writable(w, 1) == 0)
 			return false;
-		container[next_write] = std::move(t);
-		write_index.store(next_write);
+		container[w % capacity] = std::move(t);
+		write_position.store(w + 1, std::memory_order_release);
 		return true;
 	}
 
 	std::optional<T> read()
 	{
-		if (read_index == write_index)
+		size_t r = read_position.load(std::memory_order_relaxed);
+		if (readable(r, 1) == 0)
 			return {};
-		size_t next_read = (read_index + 1) % capacity;
-		T res = std::move(container[next_read]);
-		read_index.store(next_read);
-		return std::move(res);
+		T res = std::move(container[r % capacity]);
+		read_position.store(r + 1, std::memory_order_release);
+		return res;
+	}
+
+	// Writes as many elements as possible, returns the number of elements written
+	size_t write_n(std::span<const T> data)
+	{
+		size_t w = write_position.load(std::memory_order_relaxed);
+		size_t n = std::min(data.size(), writable(w, data.size()));
+
+		size_t start = w % capacity;
+		size_t first = std::min(n, capacity - start);
+		std::copy_n(data.begin(), first, container.begin() + start);
+		std::copy_n(data.begin() + first, n - first, container.begin());
+
+		write_position.store(w + n, std::memory_order_release);
+		return n;
+	}
+
+	// Reads as many elements as possible, returns the number of elements read
+	size_t read_n(std::span<T> data)
+	{
+		size_t r = read_position.load(std::memory_order_relaxed);
+		size_t n = std::min(data.size(), readable(r, data.size()));
+
+		size_t start = r % capacity;
+		size_t first = std::min(n, capacity - start);
+		std::move(container.begin() + start, container.begin() + start + first, data.begin());
+		std::move(container.begin(), container.begin() + (n - first), data.begin() + first);
+
+		read_position.store(r + n, std::memory_order_release);
+		return n;
+	}
+
+	// Discards up to count elements from the reader thread, returns the number of elements discarded
+	// Discarded elements are not destroyed until they are overwritten
+	size_t skip(size_t count)
+	{
+		size_t r = read_position.load(std::memory_order_relaxed);
+		size_t n = std::min(count, readable(r, count));
+		read_position.store(r + n, std::memory_order_release);
+		return n;
 	}
 
 	size_t size() const
 	{
-		size_t w = write_index;
-		size_t r = read_index;
-		return std::min(w - r, capacity + w - r);
+		size_t r = read_position.load(std::memory_order_acquire);
+		size_t w = write_position.load(std::memory_order_acquire);
+		return w - r;
 	}
 };
 
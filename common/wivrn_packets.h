@@ -31,6 +31,7 @@
 #include <openxr/openxr.h>
 
 #include "wivrn_serialization_types.h"
+#include "wivrn_traffic_class.h"
 
 namespace wivrn
 {
@@ -93,6 +94,11 @@ struct audio_data
 	data_holder data;
 };
 
+constexpr traffic_class traffic_class_of(const audio_data &)
+{
+	return traffic_class::audio;
+}
+
 namespace from_headset
 {
 
@@ -115,6 +121,8 @@ struct headset_info_packet
 	bool face_tracking2_fb;
 	bool palm_pose;
 	std::vector<video_codec> supported_codecs; // from preferred to least preferred
+	// session_token of the previous connection to resume the stream without resetting it, 0 otherwise
+	uint64_t resume_token;
 };
 
 struct handshake
@@ -220,6 +228,10 @@ struct inputs
 		float value;
 		XrTime last_change_time;
 	};
+	// Incremented for each packet, so that reordered packets can be discarded
+	uint32_t sequence;
+	// Only the inputs that changed since the previous packet, or all of them
+	// periodically
 	std::vector<input_value> values;
 };
 
@@ -253,6 +265,27 @@ struct battery
 };
 
 using packets = std::variant<headset_info_packet, feedback, audio_data, handshake, tracking, trackings, hand_tracking, inputs, timesync_response, battery>;
+
+constexpr traffic_class traffic_class_of(const tracking &)
+{
+	return traffic_class::tracking;
+}
+constexpr traffic_class traffic_class_of(const trackings &)
+{
+	return traffic_class::tracking;
+}
+constexpr traffic_class traffic_class_of(const hand_tracking &)
+{
+	return traffic_class::tracking;
+}
+constexpr traffic_class traffic_class_of(const inputs &)
+{
+	return traffic_class::tracking;
+}
+constexpr traffic_class traffic_class_of(const timesync_response &)
+{
+	return traffic_class::tracking;
+}
 } // namespace from_headset
 
 namespace to_headset
@@ -262,6 +295,10 @@ struct handshake
 {
 	// -1 if stream socket should not be used
 	int stream_port;
+	// Identifies the server session, sent back in headset_info_packet when reconnecting
+	uint64_t session_token;
+	// DSCP for each traffic_class, unset if packets should not be marked
+	std::optional<dscp_map> dscp;
 };
 
 struct foveation_parameter_item
@@ -315,6 +352,9 @@ class video_stream_data_shard
 {
 public:
 	inline static const size_t max_payload_size = 1400;
+	// In TCP only mode, so that other messages are not held back by a frame.
+	// Payloads are serialized with a 16 bits size
+	inline static const size_t max_tcp_payload_size = 60 * 1024;
 	enum flags : uint8_t
 	{
 		start_of_slice = 1,
@@ -391,7 +431,30 @@ struct tracking_control
 	std::array<bool, size_t(id::last) + 1> enabled;
 };
 
-using packets = std::variant<handshake, audio_stream_description, video_stream_description, audio_data, video_stream_data_shard, haptics, timesync_query, tracking_control>;
+// Sent when the server changes the frame rate of the stream, without changing the video stream description
+struct refresh_rate_change
+{
+	float fps;
+};
+
+using packets = std::variant<handshake, audio_stream_description, video_stream_description, audio_data, video_stream_data_shard, haptics, timesync_query, tracking_control, refresh_rate_change>;
+
+constexpr traffic_class traffic_class_of(const video_stream_data_shard &)
+{
+	return traffic_class::video;
+}
+constexpr traffic_class traffic_class_of(const haptics &)
+{
+	return traffic_class::tracking;
+}
+constexpr traffic_class traffic_class_of(const timesync_query &)
+{
+	return traffic_class::tracking;
+}
+constexpr traffic_class traffic_class_of(const tracking_control &)
+{
+	return traffic_class::tracking;
+}
 
 } // namespace to_headset
 
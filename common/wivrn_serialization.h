@@ -37,6 +37,7 @@
 #include <vector>
 
 #include "wivrn_serialization_types.h"
+#include "wivrn_traffic_class.h"
 
 namespace wivrn
 {
@@ -113,6 +114,9 @@ class serialization_packet
 	std::vector<std::span<uint8_t>> exp_spans;
 
 public:
+	// Set from the packet type when serialized by a socket, selects the DSCP on UDP sockets
+	traffic_class traffic = traffic_class::control;
+
 	// Minimum size to prefer a span over data copy
 	static constexpr size_t span_min_size = 32;
 
@@ -123,6 +127,7 @@ public:
 		buffer.clear();
 		spans.clear();
 		spans.push_back({size_t(0)});
+		traffic = traffic_class::control;
 	}
 
 	void write(const void * data, size_t size)
@@ -829,9 +834,12 @@ struct serialization_traits<std::span<uint8_t>>
 {
 	static constexpr void type_hash(details::hash_context & h)
 	{
-		h.feed("span<uint8_t>");
+		// Not the original name, so that the protocol version differs from
+		// clients that used 16 bits TCP message sizes
+		h.feed("span16<uint8_t>");
 	}
 
+	// 16 bits size: spans fit in a UDP packet or a TCP video chunk
 	static void serialize(const std::span<uint8_t> & value, serialization_packet & packet)
 	{
 		packet.serialize<uint16_t>(value.size());
@@ -849,7 +857,7 @@ struct serialization_traits<std::span<uint8_t>>
 	}
 	static size_t size(const std::span<uint8_t> & x)
 	{
-		return 1 + x.size_bytes();
+		return sizeof(uint16_t) + x.size_bytes();
 	}
 };
 
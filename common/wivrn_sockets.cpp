@@ -25,6 +25,8 @@
 #include <netdb.h>
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
+#include <poll.h>
+#include <string>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -60,6 +62,48 @@ wivrn::fd_base::~fd_base()
 		::close(fd);
 }
 
+namespace
+{
+// Ancillary data to set the DSCP of a single packet, both IPv4 and IPv6
+// options are given as the socket may send to IPv4-mapped addresses
+struct tos_control
+{
+	alignas(cmsghdr) char buffer[2 * CMSG_SPACE(sizeof(int))];
+
+	void set(msghdr & hdr, uint8_t dscp)
+	{
+		int tos = dscp << 2;
+		hdr.msg_control = buffer;
+		hdr.msg_controllen = sizeof(buffer);
+
+		cmsghdr * cmsg = CMSG_FIRSTHDR(&hdr);
+		cmsg->cmsg_level = IPPROTO_IP;
+		cmsg->cmsg_type = IP_TOS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &tos, sizeof(tos));
+
+		cmsg = CMSG_NXTHDR(&hdr, cmsg);
+		cmsg->cmsg_level = IPPROTO_IPV6;
+		cmsg->cmsg_type = IPV6_TCLASS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &tos, sizeof(tos));
+	}
+};
+
+int dscp_priority(uint8_t dscp)
+{
+	switch (dscp)
+	{
+		case wivrn::dscp::voice:
+			return 6;
+		case wivrn::dscp::video:
+			return 5;
+		default:
+			return 0;
+	}
+}
+} // namespace
+
 wivrn::UDP::UDP()
 {
 	fd = socket(AF_INET6, SOCK_DGRAM, 0);
@@ -86,9 +130,14 @@ void wivrn::UDP::bind(int port)
 
 void wivrn::UDP::connect(in6_addr address, int port)
 {
-	sockaddr_in6 sa;
-	sa.sin6_family = AF_INET6;
+	sockaddr_in6 sa{};
 	sa.sin6_addr = address;
+	connect(sa, port);
+}
+
+void wivrn::UDP::connect(sockaddr_in6 sa, int port)
+{
+	sa.sin6_family = AF_INET6;
 	sa.sin6_port = htons(port);
 
 	if (::connect(fd, (sockaddr *)&sa, sizeof(sa)) < 0)
@@ -144,13 +193,25 @@ void wivrn::UDP::set_send_buffer_size(int size)
 	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
 }
 
-void wivrn::UDP::set_tos(int tos)
+void wivrn::fd_base::set_dscp(uint8_t dscp)
 {
-	int err = setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
-	if (err == -1)
-	{
-		throw std::system_error{errno, std::generic_category()};
-	}
+	int tos = dscp << 2;
+
+	// Only one of them applies, depending on the address family
+	int err_ip = setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) < 0 ? errno : 0;
+	int err_ipv6 = setsockopt(fd, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos)) < 0 ? errno : 0;
+	if (err_ip and err_ipv6)
+		throw std::system_error{err_ip, std::generic_category()};
+
+	// IPV6_TCLASS does not set the priority used by the queueing disciplines
+	int priority = dscp_priority(dscp);
+	setsockopt(fd, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority));
+}
+
+void wivrn::UDP::set_dscp(const dscp_map & dscp)
+{
+	this->dscp = dscp;
+	set_dscp(dscp[size_t(traffic_class::control)]);
 }
 
 void wivrn::TCP::init()
@@ -214,6 +275,25 @@ wivrn::TCP::TCP(in_addr address, int port)
 	init();
 }
 
+void wivrn::TCP::set_notsent_lowat(uint32_t bytes)
+{
+	int value = bytes;
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &value, sizeof(value)) < 0)
+		throw std::system_error{errno, std::generic_category()};
+}
+
+bool wivrn::TCP::writable()
+{
+	pollfd fds{
+	        .fd = fd,
+	        .events = POLLOUT,
+	};
+	int r = ::poll(&fds, 1, 0);
+	if (r < 0)
+		throw std::system_error{errno, std::generic_category()};
+	return r > 0 and (fds.revents & POLLOUT);
+}
+
 wivrn::TCPListener::TCPListener()
 {
 }
@@ -348,18 +428,26 @@ void wivrn::UDP::send_raw(const std::vector<uint8_t> & data)
 	bytes_sent_ += sent;
 }
 
-void wivrn::UDP::send_raw(const std::vector<std::span<uint8_t>> & data)
+void wivrn::UDP::send_raw(const std::vector<std::span<uint8_t>> & data, traffic_class traffic)
 {
 	thread_local std::vector<iovec> spans;
 	spans.clear();
 	for (const auto & span: data)
 		spans.emplace_back((void *)span.data(), span.size());
 
-	if (::writev(fd, spans.data(), spans.size()) < 0)
+	tos_control control;
+	msghdr hdr{
+	        .msg_iov = spans.data(),
+	        .msg_iovlen = spans.size(),
+	};
+	if (dscp)
+		control.set(hdr, (*dscp)[size_t(traffic)]);
+
+	if (::sendmsg(fd, &hdr, 0) < 0)
 		throw std::system_error{errno, std::generic_category()};
 }
 
-void wivrn::UDP::send_many_raw(std::span<const std::vector<std::span<uint8_t>> *> data)
+void wivrn::UDP::send_many_raw(std::span<const std::vector<std::span<uint8_t>> *> data, std::span<const traffic_class> traffic)
 {
 	thread_local std::vector<iovec> iovecs;
 	thread_local std::vector<mmsghdr> mmsgs;
@@ -376,17 +464,23 @@ void wivrn::UDP::send_many_raw(std::span<const std::vector<std::span<uint8_t>> *
 			        });
 		}
 	}
+	// One control message per traffic class, shared by the messages
+	std::array<tos_control, size_t(traffic_class::count)> controls;
 	size_t i = 0;
-	for (const auto & message: data)
+	for (size_t index = 0; index < data.size(); ++index)
 	{
-		mmsgs.push_back(
-		        {
-		                .msg_hdr = {
-		                        .msg_iov = &iovecs[i],
-		                        .msg_iovlen = message->size(),
-		                },
-		        });
-		i += message->size();
+		auto & mmsg = mmsgs.emplace_back(mmsghdr{
+		        .msg_hdr = {
+		                .msg_iov = &iovecs[i],
+		                .msg_iovlen = data[index]->size(),
+		        },
+		});
+		if (dscp)
+		{
+			auto t = index < traffic.size() ? traffic[index] : traffic_class::control;
+			controls[size_t(t)].set(mmsg.msg_hdr, (*dscp)[size_t(t)]);
+		}
+		i += data[index]->size();
 	}
 	// sendmmsg may not send all messages, just consider them as lost for UDP
 	if (sendmmsg(fd, mmsgs.data(), mmsgs.size(), 0) < 0)
@@ -397,14 +491,17 @@ wivrn::deserialization_packet wivrn::TCP::receive_raw()
 {
 	ssize_t expected_size;
 
-	if (data.size_bytes() < sizeof(uint16_t))
+	if (data.size_bytes() < sizeof(message_size_t))
 	{
-		expected_size = sizeof(uint16_t) - data.size_bytes();
+		expected_size = sizeof(message_size_t) - data.size_bytes();
 	}
 	else
 	{
-		uint32_t payload_size = *reinterpret_cast<uint16_t *>(data.data());
-		expected_size = payload_size + sizeof(uint16_t) - data.size_bytes();
+		message_size_t payload_size;
+		memcpy(&payload_size, data.data(), sizeof(payload_size));
+		if (payload_size > max_message_size)
+			throw std::runtime_error("Invalid packet: size " + std::to_string(payload_size) + " too large");
+		expected_size = payload_size + sizeof(message_size_t) - data.size_bytes();
 	}
 
 	if (expected_size > capacity_left)
@@ -434,35 +531,26 @@ wivrn::deserialization_packet wivrn::TCP::receive_raw()
 
 	data = std::span(data.data(), data.size() + received);
 	capacity_left -= received;
-	if (data.size_bytes() < sizeof(uint16_t))
-		return {};
-
-	uint32_t payload_size = *reinterpret_cast<uint16_t *>(data.data());
-	if (payload_size == 0)
-		throw std::runtime_error("Invalid packet: 0 size");
-
-	if (data.size_bytes() < sizeof(uint16_t) + payload_size)
-		return {};
-
-	auto span = data.subspan(sizeof(uint16_t), payload_size);
-	data = data.subspan(sizeof(uint16_t) + payload_size);
-	return deserialization_packet{buffer, span};
+	return receive_pending();
 }
 
 wivrn::deserialization_packet wivrn::TCP::receive_pending()
 {
-	if (data.size_bytes() < sizeof(uint16_t))
+	if (data.size_bytes() < sizeof(message_size_t))
 		return {};
 
-	uint32_t payload_size = *reinterpret_cast<uint16_t *>(data.data());
+	message_size_t payload_size;
+	memcpy(&payload_size, data.data(), sizeof(payload_size));
 	if (payload_size == 0)
 		throw std::runtime_error("Invalid packet: 0 size");
+	if (payload_size > max_message_size)
+		throw std::runtime_error("Invalid packet: size " + std::to_string(payload_size) + " too large");
 
-	if (data.size_bytes() < sizeof(uint16_t) + payload_size)
+	if (data.size_bytes() < sizeof(message_size_t) + payload_size)
 		return {};
 
-	auto span = data.subspan(sizeof(uint16_t), payload_size);
-	data = data.subspan(sizeof(uint16_t) + payload_size);
+	auto span = data.subspan(sizeof(message_size_t), payload_size);
+	data = data.subspan(sizeof(message_size_t) + payload_size);
 	return deserialization_packet{buffer, span};
 }
 
@@ -471,7 +559,7 @@ void wivrn::TCP::send_raw(const std::vector<std::span<uint8_t>> & spans)
 	thread_local std::vector<iovec> iovecs;
 	iovecs.clear();
 
-	uint16_t size = 0;
+	message_size_t size = 0;
 	iovecs.emplace_back(&size, sizeof(size));
 	for (const auto & span: spans)
 	{
@@ -520,7 +608,7 @@ void wivrn::TCP::send_raw(const std::vector<std::span<uint8_t>> & spans)
 void wivrn::TCP::send_many_raw(std::span<const std::vector<std::span<uint8_t>> *> data)
 {
 	thread_local std::vector<iovec> iovecs;
-	thread_local std::vector<uint16_t> sizes;
+	thread_local std::vector<message_size_t> sizes;
 	iovecs.clear();
 	sizes.clear();
 
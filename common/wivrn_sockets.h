@@ -20,6 +20,7 @@
 #pragma once
 
 #include "wivrn_serialization.h"
+#include "wivrn_traffic_class.h"
 
 #include <atomic>
 #include <cassert>
@@ -27,6 +28,7 @@
 #include <memory>
 #include <mutex>
 #include <netinet/ip.h>
+#include <optional>
 #include <span>
 #include <utility>
 #include <vector>
@@ -96,12 +98,16 @@ public:
 	{
 		return bytes_received_;
 	}
+
+	// Sets the DSCP of all packets sent on this socket
+	void set_dscp(uint8_t dscp);
 };
 
 class UDP : public fd_base
 {
 	std::shared_ptr<uint8_t[]> buffer;
 	std::vector<std::span<uint8_t>> messages;
+	std::optional<dscp_map> dscp;
 
 public:
 	UDP();
@@ -111,21 +117,29 @@ public:
 	deserialization_packet receive_pending();
 	std::pair<wivrn::deserialization_packet, sockaddr_in6> receive_from_raw();
 	void send_raw(const std::vector<uint8_t> & data);
-	void send_raw(const std::vector<std::span<uint8_t>> & data);
-	void send_many_raw(std::span<const std::vector<std::span<uint8_t>> *> data);
+	void send_raw(const std::vector<std::span<uint8_t>> & data, traffic_class traffic = traffic_class::control);
+	void send_many_raw(std::span<const std::vector<std::span<uint8_t>> *> data, std::span<const traffic_class> traffic = {});
 
 	void connect(in6_addr address, int port);
+	void connect(sockaddr_in6 address, int port);
 	void connect(in_addr address, int port);
 	void bind(int port);
 	void subscribe_multicast(in6_addr address);
 	void unsubscribe_multicast(in6_addr address);
 	void set_receive_buffer_size(int size);
 	void set_send_buffer_size(int size);
-	void set_tos(int type_of_service);
+	using fd_base::set_dscp;
+	// Marks each packet with the DSCP of its traffic class
+	void set_dscp(const dscp_map &);
 };
 
 class TCP : public fd_base
 {
+	// Messages are prefixed by their size
+	using message_size_t = uint32_t;
+	// Larger sizes come from a corrupted or malicious stream
+	static constexpr message_size_t max_message_size = 4 * 1024 * 1024;
+
 	std::shared_ptr<uint8_t[]> buffer;
 	ssize_t capacity_left = 0;
 	std::span<uint8_t> data;
@@ -142,6 +156,12 @@ public:
 	deserialization_packet receive_pending();
 	void send_raw(const std::vector<std::span<uint8_t>> & data);
 	void send_many_raw(std::span<const std::vector<std::span<uint8_t>> *> data);
+
+	// Limits the data waiting in the kernel that was not sent yet, the socket
+	// is not writable while there is more
+	void set_notsent_lowat(uint32_t bytes);
+	// Whether the unsent data is below the limit set by set_notsent_lowat
+	bool writable();
 };
 
 using UnixDatagram = UDP;
@@ -219,6 +239,7 @@ public:
 	static void serialize(serialization_packet & p, const T & data)
 	{
 		p.clear();
+		p.traffic = traffic_class_of(data);
 		uint8_t index = details::Index<std::decay_t<T>, std::tuple<VariantTypes...>>::value;
 		p.serialize(index);
 		p.serialize(data);
@@ -229,16 +250,27 @@ public:
 	{
 		thread_local serialization_packet p;
 		serialize(p, data);
-		this->send_raw(p);
+		if constexpr (std::is_same_v<Socket, UDP>)
+			this->send_raw(p, p.traffic);
+		else
+			this->send_raw(p);
 	}
 
 	void send(const std::span<serialization_packet> & packets)
 	{
 		thread_local std::vector<const std::vector<std::span<uint8_t>> *> data;
+		thread_local std::vector<traffic_class> traffic;
 		data.clear();
+		traffic.clear();
 		for (auto & packet: packets)
+		{
 			data.emplace_back(packet);
-		this->send_many_raw(data);
+			traffic.push_back(packet.traffic);
+		}
+		if constexpr (std::is_same_v<Socket, UDP>)
+			this->send_many_raw(data, traffic);
+		else
+			this->send_many_raw(data);
 	}
 };
 
@@ -0,0 +1,63 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace wivrn
+{
+// Each class can be sent with its own DSCP, so that Wi-Fi access points put
+// it in a different WMM access category
+enum class traffic_class : uint8_t
+{
+	control,
+	tracking,
+	audio,
+	video,
+
+	count
+};
+
+// DSCP values mapped to WMM access categories by access points and by the
+// Linux Wi-Fi stack (RFC 8325)
+namespace dscp
+{
+constexpr uint8_t best_effort = 0;  // AC_BE
+constexpr uint8_t video = 34;       // AF41, AC_VI
+constexpr uint8_t voice = 46;       // EF, AC_VO
+} // namespace dscp
+
+using dscp_map = std::array<uint8_t, size_t(traffic_class::count)>;
+
+constexpr dscp_map default_dscp{
+        dscp::best_effort, // control
+        dscp::voice,       // tracking
+        dscp::voice,       // audio
+        dscp::video,       // video
+};
+
+// Packets are sent as control unless their type has an overload in its namespace
+template <typename T>
+constexpr traffic_class traffic_class_of(const T &)
+{
+	return traffic_class::control;
+}
+} // namespace wivrn
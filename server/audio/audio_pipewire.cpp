@@ -22,8 +22,10 @@
 #include "os/os_time.h"
 #include "util/u_logging.h"
 #include "utils/ring_buffer.h"
+#include "utils/thread_policy.h"
 #include <memory>
 #include <pipewire/pipewire.h>
+#include <span>
 #include <spa/param/audio/format-utils.h>
 
 namespace wivrn
@@ -56,9 +58,9 @@ struct pipewire_device : public audio_device
 	        .process = &pipewire_device::speaker_process,
 	};
 
-	utils::ring_buffer<audio_data, 100> mic_samples;
-	std::atomic<size_t> mic_buffer_size_bytes;
-	audio_data mic_current;
+	// Microphone samples, about 340ms of 48kHz stereo
+	static const size_t mic_samples_size = 65536;
+	utils::ring_buffer<uint8_t, mic_samples_size> mic_samples;
 	std::unique_ptr<pw_stream, deleter> microphone;
 	pw_stream_events mic_events{
 	        .version = PW_VERSION_STREAM_EVENTS,
@@ -191,6 +193,7 @@ struct pipewire_device : public audio_device
 		if (desc.speaker or desc.microphone)
 			thread = std::jthread(
 			        [this](std::stop_token) {
+				set_thread_policy("pipewire audio");
 				pw_main_loop_run(pw_loop.get());
 				speaker.reset();
 				microphone.reset();
@@ -226,44 +229,16 @@ void pipewire_device::mic_process(void * self_v)
 		num_frames = data.maxsize / frame_size;
 	}
 	data.chunk->offset = 0;
-	data.chunk->size = 0;
 	data.chunk->stride = frame_size;
-
-	while (num_frames != 0)
-	{
-		// remaining bytes in existing buffer
-		auto & current = self->mic_current;
-		ptrdiff_t tmp_remain = current.payload.size_bytes();
-		// limit to requested frames
-		tmp_remain = std::min<ptrdiff_t>(tmp_remain, num_frames * frame_size);
-		if (tmp_remain)
-		{
-			memcpy(data_ptr, current.payload.data(), tmp_remain);
-			current.payload = current.payload.subspan(tmp_remain);
-			data_ptr += tmp_remain;
-			data.chunk->size += tmp_remain;
-			num_frames -= tmp_remain / frame_size;
-			self->mic_buffer_size_bytes -= tmp_remain;
-		}
-		else
-		{
-			auto tmp = self->mic_samples.read();
-			if (not tmp)
-				break;
-			self->mic_current = std::move(*tmp);
-		}
-	}
+	data.chunk->size = self->mic_samples.read_n(std::span(data_ptr, num_frames * frame_size));
 	pw_stream_queue_buffer(self->microphone.get(), buffer);
 
 	// discard excess data, so we don't accumulate latency
 	size_t target_buffer_size = frame_size * self->desc.microphone->sample_rate * 0.08;
-	while (self->mic_buffer_size_bytes > target_buffer_size and self->mic_samples.size() > 1)
+	if (size_t size = self->mic_samples.size(); size > target_buffer_size)
 	{
-		auto tmp = self->mic_samples.read();
-		if (not tmp)
-			break;
-		self->mic_buffer_size_bytes -= tmp->payload.size_bytes();
-		U_LOG_D("Audio sync: discard %ld bytes", tmp->payload.size_bytes());
+		size_t discarded = self->mic_samples.skip((size - target_buffer_size) / frame_size * frame_size);
+		U_LOG_D("Audio sync: discard %ld bytes", discarded);
 	}
 }
 
@@ -300,9 +275,18 @@ void pipewire_device::speaker_process(void * self_v)
 
 void pipewire_device::process_mic_data(wivrn::audio_data && sample)
 {
-	auto size = sample.payload.size_bytes();
-	if (mic_samples.write(std::move(sample)))
-		mic_buffer_size_bytes += size;
+	if (not desc.microphone)
+		return;
+
+	// Only write whole frames, and drop packets which do not fit
+	const size_t frame_size = desc.microphone->num_channels * sizeof(int16_t);
+	auto payload = sample.payload.first(sample.payload.size() / frame_size * frame_size);
+	if (mic_samples.size() + payload.size() > mic_samples_size)
+	{
+		U_LOG_D("Audio sync: buffer full, drop %ld bytes", payload.size());
+		return;
+	}
+	mic_samples.write_n(payload);
 }
 
 std::shared_ptr<audio_device> create_pipewire_handle(
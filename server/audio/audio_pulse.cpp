@@ -4,7 +4,8 @@
 #include "driver/wivrn_session.h"
 #include "os/os_time.h"
 #include "util/u_logging.h"
-#include "utils/sync_queue.h"
+#include "utils/mpmc_queue.h"
+#include "utils/thread_policy.h"
 #include "utils/wrap_lambda.h"
 
 #include <pulse/context.h>
@@ -252,7 +253,8 @@ struct pulse_device : public audio_device
 	std::optional<module_entry> speaker;
 	std::optional<module_entry> microphone;
 
-	utils::sync_queue<audio_data> mic_buffer;
+	// Drop old samples rather than adding latency when the pipe is not drained
+	utils::mpmc_queue<audio_data, 128, utils::overflow_policy::drop_oldest> mic_buffer;
 
 	wivrn::fd_base speaker_pipe;
 	wivrn::fd_base mic_pipe;
@@ -293,7 +295,7 @@ struct pulse_device : public audio_device
 	void run_speaker()
 	{
 		assert(desc.speaker);
-		pthread_setname_np(pthread_self(), "speaker_thread");
+		set_thread_policy("speaker_thread");
 
 		U_LOG_I("started speaker thread, sample rate %dHz, %d channels", desc.speaker->sample_rate, desc.speaker->num_channels);
 
@@ -364,7 +366,7 @@ struct pulse_device : public audio_device
 	void run_mic()
 	{
 		assert(desc.microphone);
-		pthread_setname_np(pthread_self(), "mic_thread");
+		set_thread_policy("mic_thread");
 
 		const size_t sample_size = desc.microphone->num_channels * sizeof(int16_t);
 		try
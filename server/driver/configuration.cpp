@@ -26,6 +26,7 @@
 #define JSON_DIAGNOSTICS 1
 #include <nlohmann/json.hpp>
 #include <random>
+#include <sched.h>
 #include <stdlib.h>
 
 #include "util/u_logging.h"
@@ -126,6 +127,82 @@ configuration configuration::read_user_configuration()
 		{
 			result.tcp_only = json["tcp_only"];
 		}
+
+		if (json.contains("dscp"))
+		{
+			if (json["dscp"].is_boolean())
+			{
+				if (not json["dscp"].get<bool>())
+					result.dscp.reset();
+			}
+			else
+			{
+				static const std::map<std::string, traffic_class> classes{
+				        {"control", traffic_class::control},
+				        {"tracking", traffic_class::tracking},
+				        {"audio", traffic_class::audio},
+				        {"video", traffic_class::video},
+				};
+				for (const auto & [name, value]: json["dscp"].items())
+				{
+					auto it = classes.find(name);
+					if (it == classes.end())
+						throw std::runtime_error("invalid traffic class " + name);
+					if (value.get<int>() < 0 or value.get<int>() > 63)
+						throw std::runtime_error("invalid DSCP value " + value.dump());
+					(*result.dscp)[size_t(it->second)] = value;
+				}
+			}
+		}
+
+		if (json.contains("threads"))
+		{
+			for (const auto & [name, policy]: json["threads"].items())
+			{
+				configuration::thread_policy p;
+				if (policy.contains("scheduler"))
+				{
+					static const std::map<std::string, int> schedulers{
+					        {"other", SCHED_OTHER},
+					        {"batch", SCHED_BATCH},
+					        {"idle", SCHED_IDLE},
+					        {"fifo", SCHED_FIFO},
+					        {"rr", SCHED_RR},
+					};
+					auto it = schedulers.find(policy["scheduler"]);
+					if (it == schedulers.end())
+						throw std::runtime_error("invalid scheduler value " + policy["scheduler"].get<std::string>());
+					p.scheduler = it->second;
+				}
+				if (policy.contains("priority"))
+					p.priority = policy["priority"];
+				if (policy.contains("nice"))
+					p.nice = policy["nice"];
+				if (policy.contains("cpus"))
+					p.cpus = policy["cpus"].get<std::vector<int>>();
+				result.threads.emplace(name, p);
+			}
+		}
+
+		if (json.contains("isolate_application"))
+		{
+			result.isolate_application = json["isolate_application"];
+		}
+
+		if (json.contains("adaptive_refresh_rate"))
+		{
+			result.adaptive_refresh_rate = json["adaptive_refresh_rate"];
+		}
+
+		if (json.contains("min_refresh_rate"))
+		{
+			result.min_refresh_rate = json["min_refresh_rate"];
+		}
+
+		if (json.contains("adaptive_foveation"))
+		{
+			result.adaptive_foveation = json["adaptive_foveation"];
+		}
 	}
 	catch (const std::exception & e)
 	{
@@ -45,11 +45,29 @@ struct configuration
 		std::optional<std::string> device;
 	};
 
+	struct thread_policy
+	{
+		// SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR
+		std::optional<int> scheduler;
+		std::optional<int> priority;
+		std::optional<int> nice;
+		std::vector<int> cpus;
+	};
+
 	std::vector<encoder> encoders;
 	std::optional<int> bitrate;
 	std::optional<std::array<double, 2>> scale;
 	std::vector<std::string> application;
 	bool tcp_only = false;
+	std::optional<dscp_map> dscp = default_dscp;
+	// Indexed by thread name, may contain shell wildcards
+	std::map<std::string, thread_policy> threads;
+	bool isolate_application = false;
+	// Lower the refresh rate when the stream cannot keep up
+	bool adaptive_refresh_rate = false;
+	std::optional<float> min_refresh_rate;
+	// Narrow the foveation, then lower the bitrate, when the link degrades
+	bool adaptive_foveation = false;
 
 	static void set_config_file(const std::filesystem::path &);
 	static const std::filesystem::path & get_config_file();
@@ -0,0 +1,145 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "foveation_governor.h"
+
+#include <algorithm>
+
+namespace wivrn
+{
+
+static const int64_t window_ns = 250'000'000;
+// Windows with fewer feedbacks are ignored
+static const int min_feedbacks = 5;
+
+// Strengthen foveation as soon as one of the limits is exceeded
+static const float max_lost = 0.02;
+static const int64_t max_queueing_delay_ns = 8'000'000;
+static const float strength_up_step = 0.25;
+
+// Relax it slowly once the link has been clear for clear_windows_to_relax windows in a row
+static const float clear_lost = 0.005;
+static const int64_t clear_queueing_delay_ns = 2'000'000;
+static const int clear_windows_to_relax = 4;
+static const float strength_down_step = 0.05;
+
+void foveation_governor::reset_window(int64_t now_ns)
+{
+	window_start_ns = now_ns;
+	feedbacks = 0;
+	lost_frames = 0;
+	delay_sum_ns = 0;
+	delays = 0;
+	window_min_delay_ns.reset();
+}
+
+void foveation_governor::on_feedback(bool decoded)
+{
+	std::lock_guard lock(mutex);
+	++feedbacks;
+	if (not decoded)
+		++lost_frames;
+}
+
+void foveation_governor::on_delay(int64_t delay_ns)
+{
+	std::lock_guard lock(mutex);
+	delay_sum_ns += delay_ns;
+	++delays;
+	window_min_delay_ns = std::min(window_min_delay_ns.value_or(delay_ns), delay_ns);
+}
+
+std::optional<foveation_governor::evaluation> foveation_governor::update(int64_t now_ns)
+{
+	std::lock_guard lock(mutex);
+	if (window_start_ns == 0)
+	{
+		reset_window(now_ns);
+		return std::nullopt;
+	}
+
+	if (now_ns < window_start_ns + window_ns)
+		return std::nullopt;
+
+	if (feedbacks < min_feedbacks)
+	{
+		reset_window(now_ns);
+		return std::nullopt;
+	}
+
+	evaluation result{
+	        .lost = float(lost_frames) / feedbacks,
+	        .queueing_delay_ns = 0,
+	        .strength = strength_,
+	        .changed = false,
+	};
+
+	if (window_min_delay_ns)
+	{
+		min_delays_ns[next_min_delay] = window_min_delay_ns;
+		next_min_delay = (next_min_delay + 1) % min_delays_ns.size();
+
+		int64_t base_delay_ns = *window_min_delay_ns;
+		for (const auto & delay: min_delays_ns)
+		{
+			if (delay)
+				base_delay_ns = std::min(base_delay_ns, *delay);
+		}
+		result.queueing_delay_ns = delay_sum_ns / delays - base_delay_ns;
+	}
+	reset_window(now_ns);
+
+	if (result.lost > max_lost or result.queueing_delay_ns > max_queueing_delay_ns)
+	{
+		clear_windows = 0;
+		strength_ = std::min(strength_ + strength_up_step, 1.f);
+	}
+	else if (result.lost <= clear_lost and result.queueing_delay_ns < clear_queueing_delay_ns)
+	{
+		if (++clear_windows < clear_windows_to_relax)
+			return result;
+		clear_windows = 0;
+		strength_ = std::max(strength_ - strength_down_step, 0.f);
+	}
+	else
+	{
+		clear_windows = 0;
+		return result;
+	}
+
+	result.changed = strength_ != result.strength;
+	result.strength = strength_;
+	return result;
+}
+
+float foveation_governor::strength()
+{
+	std::lock_guard lock(mutex);
+	return strength_;
+}
+
+void foveation_governor::reset()
+{
+	std::lock_guard lock(mutex);
+	window_start_ns = 0;
+	min_delays_ns = {};
+	next_min_delay = 0;
+	clear_windows = 0;
+	strength_ = 0;
+}
+} // namespace wivrn
@@ -0,0 +1,78 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+
+namespace wivrn
+{
+
+// Computes a strength which narrows the high resolution region, then lowers the
+// bitrate, when the link degrades. The link quality is derived from
+// the frames the headset could not decode and from the queueing delay, which
+// is the one-way delay above its recent minimum.
+class foveation_governor
+{
+public:
+	struct evaluation
+	{
+		// Fraction of frames which could not be decoded by the headset
+		float lost;
+		int64_t queueing_delay_ns;
+		// Between 0 (widened foveation, configured bitrate) and 1 (configured foveation, half bitrate)
+		float strength;
+		bool changed;
+	};
+
+private:
+	std::mutex mutex;
+
+	int64_t window_start_ns = 0;
+	int feedbacks = 0;
+	int lost_frames = 0;
+	int64_t delay_sum_ns = 0;
+	int delays = 0;
+	std::optional<int64_t> window_min_delay_ns;
+
+	// Minimum delay of the last windows, the smallest one is the delay of an empty queue
+	std::array<std::optional<int64_t>, 40> min_delays_ns;
+	size_t next_min_delay = 0;
+
+	int clear_windows = 0;
+	float strength_ = 0;
+
+	void reset_window(int64_t now_ns);
+
+public:
+	void on_feedback(bool decoded);
+	// Time between the compositor presenting a frame and the headset receiving it
+	void on_delay(int64_t delay_ns);
+
+	// Evaluates the samples once per window
+	std::optional<evaluation> update(int64_t now_ns);
+
+	float strength();
+
+	// Goes back to the configured foveation
+	void reset();
+};
+} // namespace wivrn
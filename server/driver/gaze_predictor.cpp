@@ -0,0 +1,214 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "gaze_predictor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace wivrn
+{
+
+static constexpr float deg = std::numbers::pi_v<float> / 180;
+
+// Samples further apart are not used to compute velocity
+static const int64_t max_sample_interval_ns = 50'000'000;
+// Velocity is measured between the latest sample and one at least this old:
+// the samples arrive 1 to 5ms apart with jitter, which makes instantaneous speeds
+// meaningless, eye trackers run between 30 and 250Hz
+static const int64_t min_velocity_window_ns = 15'000'000;
+
+// Velocity thresholds for saccade detection (I-VT)
+static const float saccade_onset_speed = 100 * deg;
+static const float saccade_end_speed = 40 * deg;
+static const int64_t max_saccade_duration_ns = 150'000'000;
+// Consecutive samples above the onset speed before a saccade is assumed
+static const int saccade_onset_samples = 3;
+
+// Saccade main sequence: peak velocity = v_max * (1 - exp(-amplitude / c))
+static const float main_sequence_v_max = 500 * deg;
+static const float main_sequence_c = 14 * deg;
+static const float max_saccade_amplitude = 40 * deg;
+
+// Extrapolation outside of saccades
+static const float max_pursuit_speed = 30 * deg;
+static const int64_t max_extrapolation_ns = 50'000'000;
+
+// Confidence decreases when the last sample is older than the usual motion to photon latency
+static const int64_t expected_latency_ns = 50'000'000;
+static const int64_t stale_ns = 150'000'000;
+
+static float length(xrt_vec2 v)
+{
+	return std::hypot(v.x, v.y);
+}
+
+static float saccade_amplitude(float peak_speed)
+{
+	peak_speed = std::min(peak_speed, 0.95f * main_sequence_v_max);
+	return std::min(-main_sequence_c * std::log(1 - peak_speed / main_sequence_v_max), max_saccade_amplitude);
+}
+
+const gaze_predictor::sample * gaze_predictor::velocity_reference(int64_t time_ns) const
+{
+	for (size_t i = 1; i <= history_size; ++i)
+	{
+		const auto & item = history[(history_next + history.size() - i) % history.size()];
+		if (time_ns - item.time_ns >= max_sample_interval_ns)
+			return nullptr;
+		if (time_ns - item.time_ns >= min_velocity_window_ns)
+			return &item;
+	}
+	return nullptr;
+}
+
+void gaze_predictor::add(int64_t time_ns, xrt_vec2 angles)
+{
+	if (latest)
+	{
+		const auto & prev = *latest;
+		if (time_ns <= prev.time_ns)
+			return;
+
+		// The tracker runs slower than the packets, repeated values are not new measurements
+		if (valid and angles.x == prev.angles.x and angles.y == prev.angles.y)
+			return;
+
+		if (time_ns - prev.time_ns >= max_sample_interval_ns)
+			invalidate();
+	}
+
+	const sample * ref = valid ? velocity_reference(time_ns) : nullptr;
+	if (ref)
+	{
+		float dt = (time_ns - ref->time_ns) * 1e-9f;
+		velocity = {
+		        (angles.x - ref->angles.x) / dt,
+		        (angles.y - ref->angles.y) / dt,
+		};
+		speed = length(velocity);
+
+		if (speed > saccade_onset_speed)
+		{
+			if (fast_samples++ == 0)
+				fast_start = *ref;
+		}
+		else
+			fast_samples = 0;
+
+		if (not in_saccade and fast_samples >= saccade_onset_samples)
+		{
+			in_saccade = true;
+			saccade_start_ns = fast_start.time_ns;
+			saccade_onset = fast_start.angles;
+			saccade_peak_speed = 0;
+			saccade_peak_travel = 0;
+		}
+
+		if (in_saccade)
+		{
+			if (speed < saccade_end_speed or time_ns - saccade_start_ns > max_saccade_duration_ns)
+			{
+				in_saccade = false;
+				fast_samples = 0;
+				velocity = {};
+			}
+			else
+			{
+				xrt_vec2 travel{angles.x - saccade_onset.x, angles.y - saccade_onset.y};
+				if (float l = length(travel); l > 0)
+					saccade_direction = {travel.x / l, travel.y / l};
+				if (speed > saccade_peak_speed)
+				{
+					// The speed is measured over the window, it was reached around its middle
+					saccade_peak_speed = speed;
+					saccade_peak_travel = length({
+					        (angles.x + ref->angles.x) / 2 - saccade_onset.x,
+					        (angles.y + ref->angles.y) / 2 - saccade_onset.y,
+					});
+				}
+			}
+		}
+	}
+
+	latest = {time_ns, angles};
+	history[history_next] = *latest;
+	history_next = (history_next + 1) % history.size();
+	history_size = std::min(history_size + 1, history.size());
+	valid = true;
+}
+
+void gaze_predictor::invalidate()
+{
+	valid = false;
+	history_size = 0;
+	fast_samples = 0;
+	in_saccade = false;
+	velocity = {};
+	speed = 0;
+}
+
+gaze_predictor::prediction gaze_predictor::predict(int64_t time_ns) const
+{
+	if (not latest)
+		return {};
+
+	int64_t age = std::max<int64_t>(time_ns - latest->time_ns, 0);
+
+	prediction result{
+	        .angles = latest->angles,
+	        .confidence = 0,
+	        .speed = speed,
+	        .saccade = in_saccade,
+	};
+
+	if (not valid)
+		return result;
+
+	result.confidence = std::clamp(1 - float(age - expected_latency_ns) / stale_ns, 0.f, 1.f);
+
+	if (in_saccade)
+	{
+		// Assume the eye lands where the main sequence predicts, the saccade
+		// is usually over before the frame is displayed
+		float traveled = length({latest->angles.x - saccade_onset.x, latest->angles.y - saccade_onset.y});
+		// The velocity profile is roughly symmetric: the eye does not travel
+		// more than twice the distance it had when it reached its peak speed
+		float amplitude = std::clamp(saccade_amplitude(saccade_peak_speed), traveled, std::max(2 * saccade_peak_travel, traveled));
+		result.angles = {
+		        saccade_onset.x + saccade_direction.x * amplitude,
+		        saccade_onset.y + saccade_direction.y * amplitude,
+		};
+		return result;
+	}
+
+	xrt_vec2 v = velocity;
+	if (float s = length(v); s > max_pursuit_speed)
+	{
+		v.x *= max_pursuit_speed / s;
+		v.y *= max_pursuit_speed / s;
+	}
+	float dt = std::min(age, max_extrapolation_ns) * 1e-9f;
+	result.angles = {
+	        latest->angles.x + v.x * dt,
+	        latest->angles.y + v.y * dt,
+	};
+	return result;
+}
+} // namespace wivrn
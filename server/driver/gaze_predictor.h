@@ -0,0 +1,88 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "xrt/xrt_defines.h"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+namespace wivrn
+{
+
+// Predicts where the eye will be looking from the successive gaze samples.
+// Angles are yaw and pitch in radians, relative to the head.
+// Velocity is measured over at least 15ms, so that the jitter of the sample
+// timestamps does not look like eye motion.
+// During a saccade, the landing point is estimated from the peak velocity,
+// otherwise the gaze is extrapolated at smooth pursuit speeds.
+class gaze_predictor
+{
+public:
+	struct sample
+	{
+		int64_t time_ns;
+		xrt_vec2 angles;
+	};
+
+	struct prediction
+	{
+		xrt_vec2 angles;
+		// 0 when gaze is unknown or stale, 1 for a fresh sample during fixation
+		float confidence;
+		// Angular speed of the last samples, rad/s
+		float speed;
+		bool saccade;
+	};
+
+private:
+	std::optional<sample> latest;
+	// Recent distinct samples, to measure the velocity over several tracker periods
+	std::array<sample, 16> history;
+	size_t history_size = 0;
+	size_t history_next = 0;
+
+	bool valid = false;
+	xrt_vec2 velocity{};
+	float speed = 0;
+
+	// Consecutive samples above the saccade onset speed, and where the first one started
+	int fast_samples = 0;
+	sample fast_start;
+
+	// Current saccade
+	bool in_saccade = false;
+	int64_t saccade_start_ns;
+	xrt_vec2 saccade_onset;
+	xrt_vec2 saccade_direction;
+	float saccade_peak_speed;
+	// Distance from the onset when the speed peaked
+	float saccade_peak_travel;
+
+	const sample * velocity_reference(int64_t time_ns) const;
+
+public:
+	void add(int64_t time_ns, xrt_vec2 angles);
+	// Eye tracking was lost, for instance during a blink
+	void invalidate();
+
+	prediction predict(int64_t time_ns) const;
+};
+} // namespace wivrn
@@ -23,14 +23,94 @@
 #include "os/os_time.h"
 #include "util/u_logging.h"
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstddef>
-#include <list>
+#include <cstdint>
+#include <limits>
 #include <mutex>
 #include <openxr/openxr.h>
+#include <utility>
+#include <vector>
 
 namespace wivrn
 {
 
+// Epoch of the samples being added, and epoch pinned by a snapshot whose
+// samples must be kept
+struct sample_epoch
+{
+	uint64_t epoch;
+	uint64_t pinned;
+};
+
+// Samples are tagged with the epoch of the packet they come from, all the
+// samples of a packet are published at once. The first query for a display
+// time pins the current epoch, the following queries for the same time use it,
+// so that the poses of all devices for an application frame come from the same
+// packets. Once the compositor starts a frame, queries up to its display time
+// use the latest epoch instead, so that its late query is not stale.
+class tracking_epoch
+{
+	// Only modified by the network thread
+	std::atomic<uint64_t> published = 0;
+
+	// The pinned epoch is read from published and pinned under the lock, so
+	// that the network thread sees the pin before it discards the samples of
+	// that epoch
+	std::mutex mutex;
+	XrTime pinned_timestamp_ns = 0;
+	uint64_t pinned_epoch = 0;
+
+	// Display time of the last frame started by the compositor
+	std::atomic<XrTime> composited_ns = 0;
+
+public:
+	// Epoch of the samples being added, from the network thread
+	sample_epoch next()
+	{
+		std::lock_guard lock(mutex);
+		uint64_t current = published.load(std::memory_order_relaxed);
+		// Frames already started by the compositor use the latest epoch
+		bool pinned = pinned_timestamp_ns > composited_ns.load(std::memory_order_relaxed);
+		return {
+		        .epoch = current + 1,
+		        .pinned = pinned ? pinned_epoch : current,
+		};
+	}
+
+	// Makes the samples of the epoch visible, from the network thread
+	void publish(uint64_t epoch)
+	{
+		published.store(epoch, std::memory_order_release);
+	}
+
+	// The compositor started the frame displayed at display_time_ns
+	void composite(XrTime display_time_ns)
+	{
+		composited_ns.store(display_time_ns, std::memory_order_relaxed);
+	}
+
+	// Epoch to use for queries at at_timestamp_ns
+	uint64_t snapshot(XrTime at_timestamp_ns)
+	{
+		if (at_timestamp_ns <= composited_ns.load(std::memory_order_relaxed))
+			return published.load(std::memory_order_acquire);
+
+		std::lock_guard lock(mutex);
+		uint64_t latest = published.load(std::memory_order_acquire);
+		if (pinned_timestamp_ns == at_timestamp_ns)
+			return pinned_epoch;
+		// Query for an older frame
+		if (pinned_timestamp_ns > at_timestamp_ns)
+			return latest;
+
+		pinned_timestamp_ns = at_timestamp_ns;
+		pinned_epoch = latest;
+		return latest;
+	}
+};
+
 template <typename Derived, typename Data, XrDuration extrapolation = 0, size_t MaxSamples = 10>
 class history
 {
@@ -38,19 +118,35 @@ class history
 	{
 		XrTime produced_timestamp;
 		XrTime at_timestamp_ns;
+		uint64_t epoch;
+		// Samples replaced by newer ones are kept for queries in older epochs
+		uint64_t superseded_epoch = std::numeric_limits<uint64_t>::max();
+
+		bool visible(uint64_t query_epoch) const
+		{
+			return epoch <= query_epoch and query_epoch < superseded_epoch;
+		}
 	};
 
+	// Samples of the current and previous epochs, and of the pinned epoch
+	// when there is room
+	static constexpr size_t max_stored_samples = 2 * MaxSamples;
+
 	std::mutex mutex;
-	std::list<TimedData> data;
+	// Sorted by at_timestamp_ns
+	std::vector<TimedData> data;
 	XrTime last_request;
 	XrTime last_produced;
 
 protected:
 	history() :
-	        last_request(os_monotonic_get_ns()) {}
+	        last_request(os_monotonic_get_ns())
+	{
+		data.reserve(max_stored_samples + 1);
+	}
 
 	// return true if object is active (last request is not too old)
-	bool add_sample(XrTime produced_timestamp, XrTime timestamp, const Data & sample, const clock_offset & offset)
+	bool add_sample(XrTime produced_timestamp, XrTime timestamp, const Data & sample, const clock_offset & offset, const sample_epoch & epoch)
 	{
 		XrTime produced = offset.from_headset(produced_timestamp);
 		XrTime t = offset.from_headset(timestamp);
@@ -67,7 +163,7 @@ protected:
 			{
 				U_LOG_D("not using history: clock_offset not stable");
 				data.clear();
-				data.emplace_back(sample, produced, t);
+				data.emplace_back(sample, produced, t, epoch.epoch);
 				return active;
 			}
 
@@ -75,93 +171,124 @@ protected:
 				return active;
 		}
 
-		// Discard outdated predictions
-		if (t != produced)
+		// Discard outdated predictions, and samples for the same time
+		for (auto & item: data)
 		{
-			for (auto it = data.begin(); it != data.end();)
+			if (not item.visible(epoch.epoch))
+				continue;
+
+			if (item.at_timestamp_ns == t or
+			    (t != produced and
+			     item.at_timestamp_ns != item.produced_timestamp // a prediction
+			     and item.produced_timestamp < produced          // older prediction
+			     and item.at_timestamp_ns <= t + 1'000'000))     // we have far enough data
+				item.superseded_epoch = epoch.epoch;
+		}
+
+		// Insert the new sample
+		auto it = std::upper_bound(data.begin(), data.end(), t, [](int64_t t, TimedData & sample) { return t < sample.at_timestamp_ns; });
+		data.emplace(it, sample, produced, t, epoch.epoch);
+
+		size_t count = std::ranges::count_if(data, [&](const TimedData & item) { return item.visible(epoch.epoch); });
+		for (auto & item: data)
+		{
+			if (count <= MaxSamples)
+				break;
+			if (item.visible(epoch.epoch))
 			{
-				if (it->at_timestamp_ns == it->produced_timestamp // not a prediction
-				    or it->produced_timestamp >= produced         // recent prediction
-				    or it->at_timestamp_ns > t + 1'000'000)       // we don't have far enough data yet
-					++it;
-				else
-					it = data.erase(it);
+				item.superseded_epoch = epoch.epoch;
+				--count;
 			}
 		}
 
-		// Insert the new sample
-		auto it = std::lower_bound(data.begin(), data.end(), t, [](TimedData & sample, int64_t t) { return sample.at_timestamp_ns < t; });
-		if (it == data.end())
-			data.emplace_back(sample, produced, t);
-		else if (it->at_timestamp_ns == t)
-			*it = TimedData(sample, produced, t);
-		else
-			data.emplace(it, sample, produced, t);
+		// Keep the samples for the current, previous and pinned epochs
+		std::erase_if(data, [&](const TimedData & item) {
+			return not(item.visible(epoch.epoch) or item.visible(epoch.epoch - 1) or item.visible(epoch.pinned));
+		});
 
-		while (data.size() > MaxSamples)
-			data.pop_front();
+		// The previous epoch may be pinned while this packet is added. When the
+		// pinned epoch is far behind, drop its oldest samples: the current and
+		// previous epochs have at most MaxSamples each
+		for (auto it = data.begin(); data.size() > max_stored_samples and it != data.end();)
+		{
+			if (it->visible(epoch.epoch) or it->visible(epoch.epoch - 1))
+				++it;
+			else
+				it = data.erase(it);
+		}
 
 		return active;
 	}
 
 public:
-	std::pair<std::chrono::nanoseconds, Data> get_at(XrTime at_timestamp_ns)
+	// Only uses the samples published in epoch, see tracking_epoch
+	std::pair<std::chrono::nanoseconds, Data> get_at(XrTime at_timestamp_ns, uint64_t epoch)
 	{
 		std::lock_guard lock(mutex);
 		std::chrono::nanoseconds ex(std::max<XrTime>(0, at_timestamp_ns - last_produced));
 
 		last_request = os_monotonic_get_ns();
 
-		if (data.empty())
+		std::array<const TimedData *, MaxSamples> samples;
+		size_t count = 0;
+		for (const auto & sample: data)
+		{
+			if (sample.visible(epoch) and count < samples.size())
+				samples[count++] = &sample;
+		}
+
+		if (count == 0)
 		{
 			return {};
 		}
 
-		if (at_timestamp_ns - data.back().at_timestamp_ns > 1'000'000'000)
+		const TimedData & front = *samples[0];
+		const TimedData & back = *samples[count - 1];
+
+		if (at_timestamp_ns - back.at_timestamp_ns > 1'000'000'000)
 		{
 			// stale data
-			data.clear();
 			return {};
 		}
 
-		if (data.size() == 1)
+		if (count == 1)
 		{
-			return {ex, data.front()};
+			return {ex, front};
 		}
 
-		if (data.front().at_timestamp_ns > at_timestamp_ns)
+		if (front.at_timestamp_ns > at_timestamp_ns)
 		{
 			if constexpr (extrapolation)
 			{
-				auto second = data.begin();
-				auto first = second++;
-				at_timestamp_ns = std::max(at_timestamp_ns, data.front().at_timestamp_ns - extrapolation);
-				return {ex, Derived::extrapolate(*first, *second, first->at_timestamp_ns, second->at_timestamp_ns, at_timestamp_ns)};
+				const TimedData & second = *samples[1];
+				at_timestamp_ns = std::max(at_timestamp_ns, front.at_timestamp_ns - extrapolation);
+				return {ex, Derived::extrapolate(front, second, front.at_timestamp_ns, second.at_timestamp_ns, at_timestamp_ns)};
 			}
 			else
-				return {ex, data.front()};
+				return {ex, front};
 		}
 
-		for (auto after = data.begin(), before = after++; after != data.end(); before = after++)
+		for (size_t i = 1; i < count; ++i)
 		{
-			if (after->at_timestamp_ns > at_timestamp_ns)
+			const TimedData & before = *samples[i - 1];
+			const TimedData & after = *samples[i];
+			if (after.at_timestamp_ns > at_timestamp_ns)
 			{
-				float t = float(after->at_timestamp_ns - at_timestamp_ns) /
-				          (after->at_timestamp_ns - before->at_timestamp_ns);
-				return {ex, Derived::interpolate(*before, *after, t)};
+				float t = float(after.at_timestamp_ns - at_timestamp_ns) /
+				          (after.at_timestamp_ns - before.at_timestamp_ns);
+				return {ex, Derived::interpolate(before, after, t)};
 			}
 		}
 
 		if constexpr (extrapolation)
 		{
-			auto prev = data.rbegin();
-			auto last = prev++;
-			at_timestamp_ns = std::min(at_timestamp_ns, data.back().at_timestamp_ns + extrapolation);
-			return {ex, Derived::extrapolate(*prev, *last, prev->at_timestamp_ns, last->at_timestamp_ns, at_timestamp_ns)};
+			const TimedData & prev = *samples[count - 2];
+			at_timestamp_ns = std::min(at_timestamp_ns, back.at_timestamp_ns + extrapolation);
+			return {ex, Derived::extrapolate(prev, back, prev.at_timestamp_ns, back.at_timestamp_ns, at_timestamp_ns)};
 		}
 		else
 		{
-			return {ex, data.back()};
+			return {ex, back};
 		}
 	}
 };
@@ -29,6 +29,17 @@ using namespace xrt::auxiliary::math;
 namespace wivrn
 {
 
+demuxed_tracking::demuxed_tracking(const from_headset::tracking & tracking, const sample_epoch & epoch) :
+        tracking(tracking),
+        epoch(epoch)
+{
+	for (const auto & pose: tracking.device_poses)
+	{
+		if (size_t(pose.device) < poses.size())
+			poses[size_t(pose.device)] = &pose;
+	}
+}
+
 xrt_space_relation pose_list::interpolate(const xrt_space_relation & a, const xrt_space_relation & b, float t)
 {
 	xrt_space_relation result;
@@ -62,16 +73,13 @@ xrt_space_relation pose_list::extrapolate(const xrt_space_relation & a, const xr
 	return res;
 }
 
-bool pose_list::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+bool pose_list::update_tracking(const demuxed_tracking & tracking, const clock_offset & offset)
 {
-	for (const auto & pose: tracking.device_poses)
-	{
-		if (pose.device != device)
-			continue;
+	const auto * pose = tracking.pose(device);
+	if (not pose)
+		return true;
 
-		return add_sample(tracking.production_timestamp, tracking.timestamp, convert_pose(pose), offset);
-	}
-	return true;
+	return add_sample(tracking.tracking.production_timestamp, tracking.tracking.timestamp, convert_pose(*pose), offset, tracking.epoch);
 }
 
 xrt_space_relation pose_list::convert_pose(const from_headset::tracking::pose & pose)
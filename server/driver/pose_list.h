@@ -23,10 +23,32 @@
 #include "wivrn_packets.h"
 #include "xrt/xrt_defines.h"
 
+#include <array>
+#include <cstdint>
+
 namespace wivrn
 {
 struct clock_offset;
 
+// Tracking packet indexed by device, so that each device history gets its
+// sample without scanning the packet
+class demuxed_tracking
+{
+	std::array<const from_headset::tracking::pose *, size_t(device_id::EYE_GAZE) + 1> poses{};
+
+public:
+	const from_headset::tracking & tracking;
+	// Epoch of the samples, see tracking_epoch
+	const sample_epoch epoch;
+
+	demuxed_tracking(const from_headset::tracking & tracking, const sample_epoch & epoch);
+
+	const from_headset::tracking::pose * pose(device_id id) const
+	{
+		return size_t(id) < poses.size() ? poses[size_t(id)] : nullptr;
+	}
+};
+
 class pose_list : public history<pose_list, xrt_space_relation>
 {
 public:
@@ -38,7 +60,7 @@ public:
 	pose_list(wivrn::device_id id) :
 	        device(id) {}
 
-	bool update_tracking(const wivrn::from_headset::tracking &, const clock_offset & offset);
+	bool update_tracking(const demuxed_tracking &, const clock_offset & offset);
 
 	static xrt_space_relation convert_pose(const wivrn::from_headset::tracking::pose &);
 };
@@ -0,0 +1,194 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "refresh_rate_governor.h"
+
+#include <algorithm>
+
+namespace wivrn
+{
+
+static const int64_t window_ns = 1'000'000'000;
+// Windows with fewer frames are ignored
+static const int min_frames = 10;
+
+// Step down when any of the limits is exceeded for overloaded_windows windows in a row
+static const float max_app_missed = 0.1;
+static const float max_encode_load = 0.85;
+static const float max_lost = 0.05;
+static const int overloaded_windows_to_step_down = 2;
+
+// Step up when the load, scaled to the next refresh rate, is below these limits for step_up_windows windows in a row
+static const float idle_app_missed = 0.02;
+static const float idle_encode_load = 0.6;
+static const float idle_lost = 0.01;
+static const int initial_step_up_windows = 5;
+static const int max_step_up_windows = 120;
+
+refresh_rate_governor::refresh_rate_governor(std::vector<float> available, float max, float min) :
+        step_up_windows(initial_step_up_windows)
+{
+	std::ranges::sort(available);
+	for (float rate: available)
+	{
+		if (rate >= min and rate <= max and (rates.empty() or rate > rates.back()))
+			rates.push_back(rate);
+	}
+	if (rates.empty() or rates.back() != max)
+		rates.push_back(max);
+
+	initial = rates.size() - 1;
+	current = initial;
+}
+
+void refresh_rate_governor::reset_window(int64_t now_ns)
+{
+	window_start_ns = now_ns;
+	frames = 0;
+	missed_frames = 0;
+	for (auto & [sum, count]: encode_times)
+	{
+		sum = 0;
+		count = 0;
+	}
+	feedbacks = 0;
+	lost_frames = 0;
+}
+
+void refresh_rate_governor::on_app_frame(bool new_frame)
+{
+	std::lock_guard lock(mutex);
+	++frames;
+	if (not new_frame)
+		++missed_frames;
+}
+
+void refresh_rate_governor::on_encode(size_t thread, int64_t duration_ns)
+{
+	std::lock_guard lock(mutex);
+	if (encode_times.size() <= thread)
+		encode_times.resize(thread + 1);
+	encode_times[thread].first += duration_ns;
+	encode_times[thread].second++;
+}
+
+void refresh_rate_governor::on_feedback(bool decoded)
+{
+	std::lock_guard lock(mutex);
+	++feedbacks;
+	if (not decoded)
+		++lost_frames;
+}
+
+std::optional<refresh_rate_governor::evaluation> refresh_rate_governor::update(int64_t now_ns)
+{
+	std::lock_guard lock(mutex);
+	if (window_start_ns == 0)
+	{
+		reset_window(now_ns);
+		return std::nullopt;
+	}
+
+	if (now_ns < window_start_ns + window_ns)
+		return std::nullopt;
+
+	if (frames < min_frames)
+	{
+		reset_window(now_ns);
+		return std::nullopt;
+	}
+
+	const float frame_duration_ns = 1'000'000'000 / rates[current];
+
+	evaluation result{
+	        .app_missed = float(missed_frames) / frames,
+	        .encode_load = 0,
+	        .lost = feedbacks ? float(lost_frames) / feedbacks : 0,
+	        .refresh_rate = rates[current],
+	        .changed = false,
+	};
+	for (const auto & [sum, count]: encode_times)
+	{
+		if (count)
+			result.encode_load = std::max(result.encode_load, float(sum) / count / frame_duration_ns);
+	}
+	reset_window(now_ns);
+
+	// Let the application and the headset settle after a change
+	if (windows_since_change++ == 0)
+		return result;
+
+	bool overloaded = result.app_missed > max_app_missed or
+	                  result.encode_load > max_encode_load or
+	                  result.lost > max_lost;
+
+	bool idle = false;
+	if (current + 1 < rates.size())
+	{
+		float ratio = rates[current + 1] / rates[current];
+		idle = result.app_missed < idle_app_missed and
+		       result.encode_load * ratio < idle_encode_load and
+		       result.lost < idle_lost;
+	}
+
+	overloaded_windows = overloaded ? overloaded_windows + 1 : 0;
+	idle_windows = idle ? idle_windows + 1 : 0;
+
+	if (overloaded_windows >= overloaded_windows_to_step_down and current > 0)
+	{
+		// The previous step up did not hold, wait longer before the next one
+		if (last_change_up and windows_since_change <= step_up_windows)
+			step_up_windows = std::min(step_up_windows * 2, max_step_up_windows);
+
+		--current;
+		last_change_up = false;
+	}
+	else if (idle_windows >= step_up_windows)
+	{
+		++current;
+		last_change_up = true;
+	}
+	else
+		return result;
+
+	overloaded_windows = 0;
+	idle_windows = 0;
+	windows_since_change = 0;
+	result.refresh_rate = rates[current];
+	result.changed = true;
+	return result;
+}
+
+float refresh_rate_governor::refresh_rate()
+{
+	std::lock_guard lock(mutex);
+	return rates[current];
+}
+
+void refresh_rate_governor::reset()
+{
+	std::lock_guard lock(mutex);
+	current = initial;
+	window_start_ns = 0;
+	overloaded_windows = 0;
+	idle_windows = 0;
+	windows_since_change = 0;
+	last_change_up = false;
+	step_up_windows = initial_step_up_windows;
+}
+} // namespace wivrn
@@ -0,0 +1,102 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace wivrn
+{
+
+// Steps the headset refresh rate down when the application, the encoders or
+// the network cannot keep up, and back up once there is enough headroom.
+// Samples are accumulated over fixed windows, all times are passed explicitly
+// so that recorded timings can be replayed.
+// The foveation is not stepped here: the encoded size is fixed for the
+// lifetime of the encoders, changing the foveation at runtime does not reduce
+// the rendering or encoding work.
+class refresh_rate_governor
+{
+public:
+	struct evaluation
+	{
+		// Fraction of compositor frames without a new application frame
+		float app_missed;
+		// Encoding time relative to the frame duration, for the slowest encoder thread
+		float encode_load;
+		// Fraction of frames which could not be decoded by the headset
+		float lost;
+		float refresh_rate;
+		bool changed;
+	};
+
+private:
+	std::mutex mutex;
+
+	// Allowed refresh rates, in increasing order
+	std::vector<float> rates;
+	size_t initial;
+	size_t current;
+
+	int64_t window_start_ns = 0;
+	int frames = 0;
+	int missed_frames = 0;
+	// Sum and count of encoding times, for each encoder thread
+	std::vector<std::pair<int64_t, int>> encode_times;
+	int feedbacks = 0;
+	int lost_frames = 0;
+
+	int overloaded_windows = 0;
+	int idle_windows = 0;
+	// Windows since the last change, the first one is discarded
+	int windows_since_change = 0;
+	bool last_change_up = false;
+	// Number of idle windows required to step up, increased when stepping up
+	// causes an overload
+	int step_up_windows;
+
+	void reset_window(int64_t now_ns);
+
+public:
+	// available: refresh rates supported by the headset
+	// max: refresh rate selected by the user, never exceeded
+	// min: lowest refresh rate to use
+	refresh_rate_governor(std::vector<float> available, float max, float min = 0);
+
+	// Whether there is more than one refresh rate to choose from
+	explicit operator bool() const
+	{
+		return rates.size() > 1;
+	}
+
+	void on_app_frame(bool new_frame);
+	void on_encode(size_t thread, int64_t duration_ns);
+	void on_feedback(bool decoded);
+
+	// Evaluates the samples once per window
+	std::optional<evaluation> update(int64_t now_ns);
+
+	float refresh_rate();
+
+	// Goes back to the initial refresh rate
+	void reset();
+};
+} // namespace wivrn
@@ -41,6 +41,6 @@ public:
 	static tracked_views interpolate(const tracked_views & a, const tracked_views & b, float t);
 	static tracked_views extrapolate(const tracked_views & a, const tracked_views & b, int64_t ta, int64_t tb, int64_t t);
 
-	bool update_tracking(const from_headset::tracking & tracking, const clock_offset & offset);
+	bool update_tracking(const demuxed_tracking & tracking, const clock_offset & offset);
 };
 } // namespace wivrn
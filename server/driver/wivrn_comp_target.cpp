@@ -19,15 +19,20 @@
 
 #include "wivrn_comp_target.h"
 
+#include "driver/configuration.h"
 #include "driver/wivrn_session.h"
 #include "encoder/video_encoder.h"
 #include "utils/scoped_lock.h"
+#include "utils/thread_policy.h"
+#include "vk/vk_allocator.h"
 #include "wivrn_foveation.h"
 
 #include "main/comp_compositor.h"
 #include "math/m_space.h"
+#include "os/os_time.h"
 #include "xrt_cast.h"
 
+#include <algorithm>
 #include <vector>
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_core.h>
@@ -105,6 +110,7 @@ static void destroy_images(struct wivrn_comp_target * cn)
 	cn->psc.status.notify_all();
 	cn->encoder_threads.clear();
 	cn->encoders.clear();
+	cn->psc.timestamps.reset();
 
 	cn->psc.images.clear();
 
@@ -114,7 +120,54 @@ static void destroy_images(struct wivrn_comp_target * cn)
 	target_fini_semaphores(cn);
 }
 
-static void comp_wivrn_present_thread(std::stop_token stop_token, wivrn_comp_target * cn, int index, std::vector<std::shared_ptr<VideoEncoder>> encoders);
+static void comp_wivrn_present_thread(std::stop_token stop_token, wivrn_comp_target * cn, int index, int group, std::vector<std::shared_ptr<VideoEncoder>> encoders);
+
+// TCP only: the kernel may hold one frame of video, frames are dropped when the
+// link stays behind for longer than this many frames
+static const int tcp_video_backlog_frames = 4;
+
+// The foveation governor strength first narrows the foveation, which is back to
+// the configured one at this strength, then lowers the bitrate
+static const float link_bitrate_reduction_start = 0.5;
+// Fraction of the configured bitrate kept when the foveation governor is at full strength
+static const float min_link_bitrate_fraction = 0.5;
+
+// Narrowing of the foveation for the current link quality, see wivrn_hmd::set_foveation
+static float link_foveation_narrowing(wivrn_comp_target * cn)
+{
+	return std::min(cn->adaptive_foveation->strength() / link_bitrate_reduction_start, 1.f);
+}
+
+// Fraction of the configured bitrate used for the current link quality
+static float link_bitrate_fraction(wivrn_comp_target * cn)
+{
+	if (not cn->adaptive_foveation)
+		return 1;
+	float strength = cn->adaptive_foveation->strength();
+	float reduction = std::clamp((strength - link_bitrate_reduction_start) / (1 - link_bitrate_reduction_start), 0.f, 1.f);
+	return 1 - (1 - min_link_bitrate_fraction) * reduction;
+}
+
+static void set_video_budget(wivrn_comp_target * cn, float fps)
+{
+	float fraction = link_bitrate_fraction(cn);
+	uint64_t bitrate = 0;
+	for (const auto & settings: cn->settings)
+		bitrate += settings.bitrate * fraction;
+
+	cn->cnx.set_video_budget(uint32_t(bitrate / 8 / fps), std::chrono::nanoseconds(int64_t(tcp_video_backlog_frames * U_TIME_1S_IN_NS / fps)));
+}
+
+// Sends the frame rate and the link dependent bitrate to the encoders and to the TCP budget.
+// The bitrate is kept when the refresh rate changes, each frame gets a larger share at a lower rate.
+// The ffmpeg VAAPI encoder ignores the new rate, see video_encoder_va.
+static void update_encoder_rate_control(wivrn_comp_target * cn, float fps)
+{
+	float fraction = link_bitrate_fraction(cn);
+	for (size_t i = 0; i < cn->encoders.size(); ++i)
+		cn->encoders[i]->set_rate(cn->settings[i].bitrate * fraction, fps);
+	set_video_budget(cn, fps);
+}
 
 static void create_encoders(wivrn_comp_target * cn)
 {
@@ -167,18 +220,53 @@ static void create_encoders(wivrn_comp_target * cn)
 
 		thread_params[settings.group].emplace_back(encoder);
 	}
+	cn->psc.timestamps.emplace(*cn->wivrn_bundle, vk->queue_family_index, 1 + cn->encoders.size());
 
 	for (auto & [group, params]: thread_params)
 	{
-		auto & thread = cn->encoder_threads.emplace_back(
-		        comp_wivrn_present_thread, cn, cn->encoder_threads.size(), std::move(params));
-		std::string name = "encoder " + std::to_string(group);
-		pthread_setname_np(thread.native_handle(), name.c_str());
+		cn->encoder_threads.emplace_back(
+		        comp_wivrn_present_thread, cn, cn->encoder_threads.size(), group, std::move(params));
 	}
 	cn->pacer.set_stream_count(cn->encoders.size());
+	// The governors may have lowered the refresh rate or the bitrate since the stream started
+	if (float fps = cn->governor.refresh_rate(); fps != desc.fps or link_bitrate_fraction(cn) != 1)
+		update_encoder_rate_control(cn, fps);
+	else
+		set_video_budget(cn, fps);
 	cn->cnx.send_control(desc);
 }
 
+// Linear images are slower to render to, only use them when all encoders read from the CPU anyway
+static bool use_host_mapped_images(struct wivrn_comp_target * cn, vk::Format format, vk::ImageUsageFlags flags)
+{
+	for (const auto & settings: cn->settings)
+	{
+		if (not VideoEncoder::supports_mapped_image(settings))
+			return false;
+
+		// The encoder reads its padded size from the image
+		if (settings.offset_x + settings.width + settings.width % 2 > cn->width or
+		    settings.offset_y + settings.height + settings.height % 2 > cn->height)
+			return false;
+	}
+
+	try
+	{
+		cn->wivrn_bundle->physical_device.getImageFormatProperties(
+		        format,
+		        vk::ImageType::e2D,
+		        vk::ImageTiling::eLinear,
+		        flags | vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc,
+		        vk::ImageCreateFlagBits::eExtendedUsage | vk::ImageCreateFlagBits::eMutableFormat);
+		return true;
+	}
+	catch (vk::FormatNotSupportedError &)
+	{
+		U_LOG_I("Linear swapchain images are not supported, encoders will copy them");
+		return false;
+	}
+}
+
 static VkResult create_images(struct wivrn_comp_target * cn, vk::ImageUsageFlags flags)
 {
 	auto vk = get_vk(cn);
@@ -201,7 +289,12 @@ static VkResult create_images(struct wivrn_comp_target * cn, vk::ImageUsageFlags
 	};
 #endif
 
+	cn->psc.host_mapped = use_host_mapped_images(cn, format, flags);
+	if (cn->psc.host_mapped)
+		U_LOG_I("Encoders read the swapchain images directly");
+
 	cn->psc.images.resize(cn->image_count);
+	cn->psc.readers = std::vector<std::atomic<int>>(cn->image_count);
 	std::vector<vk::Image> rgb;
 	for (uint32_t i = 0; i < cn->image_count; i++)
 	{
@@ -235,7 +328,7 @@ static VkResult create_images(struct wivrn_comp_target * cn, vk::ImageUsageFlags
 		                        .mipLevels = 1,
 		                        .arrayLayers = 1,
 		                        .samples = vk::SampleCountFlagBits::e1,
-		                        .tiling = vk::ImageTiling::eOptimal,
+		                        .tiling = cn->psc.host_mapped ? vk::ImageTiling::eLinear : vk::ImageTiling::eOptimal,
 		                        .usage = flags
 #if WIVRN_USE_VULKAN_ENCODE
 		                                 | encoder_flags
@@ -244,10 +337,23 @@ static VkResult create_images(struct wivrn_comp_target * cn, vk::ImageUsageFlags
 		                        .sharingMode = vk::SharingMode::eExclusive,
 		                },
 		        {
+		                .flags = cn->psc.host_mapped ? VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT : VmaAllocationCreateFlags{},
 		                .usage = VMA_MEMORY_USAGE_AUTO,
 		        });
 		cn->images[i].handle = image;
 		rgb.push_back(image);
+
+		if (cn->psc.host_mapped)
+		{
+			auto luma = image->getSubresourceLayout({.aspectMask = vk::ImageAspectFlagBits::ePlane0});
+			auto chroma = image->getSubresourceLayout({.aspectMask = vk::ImageAspectFlagBits::ePlane1});
+			cn->psc.images[i].mapped = {
+			        .luma = image.data() + luma.offset,
+			        .chroma = image.data() + chroma.offset,
+			        .luma_stride = luma.rowPitch,
+			        .chroma_stride = chroma.rowPitch,
+			};
+		}
 	}
 
 	for (uint32_t i = 0; i < cn->image_count; i++)
@@ -336,7 +442,9 @@ static bool comp_wivrn_init_post_vulkan(struct comp_target * ct, uint32_t prefer
 		return false;
 	}
 
-	if (cn->cnx.has_dynamic_foveation())
+	// Without foveation, adaptive foveation keeps the identity distortion,
+	// the foveation renderer only renders it once
+	if (cn->cnx.has_dynamic_foveation() or cn->adaptive_foveation)
 	{
 		cn->foveation_renderer = std::make_unique<wivrn_foveation_renderer>(*cn->wivrn_bundle, cn->command_pool);
 	}
@@ -460,9 +568,10 @@ static VkResult comp_wivrn_acquire(struct comp_target * ct, uint32_t * out_index
 	};
 }
 
-static void comp_wivrn_present_thread(std::stop_token stop_token, wivrn_comp_target * cn, int index, std::vector<std::shared_ptr<VideoEncoder>> encoders)
+static void comp_wivrn_present_thread(std::stop_token stop_token, wivrn_comp_target * cn, int index, int group, std::vector<std::shared_ptr<VideoEncoder>> encoders)
 {
 	auto & vk = *cn->wivrn_bundle;
+	set_thread_policy("encoder " + std::to_string(group));
 	U_LOG_I("Starting encoder thread %d", index);
 
 	const uint8_t status_bit = 1 << (index + 1);
@@ -485,16 +594,31 @@ static void comp_wivrn_present_thread(std::stop_token stop_token, wivrn_comp_tar
 		// Get local copies before releasing the image
 		auto view_info = cn->psc.view_info;
 		auto frame_index = cn->psc.frame_index;
+		auto image_index = cn->psc.image_index;
 
 		auto res = vk.device.waitForFences(*cn->psc.fence, true, UINT64_MAX);
 
-		// Update encoder status, release image
+		// The command buffer is not reused until all threads are done, report for all of them
+		if (index == 0)
+		{
+			if (auto timestamps = cn->psc.timestamps->read(); not timestamps.empty())
+			{
+				cn->cnx.dump_time("gpu_copy_begin", frame_index, timestamps[0]);
+				for (size_t i = 1; i < timestamps.size(); ++i)
+					cn->cnx.dump_time("gpu_copy_end", frame_index, timestamps[i], i - 1);
+			}
+		}
+
+		if (cn->psc.host_mapped)
+			vmaInvalidateAllocation(vk_allocator::instance(), cn->psc.images[image_index].image, 0, VK_WHOLE_SIZE);
+
+		// Update encoder status, release image if it was copied
 		if ((cn->psc.status &= ~status_bit) == 0)
 		{
 			cn->psc.status.notify_all();
 			for (auto & img: cn->psc.images)
 			{
-				if (img.status == pseudo_swapchain::status_t::encoding)
+				if (not cn->psc.host_mapped and img.status == pseudo_swapchain::status_t::encoding)
 				{
 					img.status = pseudo_swapchain::status_t::free;
 					break;
@@ -502,6 +626,7 @@ static void comp_wivrn_present_thread(std::stop_token stop_token, wivrn_comp_tar
 			}
 		}
 
+		auto encode_begin = os_monotonic_get_ns();
 		try
 		{
 			for (auto & encoder: encoders)
@@ -517,9 +642,69 @@ static void comp_wivrn_present_thread(std::stop_token stop_token, wivrn_comp_tar
 		{
 			// Ignore errors
 		}
+		cn->governor.on_encode(index, os_monotonic_get_ns() - encode_begin);
+
+		// The image was read during encoding, release it once all threads are done
+		if (cn->psc.host_mapped and --cn->psc.readers[image_index] == 0)
+			cn->psc.images[image_index].status = pseudo_swapchain::status_t::free;
 	}
 }
 
+static void update_refresh_rate(struct wivrn_comp_target * cn, int64_t frame_id)
+{
+	// The application did not render a new frame in time if the compositor reuses the previous one
+	int64_t app_frame_ns = cn->c->base.layer_accum.layers[0].data.timestamp;
+	cn->governor.on_app_frame(app_frame_ns != cn->last_app_frame_ns);
+	cn->last_app_frame_ns = app_frame_ns;
+
+	auto now = os_monotonic_get_ns();
+	auto eval = cn->governor.update(now);
+	if (not eval)
+		return;
+
+	std::string extra = "," + std::to_string(eval->app_missed) +
+	                    "," + std::to_string(eval->encode_load) +
+	                    "," + std::to_string(eval->lost) +
+	                    "," + std::to_string(eval->refresh_rate);
+	cn->cnx.dump_time("refresh_rate", frame_id, now, -1, extra.c_str());
+
+	if (not eval->changed)
+		return;
+
+	U_LOG_I("Changing refresh rate to %.2f (missed application frames %.2f, encoder load %.2f, lost frames %.2f)",
+	        eval->refresh_rate,
+	        eval->app_missed,
+	        eval->encode_load,
+	        eval->lost);
+	cn->pacer.set_frame_duration(U_TIME_1S_IN_NS / eval->refresh_rate);
+	update_encoder_rate_control(cn, eval->refresh_rate);
+	cn->cnx.send_control(to_headset::refresh_rate_change{.fps = eval->refresh_rate});
+}
+
+static void update_foveation_strength(struct wivrn_comp_target * cn, int64_t frame_id)
+{
+	auto now = os_monotonic_get_ns();
+	auto eval = cn->adaptive_foveation->update(now);
+	if (not eval)
+		return;
+
+	std::string extra = "," + std::to_string(eval->lost) +
+	                    "," + std::to_string(eval->queueing_delay_ns) +
+	                    "," + std::to_string(eval->strength);
+	cn->cnx.dump_time("foveation", frame_id, now, -1, extra.c_str());
+
+	if (not eval->changed)
+		return;
+
+	U_LOG_D("Foveation strength %.2f (lost frames %.3f, queueing delay %.1fms)",
+	        eval->strength,
+	        eval->lost,
+	        eval->queueing_delay_ns / 1e6);
+	// Foveation is applied when the next frame is flushed, the bitrate only
+	// changes at high strengths
+	update_encoder_rate_control(cn, cn->governor.refresh_rate());
+}
+
 static VkResult comp_wivrn_present(struct comp_target * ct,
                                    VkQueue queue_,
                                    uint32_t index,
@@ -536,7 +721,10 @@ static VkResult comp_wivrn_present(struct comp_target * ct,
 	auto res = cn->wivrn_bundle->device.waitForFences(*cn->psc.fence, true, UINT64_MAX);
 
 	vk::Semaphore wait_semaphore = cn->semaphores.render_complete;
-	vk::PipelineStageFlags wait_stage = vk::PipelineStageFlagBits::eTransfer;
+	// Mapped images are not copied, the host barrier waits for the compositor writes
+	vk::PipelineStageFlags wait_stage = cn->psc.host_mapped
+	                                            ? vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eComputeShader
+	                                            : vk::PipelineStageFlagBits::eTransfer;
 	vk::SubmitInfo submit_info{
 	        .waitSemaphoreCount = 1,
 	        .pWaitSemaphores = &wait_semaphore,
@@ -604,13 +792,75 @@ static VkResult comp_wivrn_present(struct comp_target * ct,
 	cn->wivrn_bundle->device.resetFences(*cn->psc.fence);
 	psc_image.status = pseudo_swapchain::status_t::encoding;
 	auto info = cn->pacer.present_to_info(desired_present_time_ns);
+	if (cn->governor)
+		update_refresh_rate(cn, info.frame_id);
+	if (cn->adaptive_foveation)
+		update_foveation_strength(cn, info.frame_id);
 
-	for (auto & encoder: cn->encoders)
+	if (cn->psc.host_mapped)
 	{
+		// Make the image readable from the host once the fence is signaled, the compositor
+		// wrote it either as a color attachment or as a storage image
+		const vk::ImageSubresourceRange range{
+		        .aspectMask = vk::ImageAspectFlagBits::eColor,
+		        .levelCount = 1,
+		        .layerCount = 1,
+		};
+		if (vk->features.synchronization_2)
+		{
+			vk::ImageMemoryBarrier2 host_barrier{
+			        .srcStageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput | vk::PipelineStageFlagBits2::eComputeShader,
+			        .srcAccessMask = vk::AccessFlagBits2::eColorAttachmentWrite | vk::AccessFlagBits2::eShaderStorageWrite,
+			        .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+			        .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+			        .oldLayout = vk::ImageLayout::eTransferSrcOptimal,
+			        .newLayout = vk::ImageLayout::eGeneral,
+			        .image = psc_image.image,
+			        .subresourceRange = range,
+			};
+			command_buffer.pipelineBarrier2({
+			        .imageMemoryBarrierCount = 1,
+			        .pImageMemoryBarriers = &host_barrier,
+			});
+		}
+		else
+		{
+			vk::ImageMemoryBarrier host_barrier{
+			        .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eShaderWrite,
+			        .dstAccessMask = vk::AccessFlagBits::eHostRead,
+			        .oldLayout = vk::ImageLayout::eTransferSrcOptimal,
+			        .newLayout = vk::ImageLayout::eGeneral,
+			        .image = psc_image.image,
+			        .subresourceRange = range,
+			};
+			command_buffer.pipelineBarrier(
+			        vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eComputeShader,
+			        vk::PipelineStageFlagBits::eHost,
+			        {},
+			        nullptr,
+			        nullptr,
+			        host_barrier);
+		}
+
+		// Nothing is copied, no gpu_copy timestamps are recorded
+		cn->psc.readers[index] = cn->encoder_threads.size();
+		for (auto & encoder: cn->encoders)
+			encoder->present_image(psc_image.mapped);
+	}
+	else
+	{
+		cn->psc.timestamps->reset(command_buffer);
+		cn->psc.timestamps->write(command_buffer, vk::PipelineStageFlagBits2::eAllCommands, 0);
+
+		for (size_t i = 0; i < cn->encoders.size(); ++i)
+		{
+			auto & encoder = cn->encoders[i];
 #if WIVRN_USE_VULKAN_ENCODE
-		encoder->present_image(psc_image.image, video_command_buffer, *cn->psc.images[index].video_fence, info.frame_id);
+			encoder->present_image(psc_image.image, video_command_buffer, *cn->psc.images[index].video_fence, info.frame_id);
 #endif
-		encoder->present_image(psc_image.image, command_buffer);
+			encoder->present_image(psc_image.image, command_buffer);
+			cn->psc.timestamps->write(command_buffer, vk::PipelineStageFlagBits2::eAllCommands, 1 + i);
+		}
 	}
 
 #if WIVRN_USE_VULKAN_ENCODE
@@ -680,6 +930,7 @@ static VkResult comp_wivrn_present(struct comp_target * ct,
 	// set bits to 1 for index 1..num encoder threads + 1
 	cn->psc.status = (1 << (cn->encoder_threads.size() + 1)) - 2;
 	cn->psc.frame_index = info.frame_id;
+	cn->psc.image_index = index;
 	cn->psc.status.notify_all();
 
 	return VK_SUCCESS;
@@ -694,8 +945,12 @@ static void comp_wivrn_flush(struct comp_target * ct)
 		r->StartFrameCapture(NULL, NULL);
 #endif
 
-	// apply foveation for current frame
-	if (cn->cnx.apply_dynamic_foveation())
+	// apply foveation for current frame, where the eye will be looking when it is displayed
+	auto frame = cn->pacer.get_frame(cn->current_frame_id);
+	std::optional<float> narrowing;
+	if (cn->adaptive_foveation and cn->foveation_renderer)
+		narrowing = link_foveation_narrowing(cn);
+	if (cn->cnx.apply_dynamic_foveation(frame ? frame->predicted_display_time : os_monotonic_get_ns(), narrowing))
 		// foveation renderer already signaled the semaphore; nothing to do
 		return;
 
@@ -729,6 +984,8 @@ static void comp_wivrn_calc_frame_pacing(struct comp_target * ct,
 	        *out_desired_present_time_ns,
 	        *out_present_slop_ns,
 	        *out_predicted_display_time_ns);
+
+	cn->cnx.composite_tracking_snapshot(*out_predicted_display_time_ns);
 }
 
 static void comp_wivrn_mark_timing_point(struct comp_target * ct,
@@ -746,6 +1003,7 @@ static void comp_wivrn_mark_timing_point(struct comp_target * ct,
 			cn->cnx.dump_time("wake_up", frame_id, when_ns);
 			break;
 		case COMP_TARGET_TIMING_POINT_BEGIN:
+			cn->current_frame_id = frame_id;
 			cn->cnx.dump_time("begin", frame_id, when_ns);
 			break;
 		case COMP_TARGET_TIMING_POINT_SUBMIT_BEGIN:
@@ -779,9 +1037,15 @@ static void comp_wivrn_destroy(struct comp_target * ct)
 	delete (struct wivrn_comp_target *)ct;
 }
 
+// Timestamps of the compositor render pass, which includes distortion and conversion to YCbCr
 static void comp_wivrn_info_gpu(struct comp_target * ct, int64_t frame_id, int64_t gpu_start_ns, int64_t gpu_end_ns, int64_t when_ns)
 {
 	COMP_TRACE_MARKER();
+	struct wivrn_comp_target * cn = (struct wivrn_comp_target *)ct;
+
+	cn->pacer.on_gpu_timing(frame_id, gpu_end_ns);
+	cn->cnx.dump_time("gpu_render_begin", frame_id, gpu_start_ns);
+	cn->cnx.dump_time("gpu_render_end", frame_id, gpu_end_ns);
 }
 
 void wivrn_comp_target::on_feedback(const from_headset::feedback & feedback, const clock_offset & o)
@@ -789,6 +1053,14 @@ void wivrn_comp_target::on_feedback(const from_headset::feedback & feedback, con
 	if (not o)
 		return;
 	pacer.on_feedback(feedback, o);
+	governor.on_feedback(feedback.sent_to_decoder != 0);
+	if (adaptive_foveation)
+	{
+		adaptive_foveation->on_feedback(feedback.sent_to_decoder != 0);
+		auto frame = pacer.get_frame(feedback.frame_index);
+		if (frame and feedback.received_last_packet and feedback.times_displayed <= 1)
+			adaptive_foveation->on_delay(o.from_headset(feedback.received_last_packet) - frame->present_ns);
+	}
 	if (psc.status & 1)
 		return;
 	if (feedback.stream_index < encoders.size())
@@ -798,9 +1070,21 @@ void wivrn_comp_target::on_feedback(const from_headset::feedback & feedback, con
 void wivrn_comp_target::reset_encoders()
 {
 	pacer.reset();
+	if (adaptive_foveation)
+		adaptive_foveation->reset();
 	for (auto & encoder: encoders)
 		encoder->reset();
 	cnx.send_control(desc);
+
+	// The headset may keep its refresh rate if the description did not change
+	if (governor and governor.refresh_rate() != fps)
+	{
+		governor.reset();
+		pacer.set_frame_duration(U_TIME_1S_IN_NS / fps);
+		cnx.send_control(to_headset::refresh_rate_change{.fps = fps});
+	}
+	if (governor or adaptive_foveation)
+		update_encoder_rate_control(this, fps);
 }
 
 void wivrn_comp_target::render_dynamic_foveation(std::array<to_headset::foveation_parameter, 2> foveation)
@@ -810,13 +1094,24 @@ void wivrn_comp_target::render_dynamic_foveation(std::array<to_headset::foveatio
 	vk::Semaphore sem(semaphores.present_complete);
 
 	vk::SubmitInfo submit_info{
-	        .commandBufferCount = 1,
-	        .pCommandBuffers = &*foveation_renderer->cmd_buf,
 	        .signalSemaphoreCount = 1,
 	        .pSignalSemaphores = &sem,
 	};
 
-	foveation_renderer->render_distortion_images(foveation, c->nr.distortion.images, c->nr.distortion.image_views);
+	// The previous frame is complete, its command buffer can be recorded again
+	if (auto timestamps = foveation_renderer->timestamps.read(); not timestamps.empty())
+	{
+		cnx.dump_time("gpu_foveation_begin", foveation_renderer->frame_id, timestamps[0]);
+		cnx.dump_time("gpu_foveation_end", foveation_renderer->frame_id, timestamps[1]);
+	}
+
+	// When the distortion images are up to date, only signal the semaphore
+	if (foveation_renderer->render_distortion_images(foveation, c->nr.distortion.images, c->nr.distortion.image_views))
+	{
+		foveation_renderer->frame_id = current_frame_id;
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &*foveation_renderer->cmd_buf;
+	}
 
 	{
 		scoped_lock lock(c->base.vk.queue_mutex);
@@ -824,9 +1119,17 @@ void wivrn_comp_target::render_dynamic_foveation(std::array<to_headset::foveatio
 	}
 }
 
-wivrn_comp_target::wivrn_comp_target(wivrn::wivrn_session & cnx, struct comp_compositor * c, float fps) :
+static refresh_rate_governor make_governor(wivrn_session & cnx, float fps, const configuration & config)
+{
+	if (not config.adaptive_refresh_rate)
+		return refresh_rate_governor({}, fps);
+	return refresh_rate_governor(cnx.get_info().available_refresh_rates, fps, config.min_refresh_rate.value_or(0));
+}
+
+wivrn_comp_target::wivrn_comp_target(wivrn::wivrn_session & cnx, struct comp_compositor * c, float fps, const configuration & config) :
         comp_target{},
         pacer(U_TIME_1S_IN_NS / fps),
+        governor(make_governor(cnx, fps, config)),
         cnx(cnx)
 {
 	check_ready = comp_wivrn_check_ready;
@@ -846,5 +1149,8 @@ wivrn_comp_target::wivrn_comp_target(wivrn::wivrn_session & cnx, struct comp_com
 	this->fps = fps;
 	desc.fps = fps;
 	this->c = c;
+
+	if (config.adaptive_foveation)
+		adaptive_foveation.emplace();
 }
 } // namespace wivrn
@@ -21,12 +21,18 @@
 
 #include "main/comp_target.h"
 
+#include "driver/configuration.h"
 #include "encoder/encoder_settings.h"
+#include "encoder/video_encoder.h"
+#include "utils/gpu_timestamps.h"
 #include "utils/wivrn_vk_bundle.h"
 #include "vk/allocation.h"
+#include "foveation_governor.h"
+#include "refresh_rate_governor.h"
 #include "wivrn_pacer.h"
 #include "wivrn_packets.h"
 
+#include <atomic>
 #include <list>
 #include <memory>
 #include <optional>
@@ -39,7 +45,6 @@ namespace wivrn
 
 class wivrn_foveation_renderer;
 class wivrn_session;
-class VideoEncoder;
 
 struct pseudo_swapchain
 {
@@ -62,11 +67,17 @@ struct pseudo_swapchain
 		status_t status;
 		vk::raii::CommandBuffer video_command_buffer = nullptr;
 		vk::raii::Fence video_fence = nullptr;
+		VideoEncoder::mapped_image mapped{};
 	};
 	vk::raii::Semaphore video_sem = nullptr;
 	vk::raii::CommandPool video_command_pool = nullptr;
 	std::vector<item> images;
 
+	// Images are linear and host visible, encoders read them directly instead of copying them
+	bool host_mapped = false;
+	// Number of encoder threads still reading each image when host_mapped
+	std::vector<std::atomic<int>> readers;
+
 	// bitmask of encoder status, first bit to request exit, then one bit per thread:
 	// 0 when encoder is done
 	// 1 when busy/image to be encoded
@@ -75,14 +86,22 @@ struct pseudo_swapchain
 	// Data to be encoded
 	vk::raii::Fence fence = nullptr;
 	vk::raii::CommandBuffer command_buffer = nullptr;
+	// Start of command_buffer, then end of the copy for each encoder
+	std::optional<gpu_timestamps> timestamps;
 
 	int64_t frame_index;
+	uint32_t image_index;
 	to_headset::video_stream_data_shard::view_info_t view_info{};
 };
 
 struct wivrn_comp_target : public comp_target
 {
 	wivrn_pacer pacer;
+	refresh_rate_governor governor;
+	// Display time of the last application frame, to detect repeated frames
+	int64_t last_app_frame_ns = 0;
+	// Empty when the foveation does not adapt to the link quality
+	std::optional<foveation_governor> adaptive_foveation;
 
 	std::optional<wivrn_vk_bundle> wivrn_bundle;
 	vk::raii::CommandPool command_pool = nullptr;
@@ -106,7 +125,7 @@ struct wivrn_comp_target : public comp_target
 	wivrn::wivrn_session & cnx;
 	std::unique_ptr<wivrn_foveation_renderer> foveation_renderer = nullptr;
 
-	wivrn_comp_target(wivrn::wivrn_session & cnx, struct comp_compositor * c, float fps);
+	wivrn_comp_target(wivrn::wivrn_session & cnx, struct comp_compositor * c, float fps, const configuration & config);
 	~wivrn_comp_target();
 
 	void on_feedback(const from_headset::feedback &, const clock_offset &);
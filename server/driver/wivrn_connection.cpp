@@ -19,10 +19,13 @@
 
 #include "wivrn_connection.h"
 #include "configuration.h"
+#include "os/os_time.h"
 #include "util/u_logging.h"
 #include "wivrn_ipc.h"
 #include <arpa/inet.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <random>
 
 using namespace std::chrono_literals;
 
@@ -31,8 +34,52 @@ static void handle_event_from_main_loop(to_monado::disconnect)
 	// Ignore disconnect request when no headset is connected
 }
 
+namespace
+{
+struct packet_classifier
+{
+	wivrn::packet_class operator()(const wivrn::from_headset::tracking &)
+	{
+		return wivrn::packet_class::tracking;
+	}
+	wivrn::packet_class operator()(const wivrn::from_headset::trackings &)
+	{
+		return wivrn::packet_class::tracking;
+	}
+	wivrn::packet_class operator()(const wivrn::from_headset::hand_tracking &)
+	{
+		return wivrn::packet_class::tracking;
+	}
+	wivrn::packet_class operator()(const wivrn::from_headset::timesync_response &)
+	{
+		return wivrn::packet_class::timesync;
+	}
+	wivrn::packet_class operator()(const wivrn::from_headset::feedback &)
+	{
+		return wivrn::packet_class::feedback;
+	}
+	template <typename T>
+	wivrn::packet_class operator()(const T &)
+	{
+		return wivrn::packet_class::bulk;
+	}
+};
+} // namespace
+
+wivrn::packet_class wivrn::classify(const from_headset::packets & packet)
+{
+	return std::visit(packet_classifier{}, packet);
+}
+
+static uint64_t make_session_token()
+{
+	std::random_device rd;
+	std::uniform_int_distribution<uint64_t> dist(1);
+	return dist(rd);
+}
+
 wivrn::wivrn_connection::wivrn_connection(TCP && tcp) :
-        control(std::move(tcp)), stream(-1)
+        control(std::move(tcp)), stream(-1), session_token(make_session_token())
 {
 	init();
 }
@@ -60,7 +107,8 @@ void wivrn::wivrn_connection::init()
 	// Wait for client to send handshake
 	auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
 
-	if (configuration::read_user_configuration().tcp_only)
+	auto config = configuration::read_user_configuration();
+	if (config.tcp_only)
 	{
 		port = -1;
 	}
@@ -70,7 +118,7 @@ void wivrn::wivrn_connection::init()
 		stream.bind(port);
 	}
 
-	control.send(to_headset::handshake{.stream_port = port});
+	control.send(to_headset::handshake{.stream_port = port, .session_token = session_token, .dscp = config.dscp});
 
 	while (true)
 	{
@@ -139,11 +187,96 @@ void wivrn::wivrn_connection::init()
 			throw std::runtime_error("No handshake received from client");
 		}
 	}
-	control.send(to_headset::handshake{.stream_port = port});
+
+	if (config.dscp)
+	{
+		try
+		{
+			// Audio goes on the control socket, unless everything does
+			if (stream)
+			{
+				stream.set_dscp(*config.dscp);
+				control.set_dscp((*config.dscp)[size_t(traffic_class::audio)]);
+			}
+			else
+				control.set_dscp((*config.dscp)[size_t(traffic_class::video)]);
+		}
+		catch (std::exception & e)
+		{
+			U_LOG_W("Failed to set DSCP: %s", e.what());
+		}
+	}
+	control.send(to_headset::handshake{.stream_port = port, .session_token = session_token, .dscp = config.dscp});
+
+	video_backlog_since = 0;
+	if (not stream and video_budget_bytes)
+		control.set_notsent_lowat(video_budget_bytes);
+
+	epoll = fd_base(epoll_create1(EPOLL_CLOEXEC));
+	if (not epoll)
+		throw std::system_error(errno, std::system_category(), "epoll_create1");
+
+	auto add = [&](int fd, socket_source source) {
+		epoll_event event{
+		        .events = EPOLLIN,
+		        .data = {.u32 = uint32_t(source)},
+		};
+		if (epoll_ctl(epoll.get_fd(), EPOLL_CTL_ADD, fd, &event) < 0)
+			throw std::system_error(errno, std::system_category(), "epoll_ctl");
+	};
+	if (stream)
+		add(stream.get_fd(), socket_source::stream);
+	add(control.get_fd(), socket_source::control);
+	add(wivrn_ipc_socket_monado->get_fd(), socket_source::ipc);
+
+	for (auto & i: batch)
+		i.clear();
 
 	active = true;
 }
 
+void wivrn::wivrn_connection::set_video_budget(uint32_t bytes, std::chrono::nanoseconds duration)
+{
+	video_budget_bytes = bytes;
+	video_budget_ns = duration.count();
+	if (active and not stream)
+	{
+		try
+		{
+			control.set_notsent_lowat(bytes);
+		}
+		catch (std::exception & e)
+		{
+			U_LOG_W("Failed to set TCP_NOTSENT_LOWAT: %s", e.what());
+		}
+	}
+}
+
+bool wivrn::wivrn_connection::video_backlogged()
+{
+	if (stream or not video_budget_bytes or not active)
+		return false;
+
+	try
+	{
+		if (control.writable())
+		{
+			video_backlog_since = 0;
+			return false;
+		}
+	}
+	catch (std::exception &)
+	{
+		return false;
+	}
+
+	int64_t now = os_monotonic_get_ns();
+	int64_t since = 0;
+	if (video_backlog_since.compare_exchange_strong(since, now))
+		since = now;
+	return now - since > video_budget_ns;
+}
+
 void wivrn::wivrn_connection::reset(TCP && tcp)
 {
 	control = std::move(tcp);
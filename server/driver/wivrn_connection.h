@@ -23,23 +23,110 @@
 #include "wivrn_packets.h"
 #include "wivrn_sockets.h"
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <optional>
-#include <poll.h>
 #include <stdexcept>
+#include <sys/epoll.h>
 #include <system_error>
+#include <vector>
 
 namespace wivrn
 {
 
+// Incoming packets are dispatched by class, in this order
+enum class packet_class
+{
+	tracking,
+	timesync,
+	feedback,
+	bulk,
+
+	count
+};
+
+packet_class classify(const from_headset::packets &);
+
+struct dispatch_stats
+{
+	size_t count;
+	// Longest time between reception and dispatch
+	std::chrono::nanoseconds max_latency;
+};
+
 class wivrn_connection
 {
 	typed_socket<TCP, from_headset::packets, to_headset::packets> control;
 	typed_socket<UDP, from_headset::packets, to_headset::packets> stream;
 	std::atomic<bool> active = false;
 
+	// Random identifier kept across reconnections, lets the headset resume the stream
+	const uint64_t session_token;
+
+	enum class socket_source : uint32_t
+	{
+		stream,
+		control,
+		ipc,
+	};
+	fd_base epoll;
+
+	struct received_packet
+	{
+		from_headset::packets packet;
+		std::chrono::steady_clock::time_point received;
+	};
+	std::array<std::vector<received_packet>, size_t(packet_class::count)> batch;
+	std::array<dispatch_stats, size_t(packet_class::count)> stats;
+
+	// Packets from the main process not dispatched yet, kept across calls to poll
+	// so that they are not lost when a visitor throws
+	std::vector<to_monado::packets> from_main;
+
+	// TCP only: unsent video allowed in the kernel, and how long the socket
+	// may stay above it before frames are dropped
+	std::atomic<uint32_t> video_budget_bytes = 0;
+	std::atomic<int64_t> video_budget_ns = 0;
+	// When the socket went above the budget, 0 if it is below
+	std::atomic<int64_t> video_backlog_since = 0;
+
 	void init();
 
+	// Reads everything available on the socket, up to a limit so that
+	// a flood on one socket does not starve the others
+	template <typename Socket>
+	void drain(Socket & socket)
+	{
+		const int max_reads = 64;
+		for (int i = 0; i < max_reads; i++)
+		{
+			while (auto packet = socket.receive_pending())
+				add_to_batch(std::move(*packet));
+
+			try
+			{
+				if (auto packet = socket.receive())
+					add_to_batch(std::move(*packet));
+			}
+			catch (std::system_error & e)
+			{
+				if (e.code().value() == EAGAIN or e.code().value() == EWOULDBLOCK)
+					break;
+				throw;
+			}
+		}
+		while (auto packet = socket.receive_pending())
+			add_to_batch(std::move(*packet));
+	}
+
+	void add_to_batch(from_headset::packets && packet)
+	{
+		auto & b = batch[size_t(classify(packet))];
+		b.emplace_back(std::move(packet), std::chrono::steady_clock::now());
+	}
+
 public:
 	wivrn_connection(TCP && tcp);
 	wivrn_connection(const wivrn_connection &) = delete;
@@ -51,6 +138,24 @@ public:
 	}
 	void reset(TCP && tcp);
 
+	uint64_t get_session_token() const
+	{
+		return session_token;
+	}
+
+	// Video goes through the control socket
+	bool tcp_only() const
+	{
+		return not stream;
+	}
+
+	// TCP only: bytes is about one frame of video, duration is how long the
+	// send buffer may hold more than that
+	void set_video_budget(uint32_t bytes, std::chrono::nanoseconds duration);
+	// TCP only: whether the next video frame would wait behind a backlog
+	// older than the budget
+	bool video_backlogged();
+
 	template <typename T>
 	void send_control(T && packet)
 	{
@@ -84,56 +189,93 @@ public:
 
 	std::optional<from_headset::packets> poll_control(int timeout);
 
+	// Waits for incoming packets, drains all sockets then dispatches the packets
+	// class by class, in the order of packet_class
 	template <typename T>
 	int poll(T && visitor, int timeout)
 	{
-		pollfd fds[3] = {};
-		fds[0].events = POLLIN;
-		fds[0].fd = stream.get_fd();
-		fds[1].events = POLLIN;
-		fds[1].fd = control.get_fd();
-		fds[2].fd = wivrn_ipc_socket_monado->get_fd();
-		fds[2].events = POLLIN;
-
-		while (auto packet = stream.receive_pending())
-			std::visit(std::forward<T>(visitor), std::move(*packet));
-		while (auto packet = control.receive_pending())
-			std::visit(std::forward<T>(visitor), std::move(*packet));
-
-		int r = ::poll(fds, std::size(fds), timeout);
+		epoll_event events[3];
+		int r = epoll_wait(epoll.get_fd(), events, std::size(events), timeout);
 		if (r < 0)
+		{
+			if (errno == EINTR)
+				return 0;
 			throw std::system_error(errno, std::system_category());
+		}
 
-		if (fds[0].revents & (POLLHUP | POLLERR))
-			throw std::runtime_error("Error on stream socket");
-
-		if (fds[1].revents & (POLLHUP | POLLERR))
-			throw std::runtime_error("Error on control socket");
+		for (int i = 0; i < r; i++)
+		{
+			auto source = socket_source(events[i].data.u32);
+			if (events[i].events & (EPOLLHUP | EPOLLERR))
+			{
+				switch (source)
+				{
+					case socket_source::stream:
+						throw std::runtime_error("Error on stream socket");
+					case socket_source::control:
+						throw std::runtime_error("Error on control socket");
+					case socket_source::ipc:
+						throw std::runtime_error("Error on IPC socket");
+				}
+			}
 
-		if (fds[2].revents & (POLLHUP | POLLERR))
-			throw std::runtime_error("Error on IPC socket");
+			switch (source)
+			{
+				case socket_source::stream:
+					drain(stream);
+					break;
+				case socket_source::control:
+					drain(control);
+					break;
+				case socket_source::ipc:
+					if (auto packet = receive_from_main())
+						from_main.push_back(std::move(*packet));
+					break;
+			}
+		}
 
-		if (fds[0].revents & POLLIN)
+		try
 		{
-			auto packet = stream.receive();
-			if (packet)
-				std::visit(std::forward<T>(visitor), std::move(*packet));
+			for (size_t i = 0; i < batch.size(); i++)
+			{
+				stats[i] = {};
+				for (auto & [packet, received]: batch[i])
+				{
+					stats[i].count++;
+					stats[i].max_latency = std::max<std::chrono::nanoseconds>(stats[i].max_latency, std::chrono::steady_clock::now() - received);
+					std::visit(std::forward<T>(visitor), std::move(packet));
+				}
+				batch[i].clear();
+			}
 		}
-
-		if (fds[1].revents & POLLIN)
+		catch (...)
 		{
-			auto packet = control.receive();
-			if (packet)
-				std::visit(std::forward<T>(visitor), std::move(*packet));
+			for (auto & i: batch)
+				i.clear();
+			throw;
 		}
 
-		if (fds[2].revents & POLLIN)
+		// The packet whose visitor throws is dropped, the following ones are dispatched on the next call
+		size_t dispatched = 0;
+		try
+		{
+			while (dispatched < from_main.size())
+				std::visit(std::forward<T>(visitor), std::move(from_main[dispatched++]));
+		}
+		catch (...)
 		{
-			auto packet = receive_from_main();
-			if (packet)
-				std::visit(std::forward<T>(visitor), std::move(*packet));
+			from_main.erase(from_main.begin(), from_main.begin() + dispatched);
+			throw;
 		}
+		from_main.clear();
+
 		return r;
 	}
+
+	// Packets dispatched by the last call to poll
+	const std::array<dispatch_stats, size_t(packet_class::count)> & last_dispatch() const
+	{
+		return stats;
+	}
 };
 } // namespace wivrn
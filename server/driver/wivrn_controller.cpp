@@ -262,6 +262,7 @@ void wivrn_controller::update_inputs()
 void wivrn_controller::set_inputs(const from_headset::inputs & inputs, const clock_offset & clock_offset)
 {
 	std::lock_guard lock{mutex};
+	// Inputs that are not in the packet did not change, keep their staged value
 	for (const auto & input: inputs.values)
 	{
 		set_inputs(input.id, input.value, input.last_change_time ? clock_offset.from_headset(input.last_change_time) : 0);
@@ -318,18 +319,19 @@ xrt_space_relation wivrn_controller::get_tracked_pose(xrt_input_name name, int64
 {
 	std::chrono::nanoseconds extrapolation_time;
 	xrt_space_relation res;
+	uint64_t epoch = cnx->tracking_snapshot(at_timestamp_ns);
 	switch (name)
 	{
 		case XRT_INPUT_TOUCH_AIM_POSE:
-			std::tie(extrapolation_time, res) = aim.get_at(at_timestamp_ns);
+			std::tie(extrapolation_time, res) = aim.get_at(at_timestamp_ns, epoch);
 			cnx->set_enabled(aim.device, true);
 			break;
 		case XRT_INPUT_TOUCH_GRIP_POSE:
-			std::tie(extrapolation_time, res) = grip.get_at(at_timestamp_ns);
+			std::tie(extrapolation_time, res) = grip.get_at(at_timestamp_ns, epoch);
 			cnx->set_enabled(grip.device, true);
 			break;
 		case XRT_INPUT_GENERIC_PALM_POSE:
-			std::tie(extrapolation_time, res) = palm.get_at(at_timestamp_ns);
+			std::tie(extrapolation_time, res) = palm.get_at(at_timestamp_ns, epoch);
 			cnx->set_enabled(palm.device, true);
 			break;
 		default:
@@ -346,7 +348,7 @@ std::pair<xrt_hand_joint_set, int64_t> wivrn_controller::get_hand_tracking(xrt_i
 	{
 		case XRT_INPUT_GENERIC_HAND_TRACKING_LEFT:
 		case XRT_INPUT_GENERIC_HAND_TRACKING_RIGHT: {
-			auto [extrapolation_time, data] = joints.get_at(desired_timestamp_ns);
+			auto [extrapolation_time, data] = joints.get_at(desired_timestamp_ns, cnx->tracking_snapshot(desired_timestamp_ns));
 			cnx->add_predict_offset(extrapolation_time);
 			cnx->set_enabled(joints.hand_id == 0 ? to_headset::tracking_control::id::left_hand : to_headset::tracking_control::id::right_hand, true);
 			return {data, desired_timestamp_ns};
@@ -358,7 +360,7 @@ std::pair<xrt_hand_joint_set, int64_t> wivrn_controller::get_hand_tracking(xrt_i
 	}
 }
 
-void wivrn_controller::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+void wivrn_controller::update_tracking(const demuxed_tracking & tracking, const clock_offset & offset)
 {
 	if (not aim.update_tracking(tracking, offset))
 		cnx->set_enabled(aim.device, false);
@@ -368,9 +370,9 @@ void wivrn_controller::update_tracking(const from_headset::tracking & tracking,
 		cnx->set_enabled(palm.device, false);
 }
 
-void wivrn_controller::update_hand_tracking(const from_headset::hand_tracking & tracking, const clock_offset & offset)
+void wivrn_controller::update_hand_tracking(const from_headset::hand_tracking & tracking, const clock_offset & offset, const sample_epoch & epoch)
 {
-	if (not joints.update_tracking(tracking, offset))
+	if (not joints.update_tracking(tracking, offset, epoch))
 		cnx->set_enabled(joints.hand_id == 0 ? to_headset::tracking_control::id::left_hand : to_headset::tracking_control::id::right_hand, false);
 }
 
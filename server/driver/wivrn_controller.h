@@ -62,8 +62,8 @@ public:
 
 	void set_inputs(const from_headset::inputs &, const clock_offset &);
 
-	void update_tracking(const from_headset::tracking &, const clock_offset &);
-	void update_hand_tracking(const from_headset::hand_tracking &, const clock_offset &);
+	void update_tracking(const demuxed_tracking &, const clock_offset &);
+	void update_hand_tracking(const from_headset::hand_tracking &, const clock_offset &, const sample_epoch & epoch);
 
 private:
 	void set_inputs(device_id input_id, float value, int64_t last_change_time);
@@ -21,6 +21,7 @@
 #include "wivrn_eye_tracker.h"
 
 #include "wivrn_packets.h"
+#include "wivrn_session.h"
 #include "xrt/xrt_defines.h"
 #include "xrt/xrt_device.h"
 
@@ -47,8 +48,8 @@ static void wivrn_eye_tracker_get_tracked_pose(xrt_device * xdev,
                                                int64_t at_timestamp_ns,
                                                xrt_space_relation * out_relation);
 
-wivrn_eye_tracker::wivrn_eye_tracker(xrt_device * hmd) :
-        xrt_device{}, gaze(device_id::EYE_GAZE)
+wivrn_eye_tracker::wivrn_eye_tracker(xrt_device * hmd, wivrn::wivrn_session & cnx) :
+        xrt_device{}, gaze(device_id::EYE_GAZE), cnx(cnx)
 {
 	xrt_device * base = this;
 	base->tracking_origin = hmd->tracking_origin;
@@ -81,7 +82,7 @@ xrt_space_relation wivrn_eye_tracker::get_tracked_pose(xrt_input_name name, int6
 {
 	if (name == XRT_INPUT_GENERIC_EYE_GAZE_POSE)
 	{
-		auto [_, relation] = gaze.get_at(at_timestamp_ns);
+		auto [_, relation] = gaze.get_at(at_timestamp_ns, cnx.tracking_snapshot(at_timestamp_ns));
 		return relation;
 	}
 
@@ -89,7 +90,7 @@ xrt_space_relation wivrn_eye_tracker::get_tracked_pose(xrt_input_name name, int6
 	return {};
 }
 
-void wivrn_eye_tracker::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+void wivrn_eye_tracker::update_tracking(const demuxed_tracking & tracking, const clock_offset & offset)
 {
 	gaze.update_tracking(tracking, offset);
 }
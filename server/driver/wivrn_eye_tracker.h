@@ -30,6 +30,7 @@
 
 namespace wivrn
 {
+class wivrn_session;
 
 class wivrn_eye_tracker : public xrt_device
 {
@@ -37,11 +38,13 @@ class wivrn_eye_tracker : public xrt_device
 	xrt_input gaze_input;
 	pose_list gaze;
 
+	wivrn::wivrn_session & cnx;
+
 public:
-	wivrn_eye_tracker(xrt_device * hmd);
+	wivrn_eye_tracker(xrt_device * hmd, wivrn::wivrn_session & cnx);
 
 	void update_inputs();
-	void update_tracking(const from_headset::tracking &, const clock_offset &);
+	void update_tracking(const demuxed_tracking &, const clock_offset &);
 	xrt_space_relation get_tracked_pose(xrt_input_name name, int64_t at_timestamp_ns);
 };
 } // namespace wivrn
@@ -78,11 +78,11 @@ void wivrn_fb_face2_tracker::update_inputs()
 	// Empty
 }
 
-void wivrn_fb_face2_tracker::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+void wivrn_fb_face2_tracker::update_tracking(const demuxed_tracking & tracking, const clock_offset & offset)
 {
-	if (not(tracking.face and tracking.face->is_valid))
+	if (not(tracking.tracking.face and tracking.tracking.face->is_valid))
 		return;
-	const auto & face = *tracking.face;
+	const auto & face = *tracking.tracking.face;
 
 	wivrn_fb_face2_data data{
 	        .weights = face.weights,
@@ -91,7 +91,7 @@ void wivrn_fb_face2_tracker::update_tracking(const from_headset::tracking & trac
 	        .is_eye_following_blendshapes_valid = face.is_eye_following_blendshapes_valid,
 	};
 
-	if (not face_list.update_tracking(tracking.production_timestamp, tracking.timestamp, data, offset))
+	if (not face_list.update_tracking(tracking.tracking.production_timestamp, tracking.tracking.timestamp, data, offset, tracking.epoch))
 		cnx.set_enabled(to_headset::tracking_control::id::face, false);
 }
 
@@ -100,7 +100,7 @@ xrt_result_t wivrn_fb_face2_tracker::get_face_tracking(enum xrt_input_name facia
 	if (facial_expression_type == XRT_INPUT_FB_FACE_TRACKING2_VISUAL)
 	{
 		cnx.set_enabled(to_headset::tracking_control::id::face, true);
-		auto [_, data] = face_list.get_at(at_timestamp_ns);
+		auto [_, data] = face_list.get_at(at_timestamp_ns, cnx.tracking_snapshot(at_timestamp_ns));
 
 		inout_value->face_expression_set2_fb.is_valid = data.is_valid;
 
@@ -25,6 +25,7 @@
 #include "xrt/xrt_device.h"
 
 #include "history.h"
+#include "pose_list.h"
 
 #include <array>
 #include <cmath>
@@ -78,9 +79,9 @@ public:
 		return result;
 	}
 
-	bool update_tracking(const XrTime & production_timestamp, const XrTime & timestamp, const wivrn_fb_face2_data & data, const clock_offset & offset)
+	bool update_tracking(const XrTime & production_timestamp, const XrTime & timestamp, const wivrn_fb_face2_data & data, const clock_offset & offset, const sample_epoch & epoch)
 	{
-		return this->add_sample(production_timestamp, timestamp, data, offset);
+		return this->add_sample(production_timestamp, timestamp, data, offset, epoch);
 	}
 };
 
@@ -95,7 +96,7 @@ public:
 	wivrn_fb_face2_tracker(xrt_device * hmd, wivrn::wivrn_session & cnx);
 
 	void update_inputs();
-	void update_tracking(const from_headset::tracking &, const clock_offset &);
+	void update_tracking(const demuxed_tracking &, const clock_offset &);
 	xrt_result_t get_face_tracking(enum xrt_input_name facial_expression_type, int64_t at_timestamp_ns, struct xrt_facial_expression_set * out_value);
 };
 } // namespace wivrn
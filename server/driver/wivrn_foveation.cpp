@@ -26,9 +26,13 @@
 #include "wivrn_packets.h"
 #include "xrt/xrt_defines.h"
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstring>
 #include <map>
+#include <numbers>
+#include <vector>
 #include <vulkan/vulkan_raii.hpp>
 #include <vulkan/vulkan_structs.hpp>
 #include <openxr/openxr.h>
@@ -40,6 +44,12 @@ namespace wivrn
 
 const uint32_t dispatch_group_count = RENDER_DISTORTION_IMAGE_DIMENSIONS / 8;
 
+// Widening of the high resolution region, see wivrn_hmd::set_foveation
+static const float max_widening = 0.5;
+static const float saccade_widening = 0.25;
+static const float pursuit_widening = 0.2;
+static const float pursuit_speed = 30 * std::numbers::pi_v<float> / 180;
+
 struct FoveationParamsPcs
 {
 	float a[2];
@@ -75,7 +85,8 @@ wivrn_foveation_renderer::wivrn_foveation_renderer(wivrn_vk_bundle & vk, vk::rai
                    .poolSizeCount = pool_sizes.size(),
                    .pPoolSizes = pool_sizes.data(),
            }),
-        ds_layout(vk.device, vk::DescriptorSetLayoutCreateInfo{.bindingCount = layout_bindings.size(), .pBindings = layout_bindings.data()})
+        ds_layout(vk.device, vk::DescriptorSetLayoutCreateInfo{.bindingCount = layout_bindings.size(), .pBindings = layout_bindings.data()}),
+        timestamps(vk, vk.queue_family_index, 2)
 {
 	cmd_buf = std::move(vk.device.allocateCommandBuffers(
 	        {.commandPool = *cmd_pool,
@@ -144,40 +155,11 @@ wivrn_foveation_renderer::wivrn_foveation_renderer(wivrn_vk_bundle & vk, vk::rai
 	};
 }
 
-void wivrn_foveation_renderer::render_distortion_images(std::array<to_headset::foveation_parameter, 2> foveations, const VkImage * images, const VkImageView * image_views)
+void wivrn_foveation_renderer::update_descriptor_sets(const VkImageView * image_views)
 {
-	cmd_buf.reset();
-	cmd_buf.begin(vk::CommandBufferBeginInfo{});
-
-	// images: left position, right position, left derivate, right derivate
-	std::array<vk::ImageMemoryBarrier, 4> im_barriers;
-	im_barriers.fill({
-	        .srcAccessMask = vk::AccessFlagBits::eNone,
-	        .dstAccessMask = vk::AccessFlagBits::eMemoryWrite,
-	        .oldLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
-	        .newLayout = vk::ImageLayout::eGeneral,
-	        .subresourceRange = {.aspectMask = vk::ImageAspectFlagBits::eColor,
-	                             .baseMipLevel = 0,
-	                             .levelCount = 1,
-	                             .baseArrayLayer = 0,
-	                             .layerCount = 1},
-	});
-	for (size_t i = 0; i < im_barriers.size(); ++i)
-		im_barriers[i].image = images[i];
-
-	cmd_buf.pipelineBarrier(
-	        vk::PipelineStageFlagBits::eTopOfPipe,
-	        vk::PipelineStageFlagBits::eComputeShader,
-	        {},
-	        nullptr,
-	        nullptr,
-	        im_barriers);
-
 	// Monado's distortion shader is patched to read red as position and green as derivate
 	for (int eye = 0; eye < 2; ++eye)
 	{
-		// Descriptor set
-
 		std::array image_info{
 		        vk::DescriptorImageInfo{
 		                .imageView = image_views[eye],
@@ -205,7 +187,67 @@ void wivrn_foveation_renderer::render_distortion_images(std::array<to_headset::f
 		                                       },
 		                               },
 		                               nullptr);
+	}
+	std::copy_n(image_views, bound_views.size(), bound_views.begin());
+}
+
+bool wivrn_foveation_renderer::render_distortion_images(std::array<to_headset::foveation_parameter, 2> foveations, const VkImage * images, const VkImageView * image_views)
+{
+	// images: left position, right position, left derivate, right derivate
+	if (not std::equal(bound_images.begin(), bound_images.end(), images))
+	{
+		std::copy_n(images, bound_images.size(), bound_images.begin());
+		rendered = {};
+	}
+	if (not std::equal(bound_views.begin(), bound_views.end(), image_views))
+		update_descriptor_sets(image_views);
+
+	// The images only need to be computed again for the eyes whose parameters changed
+	std::vector<int> eyes;
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		if (not rendered[eye] or std::memcmp(&*rendered[eye], &foveations[eye], sizeof(foveations[eye])))
+			eyes.push_back(eye);
+	}
+	if (eyes.empty())
+		return false;
 
+	cmd_buf.reset();
+	cmd_buf.begin(vk::CommandBufferBeginInfo{});
+	timestamps.reset(cmd_buf);
+	timestamps.write(cmd_buf, vk::PipelineStageFlagBits2::eTopOfPipe, 0);
+
+	std::vector<vk::ImageMemoryBarrier> im_barriers;
+	for (int eye: eyes)
+	{
+		for (int i: {eye, eye + 2})
+		{
+			im_barriers.push_back({
+			        .srcAccessMask = vk::AccessFlagBits::eNone,
+			        .dstAccessMask = vk::AccessFlagBits::eMemoryWrite,
+			        .oldLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+			        .newLayout = vk::ImageLayout::eGeneral,
+			        .image = images[i],
+			        .subresourceRange = {.aspectMask = vk::ImageAspectFlagBits::eColor,
+			                             .baseMipLevel = 0,
+			                             .levelCount = 1,
+			                             .baseArrayLayer = 0,
+			                             .layerCount = 1},
+			});
+		}
+	}
+
+	cmd_buf.pipelineBarrier(
+	        vk::PipelineStageFlagBits::eTopOfPipe,
+	        vk::PipelineStageFlagBits::eComputeShader,
+	        {},
+	        nullptr,
+	        nullptr,
+	        im_barriers);
+
+	cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
+	for (int eye: eyes)
+	{
 		auto foveation = foveations[eye];
 
 		FoveationParamsPcs f_params{
@@ -215,10 +257,10 @@ void wivrn_foveation_renderer::render_distortion_images(std::array<to_headset::f
 		        .center = {foveation.x.center, foveation.y.center},
 		};
 
-		cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
 		cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *layout, 0, ds[eye], {});
 		cmd_buf.pushConstants<FoveationParamsPcs>(*layout, vk::ShaderStageFlagBits::eCompute, 0, f_params);
 		cmd_buf.dispatch(dispatch_group_count, dispatch_group_count, 1);
+		rendered[eye] = foveation;
 	}
 
 	for (auto & barrier: im_barriers)
@@ -237,7 +279,9 @@ void wivrn_foveation_renderer::render_distortion_images(std::array<to_headset::f
 	        nullptr,
 	        im_barriers);
 
+	timestamps.write(cmd_buf, vk::PipelineStageFlagBits2::eComputeShader, 1);
 	cmd_buf.end();
+	return true;
 }
 
 xrt_vec2 yaw_pitch(xrt_quat q)
@@ -258,59 +302,62 @@ xrt_vec2 yaw_pitch(xrt_quat q)
 	        pitch};
 }
 
-std::array<xrt_vec2, 2> wivrn_foveation::get_center()
+wivrn_foveation::target wivrn_foveation::get_target(int64_t display_time_ns)
 {
 	std::lock_guard lock(mutex);
 
-	std::array<xrt_vec2, 2> uvs;
-	auto e = yaw_pitch(last_gaze);
+	target result;
+	auto prediction = gaze.predict(display_time_ns);
+	auto e = prediction.angles;
 
 	for (int i = 0; i < 2; i++)
 	{
-		uvs[i].x = (e.x - views[i].fov.angleLeft) / (views[i].fov.angleRight - views[i].fov.angleLeft) * 2 - 1 + center_offset[i].x;
-		uvs[i].y = (e.y - views[i].fov.angleDown) / (views[i].fov.angleUp - views[i].fov.angleDown) * 2 - 1 + center_offset[i].y;
+		result.center[i].x = (e.x - views[i].fov.angleLeft) / (views[i].fov.angleRight - views[i].fov.angleLeft) * 2 - 1 + center_offset[i].x;
+		result.center[i].y = (e.y - views[i].fov.angleDown) / (views[i].fov.angleUp - views[i].fov.angleDown) * 2 - 1 + center_offset[i].y;
 	}
 
-	return uvs;
+	// Widen the high resolution region when the prediction is likely to be off
+	result.widening = max_widening * (1 - prediction.confidence);
+	if (prediction.saccade)
+		result.widening = std::max(result.widening, saccade_widening);
+	else
+		result.widening = std::max(result.widening, pursuit_widening * std::min(prediction.speed / pursuit_speed, 1.f));
+
+	return result;
 }
 
-void wivrn_foveation::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+void wivrn_foveation::update_tracking(const demuxed_tracking & tracking, const clock_offset & offset)
 {
 	std::lock_guard lock(mutex);
 
 	const uint8_t orientation_ok = from_headset::tracking::orientation_valid | from_headset::tracking::orientation_tracked;
 
-	views = tracking.views;
-
-	std::optional<xrt_quat> head;
+	views = tracking.tracking.views;
 
-	for (const auto & pose: tracking.device_poses)
-	{
-		if (pose.device != device_id::HEAD)
-			continue;
-
-		if ((pose.flags & orientation_ok) != orientation_ok)
-			return;
+	// Other samples are predictions from the headset runtime, the gaze
+	// predictor only needs measurements
+	if (tracking.tracking.timestamp != tracking.tracking.production_timestamp)
+		return;
 
-		head = xrt_cast(pose.pose.orientation);
-		break;
-	}
+	const auto * head = tracking.pose(device_id::HEAD);
+	if (not head or (head->flags & orientation_ok) != orientation_ok)
+		return;
 
-	if (!head.has_value())
+	const auto * eye = tracking.pose(device_id::EYE_GAZE);
+	if (not eye)
 		return;
 
-	for (const auto & pose: tracking.device_poses)
+	if ((eye->flags & orientation_ok) != orientation_ok)
 	{
-		if (pose.device != device_id::EYE_GAZE)
-			continue;
-
-		if ((pose.flags & orientation_ok) != orientation_ok)
-			return;
-
-		xrt_quat qgaze = xrt_cast(pose.pose.orientation);
-		math_quat_unrotate(&qgaze, &head.value(), &last_gaze);
-		break;
+		gaze.invalidate();
+		return;
 	}
+
+	xrt_quat qhead = xrt_cast(head->pose.orientation);
+	xrt_quat qgaze = xrt_cast(eye->pose.orientation);
+	xrt_quat local_gaze;
+	math_quat_unrotate(&qgaze, &qhead, &local_gaze);
+	gaze.add(offset.from_headset(tracking.tracking.timestamp), yaw_pitch(local_gaze));
 }
 
 void wivrn_foveation::set_initial_parameters(std::array<to_headset::foveation_parameter, 2> p)
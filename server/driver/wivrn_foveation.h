@@ -18,9 +18,13 @@
 
 #pragma once
 
+#include "gaze_predictor.h"
+#include "pose_list.h"
+#include "utils/gpu_timestamps.h"
 #include "wivrn_packets.h"
 #include "xrt/xrt_defines.h"
 
+#include <optional>
 #include <vulkan/vulkan_raii.hpp>
 
 namespace wivrn
@@ -36,14 +40,22 @@ class wivrn_foveation
 
 	std::array<xrt_vec2, 2> center_offset = {};
 	std::array<from_headset::tracking::view, 2> views = {};
-	xrt_quat last_gaze = {};
+	gaze_predictor gaze;
 
 public:
+	struct target
+	{
+		std::array<xrt_vec2, 2> center;
+		// How much to widen the high resolution region, between 0 and 1
+		float widening;
+	};
+
 	wivrn_foveation() {}
 
 	void set_initial_parameters(std::array<to_headset::foveation_parameter, 2> p);
-	void update_tracking(const from_headset::tracking &, const clock_offset &);
-	std::array<xrt_vec2, 2> get_center();
+	void update_tracking(const demuxed_tracking &, const clock_offset &);
+	// Foveation for a frame displayed at display_time_ns
+	target get_target(int64_t display_time_ns);
 };
 
 // Renders foveation parameters to Monado's distortion images using a compute shader
@@ -57,11 +69,23 @@ class wivrn_foveation_renderer
 	vk::raii::Pipeline pipeline = nullptr;
 	std::array<vk::DescriptorSet, 2> ds;
 
+	// Images the descriptor sets point to, and the parameters they currently hold
+	std::array<VkImage, 4> bound_images{};
+	std::array<VkImageView, 4> bound_views{};
+	std::array<std::optional<to_headset::foveation_parameter>, 2> rendered;
+
+	void update_descriptor_sets(const VkImageView * image_views);
+
 public:
 	wivrn_foveation_renderer(wivrn_vk_bundle & vk, vk::raii::CommandPool & cmd_pool);
 
 	vk::raii::CommandBuffer cmd_buf = nullptr;
 
-	void render_distortion_images(std::array<to_headset::foveation_parameter, 2> foveation_arr, const VkImage * images, const VkImageView * image_views);
+	// Start and end of the last recorded command buffer, and the frame it was for
+	gpu_timestamps timestamps;
+	int64_t frame_id = 0;
+
+	// Records cmd_buf if the images must be updated, returns false if they already hold these parameters
+	bool render_distortion_images(std::array<to_headset::foveation_parameter, 2> foveation_arr, const VkImage * images, const VkImageView * image_views);
 };
 } // namespace wivrn
@@ -262,12 +262,12 @@ xrt_space_relation wivrn_hmd::get_tracked_pose(xrt_input_name name, int64_t at_t
 		return {};
 	}
 
-	auto [extrapolation_time, res] = views.get_at(at_timestamp_ns);
+	auto [extrapolation_time, res] = views.get_at(at_timestamp_ns, cnx->tracking_snapshot(at_timestamp_ns));
 	cnx->add_predict_offset(extrapolation_time);
 	return res.relation;
 }
 
-void wivrn_hmd::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+void wivrn_hmd::update_tracking(const demuxed_tracking & tracking, const clock_offset & offset)
 {
 	views.update_tracking(tracking, offset);
 }
@@ -287,7 +287,7 @@ void wivrn_hmd::get_view_poses(const xrt_vec3 * default_eye_relation,
                                xrt_fov * out_fovs,
                                xrt_pose * out_poses)
 {
-	auto [extrapolation_time, view] = views.get_at(at_timestamp_ns);
+	auto [extrapolation_time, view] = views.get_at(at_timestamp_ns, cnx->tracking_snapshot(at_timestamp_ns));
 	cnx->add_predict_offset(extrapolation_time);
 
 	int flags = view.relation.relation_flags;
@@ -341,6 +341,7 @@ decltype(wivrn_hmd::foveation_parameters) wivrn_hmd::set_foveated_size(uint32_t
 
 	hmd->screens[0].w_pixels = width;
 	hmd->screens[0].h_pixels = height;
+	foveation_scale = {float(scale[0]), float(scale[1])};
 
 	for (int i = 0; i < 2; ++i)
 	{
@@ -363,6 +364,7 @@ decltype(wivrn_hmd::foveation_parameters) wivrn_hmd::set_foveated_size(uint32_t
 		{
 			float cu = (r + l) / (l - r);
 			foveation_parameters[i].x.center = cu;
+			foveation_center[i].x = cu;
 
 			std::tie(foveation_parameters[i].x.a, foveation_parameters[i].x.b) = solve_foveation(scale[0], cu);
 		}
@@ -371,6 +373,7 @@ decltype(wivrn_hmd::foveation_parameters) wivrn_hmd::set_foveated_size(uint32_t
 		{
 			float cv = (t + b) / (t - b);
 			foveation_parameters[i].y.center = cv;
+			foveation_center[i].y = cv;
 
 			std::tie(foveation_parameters[i].y.a, foveation_parameters[i].y.b) = solve_foveation(scale[1], cv);
 		}
@@ -383,22 +386,69 @@ decltype(wivrn_hmd::foveation_parameters) wivrn_hmd::set_foveated_size(uint32_t
 	return foveation_parameters;
 }
 
-void wivrn_hmd::set_foveation_center(std::array<xrt_vec2, 2> center)
+// Steps of the dynamic foveation parameters: changes smaller than this are not
+// visible, and identical parameters let the compositor skip the distortion images update
+static const float foveation_center_step = 1. / 256;
+static const float foveation_widening_step = 1. / 32;
+
+static float quantize(float value, float step)
+{
+	return std::round(value / step) * step;
+}
+
+std::tuple<float, float> wivrn_hmd::solve_foveation_cached(float scale, float center)
 {
+	++foveation_solution_uses;
+	auto oldest = foveation_solutions.begin();
+	for (auto it = foveation_solutions.begin(); it != foveation_solutions.end(); ++it)
+	{
+		if (it->last_use and it->scale == scale and it->center == center)
+		{
+			it->last_use = foveation_solution_uses;
+			return {it->a, it->b};
+		}
+		if (it->last_use < oldest->last_use)
+			oldest = it;
+	}
+
+	auto [a, b] = solve_foveation(scale, center);
+	*oldest = {
+	        .scale = scale,
+	        .center = center,
+	        .a = a,
+	        .b = b,
+	        .last_use = foveation_solution_uses,
+	};
+	return {a, b};
+}
+
+void wivrn_hmd::set_foveation(std::array<xrt_vec2, 2> center, float widening, float narrowing)
+{
+	// The scale never goes below the configured one, which would give the
+	// center more than a 1:1 pixel ratio
+	widening *= 1 - std::clamp(narrowing, 0.f, 1.f);
+	// Stays below 1 so that the headset keeps the same foveation pipeline
+	widening = quantize(std::clamp(widening, 0.f, 0.9f), foveation_widening_step);
+
 	for (int i = 0; i < 2; ++i)
 	{
-		foveation_parameters[i].x.center = center[i].x;
-		foveation_parameters[i].y.center = center[i].y;
+		foveation_parameters[i].x.center = quantize(center[i].x, foveation_center_step);
+		foveation_parameters[i].y.center = quantize(center[i].y, foveation_center_step);
+
+		if (foveation_scale[0] < 1)
+			foveation_parameters[i].x.scale = std::lerp(foveation_scale[0], 1.f, widening);
+		if (foveation_scale[1] < 1)
+			foveation_parameters[i].y.scale = std::lerp(foveation_scale[1], 1.f, widening);
 
 		if (foveation_parameters[i].x.scale < 1)
 		{
 			std::tie(foveation_parameters[i].x.a, foveation_parameters[i].x.b) =
-			        solve_foveation(foveation_parameters[i].x.scale, foveation_parameters[i].x.center);
+			        solve_foveation_cached(foveation_parameters[i].x.scale, foveation_parameters[i].x.center);
 		}
 		if (foveation_parameters[i].y.scale < 1)
 		{
 			std::tie(foveation_parameters[i].y.a, foveation_parameters[i].y.b) =
-			        solve_foveation(foveation_parameters[i].y.scale, foveation_parameters[i].y.center);
+			        solve_foveation_cached(foveation_parameters[i].y.scale, foveation_parameters[i].y.center);
 		}
 	}
 }
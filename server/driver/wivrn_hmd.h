@@ -27,6 +27,7 @@
 #include <array>
 #include <cstdint>
 #include <mutex>
+#include <tuple>
 
 namespace wivrn
 {
@@ -48,6 +49,22 @@ class wivrn_hmd : public xrt_device
 
 	view_list views;
 	std::array<to_headset::foveation_parameter, 2> foveation_parameters{};
+	// Ratio between the encoded and full size, for each axis
+	std::array<float, 2> foveation_scale{1, 1};
+	// Center of the configured foveation, for each eye
+	std::array<xrt_vec2, 2> foveation_center{};
+	// Recently used solutions of the foveation equation, keyed by quantized scale and center
+	struct foveation_solution
+	{
+		float scale;
+		float center;
+		float a;
+		float b;
+		uint64_t last_use;
+	};
+	std::array<foveation_solution, 16> foveation_solutions{};
+	uint64_t foveation_solution_uses = 0;
+	std::tuple<float, float> solve_foveation_cached(float scale, float center);
 	from_headset::battery battery{};
 
 	wivrn::wivrn_session * cnx;
@@ -76,10 +93,19 @@ public:
 	                                float * out_charge);
 
 	void update_battery(const from_headset::battery &);
-	void update_tracking(const from_headset::tracking &, const clock_offset &);
+	void update_tracking(const demuxed_tracking &, const clock_offset &);
 
 	decltype(foveation_parameters) set_foveated_size(uint32_t width, uint32_t height);
-	void set_foveation_center(std::array<xrt_vec2, 2> center);
+	// widening widens the high resolution region: 0 keeps a 1:1 pixel ratio at
+	// the center, 1 scales the image uniformly
+	// narrowing compresses the periphery back toward the configured foveation,
+	// where the center has a 1:1 pixel ratio: 0 keeps the widening, 1 ignores it
+	void set_foveation(std::array<xrt_vec2, 2> center, float widening, float narrowing = 0);
+
+	std::array<xrt_vec2, 2> get_foveation_center()
+	{
+		return foveation_center;
+	}
 
 	std::array<to_headset::foveation_parameter, 2> get_foveation_parameters()
 	{
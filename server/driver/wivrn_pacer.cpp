@@ -20,6 +20,7 @@
 #include "wivrn_pacer.h"
 #include "driver/clock_offset.h"
 #include "os/os_time.h"
+#include <algorithm>
 #include <cmath>
 
 namespace wivrn
@@ -41,6 +42,13 @@ void wivrn_pacer::set_stream_count(size_t count)
 		stream.times.reserve(num_wait_times);
 }
 
+void wivrn_pacer::set_frame_duration(uint64_t frame_duration)
+{
+	std::lock_guard lock(mutex);
+	frame_duration_ns = frame_duration;
+	client_render_phase_ns %= frame_duration_ns;
+}
+
 template <typename T>
 static T lerp_mod(T a, T b, double t, T mod)
 {
@@ -64,16 +72,19 @@ void wivrn_pacer::predict(
 	frame_id = this->frame_id++;
 	auto now = os_monotonic_get_ns();
 
+	// Encoders wait for the GPU, not only for the compositor to submit
+	int64_t wake_up_to_present_ns = std::max(mean_wake_up_to_present_ns, mean_wake_up_to_gpu_done_ns);
+
 	int64_t predicted_client_render = last_ns + frame_duration_ns;
 	// snap to phase
 	predicted_client_render = (predicted_client_render / frame_duration_ns) * frame_duration_ns + client_render_phase_ns;
 
-	if (now + mean_wake_up_to_present_ns + safe_present_to_decoded_ns > predicted_client_render)
-		predicted_client_render += frame_duration_ns * ((now + mean_wake_up_to_present_ns + safe_present_to_decoded_ns - predicted_client_render) / frame_duration_ns);
+	if (now + wake_up_to_present_ns + safe_present_to_decoded_ns > predicted_client_render)
+		predicted_client_render += frame_duration_ns * ((now + wake_up_to_present_ns + safe_present_to_decoded_ns - predicted_client_render) / frame_duration_ns);
 
 	out_predicted_display_time_ns = predicted_client_render + mean_render_to_display_ns;
 	out_desired_present_time_ns = predicted_client_render - safe_present_to_decoded_ns;
-	out_wake_up_time_ns = out_desired_present_time_ns - mean_wake_up_to_present_ns + margin_ns; // we should be awoken early by the application
+	out_wake_up_time_ns = out_desired_present_time_ns - wake_up_to_present_ns + margin_ns; // we should be awoken early by the application
 	last_wake_up_ns = out_wake_up_time_ns;
 
 	last_ns = predicted_client_render;
@@ -82,6 +93,7 @@ void wivrn_pacer::predict(
 	        .frame_id = frame_id,
 	        .present_ns = out_desired_present_time_ns,
 	        .predicted_display_time = out_predicted_display_time_ns,
+	        .wake_up_ns = out_wake_up_time_ns,
 	};
 
 	out_present_slop_ns = slop_ns;
@@ -167,6 +179,17 @@ void wivrn_pacer::mark_timing_point(
 	}
 }
 
+void wivrn_pacer::on_gpu_timing(int64_t frame_id, int64_t gpu_end_ns)
+{
+	std::lock_guard lock(mutex);
+	const auto & frame = in_flight_frames[frame_id % in_flight_frames.size()];
+	if (frame.frame_id != frame_id)
+		return;
+
+	if (gpu_end_ns > frame.wake_up_ns and gpu_end_ns < frame.wake_up_ns + 100'000'000)
+		mean_wake_up_to_gpu_done_ns = std::lerp(mean_wake_up_to_gpu_done_ns, gpu_end_ns - frame.wake_up_ns, 0.1);
+}
+
 wivrn_pacer::frame_info wivrn_pacer::present_to_info(int64_t present)
 {
 	std::lock_guard lock(mutex);
@@ -179,6 +202,15 @@ wivrn_pacer::frame_info wivrn_pacer::present_to_info(int64_t present)
 	return {};
 }
 
+std::optional<wivrn_pacer::frame_info> wivrn_pacer::get_frame(int64_t frame_id)
+{
+	std::lock_guard lock(mutex);
+	const auto & info = in_flight_frames[frame_id % in_flight_frames.size()];
+	if (info.frame_id != frame_id)
+		return std::nullopt;
+	return info;
+}
+
 void wivrn_pacer::reset()
 {
 	std::lock_guard lock(mutex);
@@ -188,5 +220,6 @@ void wivrn_pacer::reset()
 		stream.next_times_index = 0;
 	}
 	in_flight_frames = {};
+	mean_wake_up_to_gpu_done_ns = 0;
 }
 } // namespace wivrn
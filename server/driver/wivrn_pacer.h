@@ -24,6 +24,7 @@
 #include <cstdint>
 #include <main/comp_target.h>
 #include <mutex>
+#include <optional>
 #include <vector>
 
 namespace wivrn
@@ -34,22 +35,25 @@ struct clock_offset;
 class wivrn_pacer
 {
 public:
-	const uint64_t frame_duration_ns;
 	struct frame_info
 	{
 		int64_t frame_id;
 		int64_t present_ns;
 		int64_t predicted_display_time;
+		int64_t wake_up_ns;
 	};
 
 private:
 	std::mutex mutex;
+	uint64_t frame_duration_ns;
 	int64_t last_ns = 0;
 	int64_t frame_id = 0;
 
 	int64_t client_render_phase_ns = 0;
 
 	int64_t mean_wake_up_to_present_ns = 1'000'000;
+	// Includes the time for the GPU to complete the compositor work
+	int64_t mean_wake_up_to_gpu_done_ns = 0;
 	int64_t safe_present_to_decoded_ns = 0;
 	int64_t mean_render_to_display_ns = 0;
 
@@ -72,6 +76,7 @@ public:
 	{}
 
 	void set_stream_count(size_t count);
+	void set_frame_duration(uint64_t frame_duration);
 
 	void predict(
 	        int64_t & out_frame_id,
@@ -87,7 +92,11 @@ public:
 	        int64_t frame_id,
 	        int64_t when_ns);
 
+	void on_gpu_timing(int64_t frame_id, int64_t gpu_end_ns);
+
 	frame_info present_to_info(int64_t present);
+	// Empty if the frame is no longer in flight
+	std::optional<frame_info> get_frame(int64_t frame_id);
 
 	void reset();
 };
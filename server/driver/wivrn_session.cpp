@@ -25,10 +25,12 @@
 #include "main/comp_main_interface.h"
 #include "main/comp_target.h"
 #include "math/m_api.h"
+#include "os/os_time.h"
 #include "util/u_builders.h"
 #include "util/u_logging.h"
 #include "util/u_system.h"
 #include "utils/scoped_lock.h"
+#include "utils/thread_policy.h"
 
 #include "audio/audio_setup.h"
 #include "wivrn_comp_target.h"
@@ -39,6 +41,7 @@
 #include "wivrn_ipc.h"
 
 #include "xrt/xrt_session.h"
+#include <algorithm>
 #include <cmath>
 #include <magic_enum.hpp>
 #include <stdexcept>
@@ -86,7 +89,7 @@ struct wivrn_comp_target_factory : public comp_target_factory
 	static bool create_target(const struct comp_target_factory * ctf, struct comp_compositor * c, struct comp_target ** out_ct)
 	{
 		auto self = (wivrn_comp_target_factory *)ctf;
-		self->session.comp_target = new wivrn_comp_target(self->session, c, self->fps);
+		self->session.comp_target = new wivrn_comp_target(self->session, c, self->fps, configuration::read_user_configuration());
 		*out_ct = self->session.comp_target;
 		return true;
 	}
@@ -191,7 +194,7 @@ wivrn::wivrn_session::wivrn_session(wivrn::TCP && tcp, u_system & system) :
 
 	if (info.eye_gaze)
 	{
-		eye_tracker = std::make_unique<wivrn_eye_tracker>(&hmd);
+		eye_tracker = std::make_unique<wivrn_eye_tracker>(&hmd, *this);
 		foveation = std::make_unique<wivrn_foveation>();
 		static_roles.eyes = eye_tracker.get();
 		xdevs[xdev_count++] = eye_tracker.get();
@@ -288,24 +291,34 @@ void wivrn_session::operator()(from_headset::headset_info_packet &&)
 }
 void wivrn_session::operator()(from_headset::trackings && tracking)
 {
+	// All the samples of the packet become visible at once
+	auto offset = offset_est.get_offset();
+	auto next = epoch.next();
 	for (auto & item: tracking.items)
-		(*this)(item);
+		update_tracking(item, next, offset);
+	epoch.publish(next.epoch);
 }
 void wivrn_session::operator()(const from_headset::tracking & tracking)
 {
+	auto offset = offset_est.get_offset();
+	auto next = epoch.next();
+	update_tracking(tracking, next, offset);
+	epoch.publish(next.epoch);
+}
+void wivrn_session::update_tracking(const from_headset::tracking & tracking, const sample_epoch & next, const clock_offset & offset)
+{
+	demuxed_tracking demuxed(tracking, next);
+
 	if (tracking.state_flags & from_headset::tracking::state_flags::recentered)
 	{
-		for (const auto & pose: tracking.device_poses)
+		if (const auto * pose = demuxed.pose(device_id::HEAD))
 		{
-			if (pose.device != device_id::HEAD)
-				continue;
-
-			xrt_pose offset;
+			xrt_pose stage_offset;
 			auto tracking_origin = static_cast<xrt_device &>(hmd).tracking_origin;
-			space_overseer->get_reference_space_offset(space_overseer, xrt_reference_space_type::XRT_SPACE_REFERENCE_TYPE_STAGE, &offset);
+			space_overseer->get_reference_space_offset(space_overseer, xrt_reference_space_type::XRT_SPACE_REFERENCE_TYPE_STAGE, &stage_offset);
 
-			xrt_vec3 hmd_pos = xrt_cast(pose.pose.position);
-			xrt_quat hmd_quat = xrt_cast(pose.pose.orientation);
+			xrt_vec3 hmd_pos = xrt_cast(pose->pose.position);
+			xrt_quat hmd_quat = xrt_cast(pose->pose.orientation);
 			xrt_vec3 unit_z = XRT_VEC3_UNIT_Z;
 			xrt_vec3 unit_y = XRT_VEC3_UNIT_Y;
 
@@ -316,40 +329,44 @@ void wivrn_session::operator()(const from_headset::tracking & tracking)
 
 			xrt_quat new_orientation;
 			math_quat_from_angle_vector(-angle_y, &unit_y, &new_orientation);
-			offset.orientation = new_orientation;
-			offset.position.x = hmd_pos.x;
-			offset.position.z = hmd_pos.z;
+			stage_offset.orientation = new_orientation;
+			stage_offset.position.x = hmd_pos.x;
+			stage_offset.position.z = hmd_pos.z;
 
-			auto res = space_overseer->set_reference_space_offset(space_overseer, xrt_reference_space_type::XRT_SPACE_REFERENCE_TYPE_STAGE, &offset);
+			auto res = space_overseer->set_reference_space_offset(space_overseer, xrt_reference_space_type::XRT_SPACE_REFERENCE_TYPE_STAGE, &stage_offset);
 			if (res != XRT_SUCCESS)
 				U_LOG_W("could not recenter: offset failed to apply!");
-
-			break;
 		}
 	}
 
-	auto offset = offset_est.get_offset();
-
-	hmd.update_tracking(tracking, offset);
-	left_hand.update_tracking(tracking, offset);
-	right_hand.update_tracking(tracking, offset);
+	hmd.update_tracking(demuxed, offset);
+	left_hand.update_tracking(demuxed, offset);
+	right_hand.update_tracking(demuxed, offset);
 	if (eye_tracker)
-		eye_tracker->update_tracking(tracking, offset);
+		eye_tracker->update_tracking(demuxed, offset);
 	if (foveation)
-		foveation->update_tracking(tracking, offset);
+		foveation->update_tracking(demuxed, offset);
 	if (fb_face2_tracker)
-		fb_face2_tracker->update_tracking(tracking, offset);
+		fb_face2_tracker->update_tracking(demuxed, offset);
 }
 
 void wivrn_session::operator()(from_headset::hand_tracking && hand_tracking)
 {
 	auto offset = offset_est.get_offset();
+	auto next = epoch.next();
 
-	left_hand.update_hand_tracking(hand_tracking, offset);
-	right_hand.update_hand_tracking(hand_tracking, offset);
+	left_hand.update_hand_tracking(hand_tracking, offset, next);
+	right_hand.update_hand_tracking(hand_tracking, offset, next);
+	epoch.publish(next.epoch);
 }
 void wivrn_session::operator()(from_headset::inputs && inputs)
 {
+	// Packets only contain the inputs that changed, an older packet would
+	// overwrite newer values
+	if (inputs_sequence and int32_t(inputs.sequence - *inputs_sequence) <= 0)
+		return;
+	inputs_sequence = inputs.sequence;
+
 	auto offset = get_offset();
 
 	left_hand.set_inputs(inputs, offset);
@@ -429,13 +446,31 @@ void wivrn_session::operator()(to_monado::disconnect &&)
 
 void wivrn_session::run(std::stop_token stop)
 {
+	set_thread_policy("network");
+	auto next_latency_report = std::chrono::steady_clock::now();
+
 	while (not stop.stop_requested())
 	{
 		try
 		{
 			offset_est.request_sample(connection);
 			tracking_control.send(connection);
-			connection.poll(*this, 20);
+			if (connection.poll(*this, 20) > 0)
+				dump_dispatch_latency();
+
+			if (auto now = std::chrono::steady_clock::now(); now >= next_latency_report)
+			{
+				next_latency_report = now + std::chrono::seconds(1);
+				for (const auto & thread: run_queue_latency())
+				{
+					if (thread.timeslices == 0)
+						continue;
+					uint64_t average = thread.wait_ns / thread.timeslices;
+					U_LOG_D("Thread %s: %lu timeslices, run queue latency %luns", thread.name.c_str(), thread.timeslices, average);
+					std::string extra = "," + thread.name + "," + std::to_string(average);
+					dump_time("run_queue_latency", 0, os_monotonic_get_ns(), -1, extra.c_str());
+				}
+			}
 		}
 		catch (const std::exception & e)
 		{
@@ -455,12 +490,22 @@ std::array<to_headset::foveation_parameter, 2> wivrn_session::set_foveated_size(
 	return p;
 }
 
-bool wivrn_session::apply_dynamic_foveation()
+// Widening of the high resolution region with adaptive foveation, when the link is clear
+static const float adaptive_foveation_widening = 0.25;
+
+bool wivrn_session::apply_dynamic_foveation(int64_t display_time_ns, std::optional<float> narrowing)
 {
-	if (!foveation)
+	if (foveation)
+	{
+		auto target = foveation->get_target(display_time_ns);
+		float widening = narrowing ? std::max(target.widening, adaptive_foveation_widening) : target.widening;
+		hmd.set_foveation(target.center, widening, narrowing.value_or(0));
+	}
+	else if (narrowing)
+		hmd.set_foveation(hmd.get_foveation_center(), adaptive_foveation_widening, *narrowing);
+	else
 		return false;
 
-	hmd.set_foveation_center(foveation->get_center());
 	comp_target->render_dynamic_foveation(hmd.get_foveation_parameters());
 	return true;
 }
@@ -470,6 +515,23 @@ std::array<to_headset::foveation_parameter, 2> wivrn_session::get_foveation_para
 	return hmd.get_foveation_parameters();
 }
 
+void wivrn_session::dump_dispatch_latency()
+{
+	if (not feedback_csv)
+		return;
+
+	auto now = os_monotonic_get_ns();
+	const auto & stats = connection.last_dispatch();
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		if (stats[i].count == 0)
+			continue;
+		std::string event = "dispatch_" + std::string(magic_enum::enum_name(packet_class(i)));
+		std::string extra = "," + std::to_string(stats[i].count) + "," + std::to_string(stats[i].max_latency.count());
+		dump_time(event, 0, now, -1, extra.c_str());
+	}
+}
+
 void wivrn_session::dump_time(const std::string & event, uint64_t frame, int64_t time, uint8_t stream, const char * extra)
 {
 	if (feedback_csv)
@@ -490,6 +552,16 @@ static bool quit_if_no_client(u_system & xrt_system)
 	return false;
 }
 
+static bool same_stream_parameters(const from_headset::headset_info_packet & a, const from_headset::headset_info_packet & b)
+{
+	return a.recommended_eye_width == b.recommended_eye_width and
+	       a.recommended_eye_height == b.recommended_eye_height and
+	       a.preferred_refresh_rate == b.preferred_refresh_rate and
+	       a.speaker.has_value() == b.speaker.has_value() and
+	       a.microphone.has_value() == b.microphone.has_value() and
+	       a.supported_codecs == b.supported_codecs;
+}
+
 void wivrn_session::reconnect()
 {
 	// Notify clients about disconnected status
@@ -514,6 +586,7 @@ void wivrn_session::reconnect()
 	try
 	{
 		offset_est.reset();
+		inputs_sequence.reset();
 		connection.reset(std::move(*tcp));
 		std::optional<wivrn::from_headset::packets> control;
 		while (not(control = connection.poll_control(100)))
@@ -521,10 +594,18 @@ void wivrn_session::reconnect()
 			// FIXME: timeout
 			quit_if_no_client(xrt_system);
 		}
-		const auto & info = std::get<from_headset::headset_info_packet>(*control);
+		const auto & new_info = std::get<from_headset::headset_info_packet>(*control);
 		// FIXME: ensure new client is compatible
 
+		// The headset kept its decoders and audio, only a new IDR frame is needed
+		bool resume = new_info.resume_token == connection.get_session_token() and same_stream_parameters(info, new_info);
+		if (resume)
+			U_LOG_I("Resuming session");
+
 		comp_target->reset_encoders();
+
+		// Also sent when resuming: the headset may have lost the audio description in flight
+		// and restarts its audio streams on a new connection
 		if (audio_handle)
 			send_control(audio_handle->description());
 
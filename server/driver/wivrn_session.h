@@ -20,6 +20,7 @@
 #pragma once
 
 #include "clock_offset.h"
+#include "history.h"
 #include "wivrn_connection.h"
 #include "wivrn_controller.h"
 #include "wivrn_hmd.h"
@@ -30,6 +31,7 @@
 #include <fstream>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <thread>
 
 struct u_system;
@@ -100,6 +102,9 @@ class wivrn_session : public xrt_system_devices
 	wivrn_comp_target * comp_target;
 
 	clock_offset_estimator offset_est;
+	tracking_epoch epoch;
+	// Sequence number of the last inputs packet
+	std::optional<uint32_t> inputs_sequence;
 
 	// prediction offset and enabled tracking to configure client
 	tracking_control_t tracking_control;
@@ -140,6 +145,19 @@ public:
 
 	void set_enabled(device_id id, bool enabled);
 
+	// Epoch of the tracking samples to use for a query at at_timestamp_ns
+	uint64_t tracking_snapshot(XrTime at_timestamp_ns)
+	{
+		return epoch.snapshot(at_timestamp_ns);
+	}
+
+	// The compositor started the frame displayed at display_time_ns, its
+	// queries must not use the snapshot of the application frame
+	void composite_tracking_snapshot(XrTime display_time_ns)
+	{
+		epoch.composite(display_time_ns);
+	}
+
 	void operator()(from_headset::handshake &&) {}
 	void operator()(from_headset::headset_info_packet &&);
 	void operator()(from_headset::trackings &&);
@@ -165,9 +183,25 @@ public:
 		connection.send_control(std::forward<T>(packet));
 	}
 
+	bool tcp_only() const
+	{
+		return connection.tcp_only();
+	}
+	void set_video_budget(uint32_t bytes, std::chrono::nanoseconds duration)
+	{
+		connection.set_video_budget(bytes, duration);
+	}
+	bool video_backlogged()
+	{
+		return connection.video_backlogged();
+	}
+
 	std::array<to_headset::foveation_parameter, 2> set_foveated_size(uint32_t width, uint32_t height);
 	std::array<to_headset::foveation_parameter, 2> get_foveation_parameters();
-	bool apply_dynamic_foveation();
+	// narrowing: see wivrn_hmd::set_foveation, empty if foveation does not adapt to the link.
+	// With adaptive foveation, the high resolution region is widened while the
+	// link is clear and narrowed back to the configured foveation as it degrades
+	bool apply_dynamic_foveation(int64_t display_time_ns, std::optional<float> narrowing);
 	bool has_dynamic_foveation()
 	{
 		return (bool)foveation;
@@ -177,7 +211,10 @@ public:
 
 private:
 	void run(std::stop_token stop);
+	void update_tracking(const from_headset::tracking &, const sample_epoch &, const clock_offset &);
 	void reconnect();
+	// Number of packets of each class handled by the last poll, and their latency
+	void dump_dispatch_latency();
 
 	// xrt_system implementation
 	xrt_result_t get_roles(xrt_system_roles * out_roles);
@@ -0,0 +1,168 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "encoder_probe_cache.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#define JSON_DISABLE_ENUM_SERIALIZATION 1
+#ifdef JSON_DIAGNOSTICS
+#undef JSON_DIAGNOSTICS
+#endif
+#define JSON_DIAGNOSTICS 1
+#include <nlohmann/json.hpp>
+
+#include "util/u_logging.h"
+#include "utils/wivrn_vk_bundle.h"
+#include "utils/xdg_base_directory.h"
+#include "version.h"
+#include "wivrn_config.h"
+
+#if WIVRN_USE_VAAPI
+#include "ffmpeg/video_encoder_va.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+}
+#endif
+
+static std::filesystem::path cache_file = xdg_cache_home() / "wivrn" / "encoders.json";
+
+namespace wivrn
+{
+static std::string make_key(wivrn_vk_bundle & bundle)
+{
+	auto props = bundle.physical_device.getProperties();
+
+	nlohmann::json key{
+	        {"vendor_id", props.vendorID},
+	        {"device_id", props.deviceID},
+	        {"driver_version", props.driverVersion},
+	        {"wivrn", git_commit},
+	};
+
+#if WIVRN_USE_VAAPI
+	key["avcodec"] = avcodec_version();
+	key["avutil"] = avutil_version();
+
+	// The VA driver is not the Vulkan driver, it is updated and selected separately
+	try
+	{
+		key["va_driver"] = video_encoder_va::driver_version(bundle, std::nullopt);
+	}
+	catch (...)
+	{
+		key["va_driver"] = nullptr;
+	}
+	if (const char * driver_name = std::getenv("LIBVA_DRIVER_NAME"))
+		key["va_driver_name"] = driver_name;
+#endif
+
+	return key.dump();
+}
+
+encoder_probe_cache::encoder_probe_cache(wivrn_vk_bundle & bundle) :
+        key(make_key(bundle))
+{
+	if (not std::filesystem::exists(cache_file))
+		return;
+
+	try
+	{
+		std::ifstream file(cache_file);
+		auto json = nlohmann::json::parse(file);
+
+		if (json["key"] != key)
+		{
+			U_LOG_I("GPU, driver or libraries changed, encoders will be probed again");
+			return;
+		}
+
+		supported = json["supported"];
+		max_size = json["max_size"];
+		std::erase_if(supported, [](const auto & item) { return not item.second; });
+	}
+	catch (const std::exception & e)
+	{
+		U_LOG_W("Invalid encoder cache %s: %s", cache_file.c_str(), e.what());
+		supported.clear();
+		max_size.clear();
+	}
+}
+
+std::optional<bool> encoder_probe_cache::get_supported(const std::string & encoder)
+{
+	auto it = supported.find(encoder);
+	if (it == supported.end())
+		return std::nullopt;
+	return it->second;
+}
+
+void encoder_probe_cache::set_supported(const std::string & encoder, bool value)
+{
+	// A failed probe may come from a transient error, such as a device that
+	// cannot be opened: probe again on next start instead of remembering it
+	if (not value)
+	{
+		modified |= supported.erase(encoder) > 0;
+		return;
+	}
+	supported[encoder] = value;
+	modified = true;
+}
+
+std::optional<std::array<int, 2>> encoder_probe_cache::get_max_size(const std::string & encoder)
+{
+	auto it = max_size.find(encoder);
+	if (it == max_size.end())
+		return std::nullopt;
+	return it->second;
+}
+
+void encoder_probe_cache::set_max_size(const std::string & encoder, std::array<int, 2> value)
+{
+	max_size[encoder] = value;
+	modified = true;
+}
+
+void encoder_probe_cache::save()
+{
+	if (not modified)
+		return;
+
+	try
+	{
+		nlohmann::json json{
+		        {"key", key},
+		        {"supported", supported},
+		        {"max_size", max_size},
+		};
+
+		std::filesystem::create_directories(cache_file.parent_path());
+		std::ofstream(cache_file) << json.dump(1, '\t');
+		modified = false;
+	}
+	catch (const std::exception & e)
+	{
+		U_LOG_W("Cannot write encoder cache %s: %s", cache_file.c_str(), e.what());
+	}
+}
+} // namespace wivrn
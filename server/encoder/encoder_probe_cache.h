@@ -0,0 +1,52 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <map>
+#include <optional>
+#include <string>
+
+namespace wivrn
+{
+struct wivrn_vk_bundle;
+
+// Results of the encoder probes, which need to create test encoders.
+// They are stored on disk and discarded when the GPU, its Vulkan or VA
+// driver, the encoding libraries or WiVRn change.
+// Only successful probes are remembered, failures are probed again.
+class encoder_probe_cache
+{
+	std::string key;
+	std::map<std::string, bool> supported;
+	std::map<std::string, std::array<int, 2>> max_size;
+	bool modified = false;
+
+public:
+	encoder_probe_cache(wivrn_vk_bundle & bundle);
+
+	std::optional<bool> get_supported(const std::string & encoder);
+	void set_supported(const std::string & encoder, bool value);
+
+	std::optional<std::array<int, 2>> get_max_size(const std::string & encoder);
+	void set_max_size(const std::string & encoder, std::array<int, 2> value);
+
+	void save();
+};
+} // namespace wivrn
@@ -19,10 +19,12 @@
 
 #include "encoder_settings.h"
 #include "driver/configuration.h"
+#include "encoder_probe_cache.h"
 #include "util/u_logging.h"
 #include "utils/wivrn_vk_bundle.h"
 #include "video_encoder.h"
 
+#include <chrono>
 #include <cmath>
 #include <magic_enum.hpp>
 #include <string>
@@ -97,20 +99,30 @@ void print_encoders(const std::vector<wivrn::encoder_settings> & encoders)
 	}
 }
 
-static void check_scale(std::string_view encoder_name, video_codec codec, uint16_t width, uint16_t height, std::array<double, 2> & scale)
+static void check_scale(std::string_view encoder_name, video_codec codec, uint16_t width, uint16_t height, std::array<double, 2> & scale, encoder_probe_cache & cache)
 {
 #if WIVRN_USE_NVENC
 	if (encoder_name == encoder_nvenc)
 	{
-		auto max = VideoEncoderNvenc::get_max_size(codec);
-		if (width * scale[0] > max[0])
+		std::string probe_name = "nvenc/" + std::string(magic_enum::enum_name(codec));
+		auto max = cache.get_max_size(probe_name);
+		if (not max)
 		{
-			scale[0] = double(max[0] - 1) / width;
+			auto start = std::chrono::steady_clock::now();
+			max = VideoEncoderNvenc::get_max_size(codec);
+			U_LOG_I("Probed nvenc %s in %.1fms",
+			        std::string(magic_enum::enum_name(codec)).c_str(),
+			        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+			cache.set_max_size(probe_name, *max);
+		}
+		if (width * scale[0] > (*max)[0])
+		{
+			scale[0] = double((*max)[0] - 1) / width;
 			U_LOG_W("Image is too wide for encoder, reducing scale to %f", scale[0]);
 		}
-		if (height * scale[1] > max[1])
+		if (height * scale[1] > (*max)[1])
 		{
-			scale[1] = double(max[1] - 1) / width;
+			scale[1] = double((*max)[1] - 1) / height;
 			U_LOG_W("Image is too tall for encoder, reducing scale to %f", scale[1]);
 		}
 	}
@@ -133,7 +145,7 @@ static constexpr auto ffmpeg_version()
 	return result;
 }
 
-static std::optional<wivrn::video_codec> filter_codecs_vaapi(wivrn_vk_bundle & bundle, const std::vector<wivrn::video_codec> & codecs)
+static std::optional<wivrn::video_codec> filter_codecs_vaapi(wivrn_vk_bundle & bundle, const std::vector<wivrn::video_codec> & codecs, encoder_probe_cache & cache)
 {
 	VideoEncoderFFMPEG::mute_logs mute;
 	encoder_settings s{
@@ -156,14 +168,29 @@ static std::optional<wivrn::video_codec> filter_codecs_vaapi(wivrn_vk_bundle & b
 				continue;
 			}
 		}
-		try
+		std::string codec_name(magic_enum::enum_name(codec));
+		auto supported = cache.get_supported("vaapi/" + codec_name);
+		if (not supported)
 		{
-			s.codec = codec;
-			video_encoder_va test(bundle, s, 60);
-			return codec;
+			auto start = std::chrono::steady_clock::now();
+			try
+			{
+				s.codec = codec;
+				video_encoder_va test(bundle, s, 60);
+				supported = true;
+			}
+			catch (...)
+			{
+				supported = false;
+			}
+			U_LOG_I("Probed vaapi %s in %.1fms",
+			        codec_name.c_str(),
+			        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+			cache.set_supported("vaapi/" + codec_name, *supported);
 		}
-		catch (...)
-		{}
+
+		if (*supported)
+			return codec;
 
 		U_LOG_I("Video codec %s not supported", std::string(magic_enum::enum_name(codec)).c_str());
 	}
@@ -172,7 +199,7 @@ static std::optional<wivrn::video_codec> filter_codecs_vaapi(wivrn_vk_bundle & b
 }
 #endif
 
-static void fill_defaults(wivrn_vk_bundle & bundle, const std::vector<wivrn::video_codec> & headset_codecs, configuration::encoder & config)
+static void fill_defaults(wivrn_vk_bundle & bundle, const std::vector<wivrn::video_codec> & headset_codecs, configuration::encoder & config, encoder_probe_cache & cache)
 {
 	if (config.name.empty())
 	{
@@ -205,7 +232,7 @@ static void fill_defaults(wivrn_vk_bundle & bundle, const std::vector<wivrn::vid
 #if WIVRN_USE_VAAPI
 	if (config.name == encoder_vaapi and not config.codec)
 	{
-		config.codec = filter_codecs_vaapi(bundle, headset_codecs);
+		config.codec = filter_codecs_vaapi(bundle, headset_codecs, cache);
 		if (not config.codec)
 		{
 			U_LOG_W("Failed to initialize vaapi, fallback to software encoding");
@@ -224,10 +251,10 @@ static void fill_defaults(wivrn_vk_bundle & bundle, const std::vector<wivrn::vid
 		config.codec = h265;
 }
 
-static std::vector<configuration::encoder> get_encoder_default_settings(wivrn_vk_bundle & bundle, const std::vector<wivrn::video_codec> & headset_codecs)
+static std::vector<configuration::encoder> get_encoder_default_settings(wivrn_vk_bundle & bundle, const std::vector<wivrn::video_codec> & headset_codecs, encoder_probe_cache & cache)
 {
 	configuration::encoder base;
-	fill_defaults(bundle, headset_codecs, base);
+	fill_defaults(bundle, headset_codecs, base, cache);
 
 #ifdef WIVRN_SPLIT_ENCODERS
 	if (base.name != encoder_x264)
@@ -293,22 +320,25 @@ std::vector<encoder_settings> get_encoder_settings(wivrn_vk_bundle & bundle, uin
 	{
 		U_LOG_E("Failed to read encoder configuration: %s", e.what());
 	}
+	encoder_probe_cache cache(bundle);
 	if (config.encoders.empty())
-		config.encoders = get_encoder_default_settings(bundle, info.supported_codecs);
+		config.encoders = get_encoder_default_settings(bundle, info.supported_codecs, cache);
 	uint64_t bitrate = config.bitrate.value_or(default_bitrate);
 	std::array<double, 2> default_scale;
 	default_scale.fill(info.eye_gaze ? 0.35 : 0.5);
 	auto scale = config.scale.value_or(default_scale);
 	for (auto & encoder: config.encoders)
 	{
-		fill_defaults(bundle, info.supported_codecs, encoder);
+		fill_defaults(bundle, info.supported_codecs, encoder, cache);
 		assert(encoder.codec);
 		check_scale(encoder.name,
 		            *encoder.codec,
 		            std::ceil(encoder.width.value_or(1) * width),
 		            std::ceil(encoder.height.value_or(1) * height),
-		            scale);
+		            scale,
+		            cache);
 	}
+	cache.save();
 
 	width *= scale[0];
 	width += width % 2;
@@ -351,6 +381,7 @@ std::vector<encoder_settings> get_encoder_settings(wivrn_vk_bundle & bundle, uin
 		}
 		settings.options = encoder.options;
 		settings.device = encoder.device;
+		settings.dynamic_rate = config.adaptive_refresh_rate or config.adaptive_foveation;
 
 		res.push_back(settings);
 	}
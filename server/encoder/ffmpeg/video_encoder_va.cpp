@@ -38,6 +38,7 @@ extern "C"
 #include <libavcodec/avcodec.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/hwcontext_drm.h>
+#include <libavutil/hwcontext_vaapi.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
 }
@@ -111,6 +112,15 @@ av_buffer_ptr make_drm_hw_ctx(vk::raii::PhysicalDevice & physical_device, const
 	return av_buffer_ptr(hw_ctx);
 }
 
+av_buffer_ptr make_vaapi_hw_ctx(AVBufferRef * drm_hw_ctx)
+{
+	AVBufferRef * hw_ctx;
+	int err = av_hwdevice_ctx_create_derived(&hw_ctx, AV_HWDEVICE_TYPE_VAAPI, drm_hw_ctx, 0);
+	if (err)
+		throw std::system_error(err, av_error_category(), "FFMPEG vaapi hardware context creation failed");
+	return av_buffer_ptr(hw_ctx);
+}
+
 std::unordered_map<uint32_t, vk::Format> vulkan_drm_format_map = {
         {DRM_FORMAT_R8, vk::Format::eR8Unorm},
         {DRM_FORMAT_R16, vk::Format::eR16Unorm},
@@ -131,18 +141,23 @@ vk::Format drm_to_vulkan_fmt(uint32_t drm_fourcc)
 
 } // namespace
 
+std::string video_encoder_va::driver_version(wivrn_vk_bundle & vk, const std::optional<std::string> & device)
+{
+	auto drm_hw_ctx = make_drm_hw_ctx(vk.physical_device, device);
+	auto vaapi_hw_ctx = make_vaapi_hw_ctx(drm_hw_ctx.get());
+
+	auto * hw_ctx = reinterpret_cast<AVHWDeviceContext *>(vaapi_hw_ctx->data);
+	auto * va_ctx = static_cast<AVVAAPIDeviceContext *>(hw_ctx->hwctx);
+	const char * vendor = vaQueryVendorString(va_ctx->display);
+	return vendor ? vendor : "";
+}
+
 video_encoder_va::video_encoder_va(wivrn_vk_bundle & vk, wivrn::encoder_settings & settings, float fps) :
         synchronization2(vk.vk.features.synchronization_2)
 {
 	auto drm_hw_ctx = make_drm_hw_ctx(vk.physical_device, settings.device);
+	auto vaapi_hw_ctx = make_vaapi_hw_ctx(drm_hw_ctx.get());
 	AVBufferRef * tmp;
-	int err = av_hwdevice_ctx_create_derived(&tmp,
-	                                         AV_HWDEVICE_TYPE_VAAPI,
-	                                         drm_hw_ctx.get(),
-	                                         0);
-	if (err)
-		throw std::system_error(err, av_error_category(), "FFMPEG vaapi hardware context creation failed");
-	av_buffer_ptr vaapi_hw_ctx(tmp);
 
 	settings.video_width += settings.video_width % 2;
 	settings.video_height += settings.video_height % 2;
@@ -161,11 +176,11 @@ video_encoder_va::video_encoder_va(wivrn_vk_bundle & vk, wivrn::encoder_settings
 	                .height = settings.height,
 	        }};
 
-	err = av_hwframe_ctx_create_derived(&tmp,
-	                                    AV_PIX_FMT_DRM_PRIME,
-	                                    drm_hw_ctx.get(),
-	                                    vaapi_frame_ctx.get(),
-	                                    AV_HWFRAME_MAP_DIRECT);
+	int err = av_hwframe_ctx_create_derived(&tmp,
+	                                        AV_PIX_FMT_DRM_PRIME,
+	                                        drm_hw_ctx.get(),
+	                                        vaapi_frame_ctx.get(),
+	                                        AV_HWFRAME_MAP_DIRECT);
 	if (err < 0)
 	{
 		throw std::system_error(err, av_error_category(), "Cannot create drm frame context");
@@ -471,6 +486,14 @@ void video_encoder_va::push_frame(bool idr, std::chrono::steady_clock::time_poin
 	auto & va_frame = in[slot].va_frame;
 	va_frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_P;
 	va_frame->pts = pts.time_since_epoch().count();
+	// ffmpeg sets up the VAAPI rate control when the encoder is opened and does
+	// not read bit_rate or framerate again: the stream keeps the configured
+	// bitrate, only the foveation and the refresh rate adapt
+	if (take_rate() and not rate_change_ignored)
+	{
+		U_LOG_W("Stream %d: the vaapi encoder cannot change its bitrate while streaming", stream_idx);
+		rate_change_ignored = true;
+	}
 	int err = avcodec_send_frame(encoder_ctx.get(), va_frame.get());
 	if (err)
 	{
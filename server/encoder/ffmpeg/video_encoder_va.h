@@ -24,6 +24,8 @@
 
 #include <array>
 #include <chrono>
+#include <optional>
+#include <string>
 #include <vector>
 #include <vulkan/vulkan_raii.hpp>
 
@@ -46,10 +48,15 @@ class video_encoder_va : public VideoEncoderFFMPEG
 	std::array<in_t, num_slots> in;
 	vk::Rect2D rect;
 	bool synchronization2 = false;
+	// set_rate was called, see push_frame
+	bool rate_change_ignored = false;
 
 public:
 	video_encoder_va(wivrn_vk_bundle &, wivrn::encoder_settings & settings, float fps);
 
+	// Vendor string of the VA driver used for the device, which includes its version
+	static std::string driver_version(wivrn_vk_bundle &, const std::optional<std::string> & device);
+
 	void present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf, uint8_t slot) override;
 
 protected:
@@ -25,6 +25,8 @@
 #include "encoder_settings.h"
 #include "os/os_time.h"
 #include "util/u_logging.h"
+#include "utils/thread_policy.h"
+#include "video_shards.h"
 #include "wivrn_config.h"
 
 #include <string>
@@ -48,6 +50,7 @@ namespace wivrn
 
 VideoEncoder::sender::sender() :
         thread([this](std::stop_token t) {
+	        set_thread_policy("encoder sender");
 	        while (not t.stop_requested())
 	        {
 		        data * d = nullptr;
@@ -100,6 +103,12 @@ std::shared_ptr<VideoEncoder::sender> VideoEncoder::sender::get()
 	return s;
 }
 
+bool VideoEncoder::supports_mapped_image(const encoder_settings & settings)
+{
+	// Only software encoders read the image from the CPU
+	return settings.encoder_name == encoder_x264;
+}
+
 std::unique_ptr<VideoEncoder> VideoEncoder::Create(
         wivrn_vk_bundle & wivrn_vk,
         encoder_settings & settings,
@@ -231,6 +240,21 @@ void VideoEncoder::reset()
 	sync_needed = true;
 }
 
+void VideoEncoder::set_rate(uint64_t bitrate, float fps)
+{
+	std::lock_guard lock(rate_mutex);
+	pending_rate.emplace(bitrate, fps);
+}
+
+std::optional<std::pair<uint64_t, float>> VideoEncoder::take_rate()
+{
+	std::lock_guard lock(rate_mutex);
+	auto rate = std::exchange(pending_rate, std::nullopt);
+	if (rate)
+		U_LOG_D("Stream %d: bitrate %ldMbit/s, %.2f fps", stream_idx, rate->first / 1'000'000, rate->second);
+	return rate;
+}
+
 void VideoEncoder::present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf)
 {
 	// Wait for encoder to be done
@@ -241,6 +265,15 @@ void VideoEncoder::present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd
 	next_present = (next_present + 1) % num_slots;
 }
 
+void VideoEncoder::present_image(const mapped_image & y_cbcr)
+{
+	busy[next_present].wait(true);
+
+	busy[next_present] = true;
+	present_image(y_cbcr, next_present);
+	next_present = (next_present + 1) % num_slots;
+}
+
 void VideoEncoder::present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & video_cmd_buf, vk::Fence fence, uint64_t frame_index)
 {
 	present_image(y_cbcr, video_cmd_buf, fence, next_present, frame_index);
@@ -283,8 +316,14 @@ void VideoEncoder::Encode(wivrn_session & cnx,
 	std::exception_ptr ex;
 	try
 	{
+		gpu_encode_time.reset();
 		auto data = encode(idr, target_timestamp, next_encode);
 		cnx.dump_time("encode_end", frame_index, os_monotonic_get_ns(), stream_idx, extra);
+		if (gpu_encode_time)
+		{
+			cnx.dump_time("gpu_encode_begin", frame_index, gpu_encode_time->first, stream_idx, extra);
+			cnx.dump_time("gpu_encode_end", frame_index, gpu_encode_time->second, stream_idx, extra);
+		}
 		if (data)
 		{
 			timing_info.encode_end = clock.to_headset(os_monotonic_get_ns());
@@ -316,19 +355,34 @@ void VideoEncoder::SendData(std::span<uint8_t> data, bool end_of_frame)
 		video_dump.write((char *)data.data(), data.size());
 	if (shard.shard_idx == 0)
 	{
-		cnx->dump_time("send_begin", shard.frame_idx, os_monotonic_get_ns(), stream_idx);
-		timing_info.send_begin = clock.to_headset(os_monotonic_get_ns());
+		// Sending a frame behind a backlog only makes it later, the decoder
+		// recovers from the missing frame as it would from a lost one
+		frame_dropped = cnx->video_backlogged();
+		if (frame_dropped)
+		{
+			U_LOG_D("Link backed up, dropping frame: stream %d frame %ld", stream_idx, shard.frame_idx);
+			cnx->dump_time("drop", shard.frame_idx, os_monotonic_get_ns(), stream_idx);
+			sync_needed = true;
+		}
+		else
+		{
+			cnx->dump_time("send_begin", shard.frame_idx, os_monotonic_get_ns(), stream_idx);
+			timing_info.send_begin = clock.to_headset(os_monotonic_get_ns());
+		}
+	}
+	if (frame_dropped)
+	{
+		// Remaining slices of the frame are dropped too
+		++shard.shard_idx;
+		return;
 	}
 
+	const size_t shard_size = cnx->tcp_only() ? to_headset::video_stream_data_shard::max_tcp_payload_size : to_headset::video_stream_data_shard::max_payload_size;
+	const size_t view_info_size = shard.view_info ? sizeof(to_headset::video_stream_data_shard::view_info_t) : 0;
+
 	shard.flags = to_headset::video_stream_data_shard::start_of_slice;
-	auto begin = data.begin();
-	auto end = data.end();
-	while (begin != end)
-	{
-		const size_t view_info_size = sizeof(to_headset::video_stream_data_shard::view_info_t);
-		const size_t max_payload_size = to_headset::video_stream_data_shard::max_payload_size - (shard.view_info ? view_info_size : 0);
-		auto next = std::min(end, begin + max_payload_size);
-		if (next == end)
+	split_shards(data, shard_size, view_info_size, [&](std::span<uint8_t> payload, bool last) {
+		if (last)
 		{
 			shard.flags |= to_headset::video_stream_data_shard::end_of_slice;
 			if (end_of_frame)
@@ -337,7 +391,7 @@ void VideoEncoder::SendData(std::span<uint8_t> data, bool end_of_frame)
 				shard.timing_info = timing_info;
 			}
 		}
-		shard.payload = {begin, next};
+		shard.payload = payload;
 		try
 		{
 			cnx->send_stream(shard);
@@ -349,8 +403,7 @@ void VideoEncoder::SendData(std::span<uint8_t> data, bool end_of_frame)
 		++shard.shard_idx;
 		shard.flags = 0;
 		shard.view_info.reset();
-		begin = next;
-	}
+	});
 	if (end_of_frame)
 		cnx->dump_time("send_end", shard.frame_idx, os_monotonic_get_ns(), stream_idx);
 }
@@ -30,6 +30,7 @@
 #include <fstream>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <thread>
 #include <vulkan/vulkan_raii.hpp>
 
@@ -47,6 +48,16 @@ inline const char * encoder_vulkan = "vulkan";
 
 class VideoEncoder
 {
+public:
+	// NV12 image in linear host visible memory, valid until the frame is encoded
+	struct mapped_image
+	{
+		uint8_t * luma;
+		uint8_t * chroma;
+		size_t luma_stride;
+		size_t chroma_stride;
+	};
+
 protected:
 	struct data
 	{
@@ -92,9 +103,14 @@ private:
 
 	std::atomic_bool sync_needed = true;
 	uint64_t last_idr_frame;
+	// TCP only: the current frame is not sent because the link is backed up
+	bool frame_dropped = false;
 
 	std::ofstream video_dump;
 
+	std::mutex rate_mutex;
+	std::optional<std::pair<uint64_t, float>> pending_rate;
+
 	std::shared_ptr<sender> shared_sender;
 
 public:
@@ -113,13 +129,20 @@ public:
 	VideoEncoder(bool async_send = false);
 	virtual ~VideoEncoder();
 
+	// Whether the encoder can read a mapped_image instead of having the image copied
+	static bool supports_mapped_image(const encoder_settings &);
+
 	void present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf);
+	void present_image(const mapped_image & y_cbcr);
 	// for vulkan video (command buffer is on a video queue)
 	void present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf, vk::Fence fence, uint64_t frame_index);
 
 	virtual void on_feedback(const from_headset::feedback &);
 	virtual void reset();
 
+	// Changes the rate control target, applied before the next frame is encoded
+	void set_rate(uint64_t bitrate, float fps);
+
 	void Encode(wivrn_session & cnx,
 	            const to_headset::video_stream_data_shard::view_info_t & view_info,
 	            uint64_t frame_index);
@@ -127,10 +150,17 @@ public:
 protected:
 	// called on present to submit command buffers for the image.
 	virtual void present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf, uint8_t slot) {};
+	// called on present when the image is host mapped, only if supports_mapped_image is true
+	virtual void present_image(const mapped_image & y_cbcr, uint8_t slot) {};
 	// for vulkan video (command buffer is on a video queue)
 	virtual void present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf, vk::Fence, uint8_t slot, uint64_t frame_index) {};
 	// called when command buffer finished executing
 	virtual std::optional<data> encode(bool idr, std::chrono::steady_clock::time_point target_timestamp, uint8_t slot) = 0;
+	// set by encode if the encoder measured its GPU execution
+	std::optional<std::pair<int64_t, int64_t>> gpu_encode_time;
+	// bitrate and frame rate requested by set_rate since the last call, encoders
+	// which support it apply them to the next frame they submit
+	std::optional<std::pair<uint64_t, float>> take_rate();
 
 	void SendData(std::span<uint8_t> data, bool end_of_frame);
 };
@@ -195,37 +195,37 @@ VideoEncoderNvenc::VideoEncoderNvenc(wivrn_vk_bundle & vk, encoder_settings & se
 	        }};
 	NVENC_CHECK(fn.nvEncGetEncodePresetConfig(session_handle, encodeGUID, presetGUID, &preset_config));
 
-	NV_ENC_CONFIG params = preset_config.presetCfg;
+	config = preset_config.presetCfg;
 
 	// Bitrate control
-	params.rcParams.rateControlMode = NV_ENC_PARAMS_RC_CBR_LOWDELAY_HQ;
-	params.rcParams.averageBitRate = bitrate;
-	params.rcParams.maxBitRate = bitrate;
-	params.rcParams.vbvBufferSize = bitrate / fps;
-	params.rcParams.vbvInitialDelay = bitrate / fps;
+	config.rcParams.rateControlMode = NV_ENC_PARAMS_RC_CBR_LOWDELAY_HQ;
+	config.rcParams.averageBitRate = bitrate;
+	config.rcParams.maxBitRate = bitrate;
+	config.rcParams.vbvBufferSize = bitrate / fps;
+	config.rcParams.vbvInitialDelay = bitrate / fps;
 
-	params.gopLength = NVENC_INFINITE_GOPLENGTH;
-	params.frameIntervalP = 1;
+	config.gopLength = NVENC_INFINITE_GOPLENGTH;
+	config.frameIntervalP = 1;
 
 	switch (settings.codec)
 	{
 		case video_codec::h264:
-			params.encodeCodecConfig.h264Config.repeatSPSPPS = 1;
-			params.encodeCodecConfig.h264Config.maxNumRefFrames = 0;
-			params.encodeCodecConfig.h264Config.idrPeriod = NVENC_INFINITE_GOPLENGTH;
-			params.encodeCodecConfig.h264Config.h264VUIParameters.videoFullRangeFlag = 1;
+			config.encodeCodecConfig.h264Config.repeatSPSPPS = 1;
+			config.encodeCodecConfig.h264Config.maxNumRefFrames = 0;
+			config.encodeCodecConfig.h264Config.idrPeriod = NVENC_INFINITE_GOPLENGTH;
+			config.encodeCodecConfig.h264Config.h264VUIParameters.videoFullRangeFlag = 1;
 			break;
 		case video_codec::h265:
-			params.encodeCodecConfig.hevcConfig.repeatSPSPPS = 1;
-			params.encodeCodecConfig.hevcConfig.maxNumRefFramesInDPB = 0;
-			params.encodeCodecConfig.hevcConfig.idrPeriod = NVENC_INFINITE_GOPLENGTH;
-			params.encodeCodecConfig.hevcConfig.hevcVUIParameters.videoFullRangeFlag = 1;
+			config.encodeCodecConfig.hevcConfig.repeatSPSPPS = 1;
+			config.encodeCodecConfig.hevcConfig.maxNumRefFramesInDPB = 0;
+			config.encodeCodecConfig.hevcConfig.idrPeriod = NVENC_INFINITE_GOPLENGTH;
+			config.encodeCodecConfig.hevcConfig.hevcVUIParameters.videoFullRangeFlag = 1;
 			break;
 		case video_codec::av1:
 			break;
 	}
 
-	NV_ENC_INITIALIZE_PARAMS params2{
+	init_params = NV_ENC_INITIALIZE_PARAMS{
 	        .version = NV_ENC_INITIALIZE_PARAMS_VER,
 	        .encodeGUID = encodeGUID,
 	        .presetGUID = presetGUID,
@@ -237,9 +237,9 @@ VideoEncoderNvenc::VideoEncoderNvenc(wivrn_vk_bundle & vk, encoder_settings & se
 	        .frameRateDen = 1,
 	        .enableEncodeAsync = 0,
 	        .enablePTD = 1,
-	        .encodeConfig = &params,
+	        .encodeConfig = &config,
 	};
-	NVENC_CHECK(fn.nvEncInitializeEncoder(session_handle, &params2));
+	NVENC_CHECK(fn.nvEncInitializeEncoder(session_handle, &init_params));
 
 	NV_ENC_CREATE_BITSTREAM_BUFFER params3{
 	        .version = NV_ENC_CREATE_BITSTREAM_BUFFER_VER,
@@ -371,6 +371,9 @@ void VideoEncoderNvenc::present_image(vk::Image y_cbcr, vk::raii::CommandBuffer
 
 std::optional<VideoEncoder::data> VideoEncoderNvenc::encode(bool idr, std::chrono::steady_clock::time_point pts, uint8_t slot)
 {
+	if (auto rate = take_rate())
+		update_rate(rate->first, rate->second);
+
 	CU_CHECK(cuda_fn->cuCtxPushCurrent(cuda));
 
 	NV_ENC_MAP_INPUT_RESOURCE param4{};
@@ -412,6 +415,29 @@ std::optional<VideoEncoder::data> VideoEncoderNvenc::encode(bool idr, std::chron
 	};
 }
 
+void VideoEncoderNvenc::update_rate(uint64_t bitrate, float fps)
+{
+	this->bitrate = bitrate;
+	this->fps = fps;
+	config.rcParams.averageBitRate = bitrate;
+	config.rcParams.maxBitRate = bitrate;
+	config.rcParams.vbvBufferSize = bitrate / fps;
+	config.rcParams.vbvInitialDelay = bitrate / fps;
+	init_params.frameRateNum = (uint32_t)fps;
+
+	NV_ENC_RECONFIGURE_PARAMS params{
+	        .version = NV_ENC_RECONFIGURE_PARAMS_VER,
+	        .reInitEncodeParams = init_params,
+	        .resetEncoder = 0,
+	        .forceIDR = 0,
+	};
+	CU_CHECK(cuda_fn->cuCtxPushCurrent(cuda));
+	NVENCSTATUS status = fn.nvEncReconfigureEncoder(session_handle, &params);
+	CU_CHECK(cuda_fn->cuCtxPopCurrent(NULL));
+	if (status != NV_ENC_SUCCESS)
+		U_LOG_W("nvEncReconfigureEncoder failed: %d, %s", status, fn.nvEncGetLastErrorString(session_handle));
+}
+
 std::array<int, 2> VideoEncoderNvenc::get_max_size(video_codec codec)
 {
 	auto [cuda_fn, nvenc_fn, fn, cuda, session_handle] = init();
@@ -62,6 +62,11 @@ private:
 	uint32_t height;
 	float fps;
 	int bitrate;
+	// kept to change the rate control
+	NV_ENC_CONFIG config;
+	NV_ENC_INITIALIZE_PARAMS init_params;
+
+	void update_rate(uint64_t bitrate, float fps);
 
 public:
 	VideoEncoderNvenc(wivrn_vk_bundle & vk, encoder_settings & settings, float fps);
@@ -52,7 +52,7 @@ vk::VideoFormatPropertiesKHR wivrn::video_encoder_vulkan::select_video_format(
 }
 
 wivrn::video_encoder_vulkan::video_encoder_vulkan(wivrn_vk_bundle & vk, vk::Rect2D rect, vk::VideoEncodeCapabilitiesKHR in_encode_caps, float fps, uint64_t bitrate) :
-        VideoEncoder(true), vk(vk), encode_caps(patch_capabilities(in_encode_caps)), rect(rect), fps(fps)
+        VideoEncoder(true), vk(vk), encode_caps(patch_capabilities(in_encode_caps)), timestamps(vk, vk.encode_queue_family_index, 2), rect(rect), fps(fps)
 {
 	// Initialize Rate control
 	U_LOG_D("Supported rate control modes: %s", vk::to_string(encode_caps.rateControlModes).c_str());
@@ -338,6 +338,9 @@ std::optional<wivrn::VideoEncoder::data> wivrn::video_encoder_vulkan::encode(boo
 		std::cerr << "device.getQueryPoolResults: " << vk::to_string(res) << std::endl;
 	}
 
+	if (auto t = timestamps.read(); not t.empty())
+		gpu_encode_time = {t[0], t[1]};
+
 	return data{
 	        .encoder = this,
 	        .span = std::span(((uint8_t *)output_buffer.map()) + feedback[0], feedback[1]),
@@ -358,6 +361,8 @@ void wivrn::video_encoder_vulkan::present_image(vk::Image src_yuv, vk::raii::Com
 	}
 
 	command_buffer.resetQueryPool(*query_pool, 0, 1);
+	timestamps.reset(command_buffer);
+	timestamps.write(command_buffer, vk::PipelineStageFlagBits2::eTopOfPipe, 0);
 
 	auto slot = std::ranges::min_element(
 	        dpb,
@@ -407,6 +412,20 @@ void wivrn::video_encoder_vulkan::present_image(vk::Image src_yuv, vk::raii::Com
 	slot->frame_index = frame_index;
 	slot->info.pPictureResource = &slot->resource;
 
+	// The rate control state of the session can only change inside a video coding scope
+	std::optional<vk::VideoEncodeRateControlLayerInfoKHR> new_rate_control_layer;
+	if (auto rate = take_rate(); rate and rate_control)
+	{
+		new_rate_control_layer = rate_control_layer;
+		new_rate_control_layer->averageBitrate = std::min(rate->first, encode_caps.maxBitrate);
+		new_rate_control_layer->maxBitrate = rate_control->rateControlMode == vk::VideoEncodeRateControlModeFlagBitsKHR::eCbr
+		                                             ? new_rate_control_layer->averageBitrate
+		                                             : std::min(2 * rate->first, encode_caps.maxBitrate);
+		new_rate_control_layer->frameRateNumerator = uint32_t(rate->second * 1'000'000);
+		if (not session_initialized)
+			rate_control_layer = *std::exchange(new_rate_control_layer, std::nullopt);
+	}
+
 	command_buffer.beginVideoCodingKHR({
 	        .pNext = (session_initialized and rate_control) ? &rate_control.value() : nullptr,
 	        .videoSession = *video_session,
@@ -451,6 +470,16 @@ void wivrn::video_encoder_vulkan::present_image(vk::Image src_yuv, vk::raii::Com
 		});
 		session_initialized = true;
 	}
+	else if (new_rate_control_layer)
+	{
+		vk::VideoEncodeRateControlInfoKHR new_rate_control = *rate_control;
+		new_rate_control.pLayers = &*new_rate_control_layer;
+		command_buffer.controlVideoCodingKHR({
+		        .pNext = &new_rate_control,
+		        .flags = vk::VideoCodingControlFlagBitsKHR::eEncodeRateControl,
+		});
+		rate_control_layer = *new_rate_control_layer;
+	}
 
 	vk::VideoEncodeInfoKHR encode_info{
 	        .pNext = encode_info_next(frame_num, slot_index, ref_slot ? std::make_optional(ref_slot->info.slotIndex) : std::nullopt),
@@ -471,6 +500,7 @@ void wivrn::video_encoder_vulkan::present_image(vk::Image src_yuv, vk::raii::Com
 	command_buffer.encodeVideoKHR(encode_info);
 	command_buffer.endQuery(*query_pool, 0);
 	command_buffer.endVideoCodingKHR(vk::VideoEndCodingInfoKHR{});
+	timestamps.write(command_buffer, vk::PipelineStageFlagBits2::eVideoEncodeKHR, 1);
 	command_buffer.end();
 
 	++frame_num;
@@ -21,6 +21,7 @@
 #include <vector>
 #include <vulkan/vulkan_raii.hpp>
 
+#include "utils/gpu_timestamps.h"
 #include "video_encoder.h"
 #include "vk/allocation.h"
 
@@ -35,6 +36,7 @@ class video_encoder_vulkan : public VideoEncoder
 	vk::raii::VideoSessionParametersKHR video_session_parameters = nullptr;
 
 	vk::raii::QueryPool query_pool = nullptr;
+	gpu_timestamps timestamps;
 
 	buffer_allocation output_buffer;
 	size_t output_buffer_size;
@@ -124,6 +124,7 @@ VideoEncoderX264::VideoEncoderX264(
 	param.i_log_level = X264_LOG_WARNING;
 	param.i_fps_num = fps * 1'000'000;
 	param.i_fps_den = 1'000'000;
+	initial_fps = fps;
 	param.b_repeat_headers = 1;
 	param.b_aud = 0;
 	param.i_keyint_max = X264_KEYINT_MAX_INFINITE;
@@ -138,6 +139,12 @@ VideoEncoderX264::VideoEncoderX264(
 	param.vui.i_sar_height = settings.height;
 	param.rc.i_rc_method = X264_RC_ABR;
 	param.rc.i_bitrate = settings.bitrate / 1000; // x264 uses kbit/s
+	if (settings.dynamic_rate)
+	{
+		// x264_encoder_reconfig only changes the bitrate when VBV is enabled
+		param.rc.i_vbv_max_bitrate = param.rc.i_bitrate;
+		param.rc.i_vbv_buffer_size = param.rc.i_bitrate / fps;
+	}
 	enc = x264_encoder_open(&param);
 	if (not enc)
 	{
@@ -183,6 +190,12 @@ VideoEncoderX264::VideoEncoderX264(
 
 void VideoEncoderX264::present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf, uint8_t slot)
 {
+	auto & pic = in[slot].pic;
+	pic.img.i_stride[0] = chroma_width * 2;
+	pic.img.plane[0] = (uint8_t *)in[slot].luma.map();
+	pic.img.i_stride[1] = chroma_width * 2;
+	pic.img.plane[1] = (uint8_t *)in[slot].chroma.map();
+
 	cmd_buf.copyImageToBuffer(
 	        y_cbcr,
 	        vk::ImageLayout::eTransferSrcOptimal,
@@ -223,10 +236,23 @@ void VideoEncoderX264::present_image(vk::Image y_cbcr, vk::raii::CommandBuffer &
 	                }});
 }
 
+void VideoEncoderX264::present_image(const mapped_image & y_cbcr, uint8_t slot)
+{
+	// Read the frame directly from the pseudo-swapchain image
+	auto & pic = in[slot].pic;
+	pic.img.i_stride[0] = y_cbcr.luma_stride;
+	pic.img.plane[0] = y_cbcr.luma + rect.offset.y * y_cbcr.luma_stride + rect.offset.x;
+	pic.img.i_stride[1] = y_cbcr.chroma_stride;
+	pic.img.plane[1] = y_cbcr.chroma + rect.offset.y / 2 * y_cbcr.chroma_stride + rect.offset.x;
+}
+
 std::optional<VideoEncoder::data> VideoEncoderX264::encode(bool idr, std::chrono::steady_clock::time_point pts, uint8_t slot)
 {
 	int num_nal;
 	x264_nal_t * nal;
+	if (auto rate = take_rate())
+		update_rate(rate->first, rate->second);
+
 	auto & pic = in[slot].pic;
 	pic.i_type = idr ? X264_TYPE_IDR : X264_TYPE_P;
 	pic.i_pts = pts.time_since_epoch().count();
@@ -244,6 +270,18 @@ std::optional<VideoEncoder::data> VideoEncoderX264::encode(bool idr, std::chrono
 	return {};
 }
 
+void VideoEncoderX264::update_rate(uint64_t bitrate, float fps)
+{
+	// x264_encoder_reconfig ignores the frame rate and keeps budgeting
+	// bitrate / initial_fps per frame: scale the bitrate so that each frame
+	// gets bitrate / fps
+	param.rc.i_bitrate = bitrate * (initial_fps / fps) / 1000;
+	param.rc.i_vbv_max_bitrate = param.rc.i_bitrate;
+	param.rc.i_vbv_buffer_size = param.rc.i_bitrate / initial_fps;
+	if (int err = x264_encoder_reconfig(enc, &param); err < 0)
+		U_LOG_W("x264_encoder_reconfig failed: %d", err);
+}
+
 VideoEncoderX264::~VideoEncoderX264()
 {
 	x264_encoder_close(enc);
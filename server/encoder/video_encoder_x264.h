@@ -34,6 +34,8 @@ class VideoEncoderX264 : public VideoEncoder
 {
 	x264_param_t param = {};
 	x264_t * enc;
+	// Frame rate the encoder was opened with
+	float initial_fps;
 
 	x264_picture_t pic_out = {};
 
@@ -64,12 +66,15 @@ public:
 	VideoEncoderX264(wivrn_vk_bundle & vk, encoder_settings & settings, float fps);
 
 	void present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf, uint8_t slot) override;
+	void present_image(const mapped_image & y_cbcr, uint8_t slot) override;
 
 	std::optional<data> encode(bool idr, std::chrono::steady_clock::time_point pts, uint8_t slot) override;
 
 	~VideoEncoderX264();
 
 private:
+	void update_rate(uint64_t bitrate, float fps);
+
 	static void ProcessCb(x264_t * h, x264_nal_t * nal, void * opaque);
 
 	void ProcessNal(pending_nal && nal);
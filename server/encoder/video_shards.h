@@ -0,0 +1,45 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace wivrn
+{
+
+// Splits an encoded slice in shard payloads of at most shard_size bytes, the
+// first shard also carries first_overhead bytes of view information.
+// Calls f(payload, last) for each payload, nothing for an empty slice.
+template <typename F>
+void split_shards(std::span<uint8_t> data, size_t shard_size, size_t first_overhead, F && f)
+{
+	size_t max_payload_size = shard_size - first_overhead;
+	while (not data.empty())
+	{
+		size_t size = std::min(data.size(), max_payload_size);
+		f(data.first(size), size == data.size());
+		data = data.subspan(size);
+		max_payload_size = shard_size;
+	}
+}
+
+} // namespace wivrn
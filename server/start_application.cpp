@@ -9,6 +9,7 @@
 #include "start_application.h"
 
 #include "driver/configuration.h"
+#include "utils/thread_policy.h"
 
 #include <filesystem>
 #include <iomanip>
@@ -221,6 +222,9 @@ pid_t wivrn::fork_application()
 		// application can be signaled
 		setpgrp();
 
+		// Keep the application away from the CPUs reserved for pipeline threads
+		isolate_application(config);
+
 		return exec_application(config);
 	}
 
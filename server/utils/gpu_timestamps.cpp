@@ -0,0 +1,91 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "gpu_timestamps.h"
+
+#include "utils/wivrn_vk_bundle.h"
+#include "vk/vk_helpers.h"
+
+#include "util/u_logging.h"
+
+#include <cassert>
+
+namespace wivrn
+{
+gpu_timestamps::gpu_timestamps(wivrn_vk_bundle & vk, uint32_t queue_family_index, uint32_t count) :
+        vk(vk),
+        count(count),
+        synchronization2(vk.vk.features.synchronization_2)
+{
+	if (not vk.vk.has_EXT_calibrated_timestamps)
+		return;
+
+	auto families = vk.physical_device.getQueueFamilyProperties();
+	if (queue_family_index >= families.size() or families[queue_family_index].timestampValidBits == 0)
+	{
+		U_LOG_D("Queue family %d does not support timestamps", queue_family_index);
+		return;
+	}
+
+	pool = vk.device.createQueryPool({
+	        .queryType = vk::QueryType::eTimestamp,
+	        .queryCount = count,
+	});
+}
+
+void gpu_timestamps::reset(vk::raii::CommandBuffer & cmd)
+{
+	if (not *pool)
+		return;
+
+	cmd.resetQueryPool(*pool, 0, count);
+	pending = true;
+}
+
+void gpu_timestamps::write(vk::raii::CommandBuffer & cmd, vk::PipelineStageFlags2 stage, uint32_t query)
+{
+	if (not *pool)
+		return;
+
+	assert(query < count);
+	if (synchronization2)
+		cmd.writeTimestamp2(stage, *pool, query);
+	else
+	{
+		// Synchronization 1 stages have the same values as the first 32 bits of synchronization 2 stages
+		assert((VkPipelineStageFlags2(stage) >> 32) == 0);
+		cmd.writeTimestamp(vk::PipelineStageFlagBits(VkPipelineStageFlags2(stage)), *pool, query);
+	}
+}
+
+std::vector<int64_t> gpu_timestamps::read()
+{
+	if (not pending)
+		return {};
+
+	auto [res, timestamps] = pool.getResults<uint64_t>(0, count, count * sizeof(uint64_t), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+	if (res != vk::Result::eSuccess)
+		return {};
+	pending = false;
+
+	if (vk_convert_timestamps_to_host_ns(&vk.vk, count, timestamps.data()) != VK_SUCCESS)
+		return {};
+
+	return {timestamps.begin(), timestamps.end()};
+}
+} // namespace wivrn
@@ -0,0 +1,58 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan_raii.hpp>
+
+namespace wivrn
+{
+struct wivrn_vk_bundle;
+
+// Timestamp queries recorded in a command buffer, converted to the
+// os_monotonic_get_ns clock when read back.
+// All operations are no-ops if the queue family does not support timestamps
+// or VK_EXT_calibrated_timestamps is not available.
+class gpu_timestamps
+{
+	wivrn_vk_bundle & vk;
+	vk::raii::QueryPool pool = nullptr;
+	uint32_t count;
+	bool pending = false;
+	bool synchronization2;
+
+public:
+	gpu_timestamps(wivrn_vk_bundle & vk, uint32_t queue_family_index, uint32_t count);
+
+	explicit operator bool() const
+	{
+		return *pool;
+	}
+
+	// Must be recorded before any write, outside of a render pass
+	void reset(vk::raii::CommandBuffer & cmd);
+	// stage must also be a valid synchronization 1 stage when synchronization2 is not enabled
+	void write(vk::raii::CommandBuffer & cmd, vk::PipelineStageFlags2 stage, uint32_t query);
+
+	// Returns all the timestamps written since the last reset, once the command
+	// buffer has completed, or an empty vector if they are not available
+	std::vector<int64_t> read();
+};
+} // namespace wivrn
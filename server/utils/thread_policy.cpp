@@ -0,0 +1,224 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "thread_policy.h"
+
+#include "driver/configuration.h"
+#include "util/u_logging.h"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fnmatch.h>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace
+{
+struct registered_thread
+{
+	std::string name;
+	uint64_t wait_ns = 0;
+	uint64_t timeslices = 0;
+};
+
+std::mutex registry_mutex;
+std::map<pid_t, registered_thread> registry;
+
+struct registration
+{
+	pid_t tid;
+
+	registration(pid_t tid, const std::string & name) :
+	        tid(tid)
+	{
+		std::lock_guard lock(registry_mutex);
+		registry[tid] = {.name = name};
+	}
+
+	~registration()
+	{
+		std::lock_guard lock(registry_mutex);
+		registry.erase(tid);
+	}
+};
+
+thread_local std::optional<registration> current_thread;
+
+using thread_policies = decltype(wivrn::configuration::threads);
+
+// Threads are started throughout the session, read the configuration only once
+const thread_policies & cached_policies()
+{
+	static const thread_policies policies = wivrn::configuration::read_user_configuration().threads;
+	return policies;
+}
+
+const wivrn::configuration::thread_policy * find_policy(const thread_policies & policies, const std::string & name)
+{
+	if (auto it = policies.find(name); it != policies.end())
+		return &it->second;
+
+	for (const auto & [pattern, policy]: policies)
+	{
+		if (fnmatch(pattern.c_str(), name.c_str(), 0) == 0)
+			return &policy;
+	}
+
+	return nullptr;
+}
+
+const char * permission_hint(int err)
+{
+	if (err == EPERM)
+		return " (CAP_SYS_NICE or a higher RLIMIT_RTPRIO/RLIMIT_NICE is required)";
+	return "";
+}
+
+// Fields are the time spent on the CPU, the time spent waiting on a run queue and the number of timeslices
+std::optional<std::array<uint64_t, 3>> read_schedstat(pid_t tid)
+{
+	std::ifstream file("/proc/self/task/" + std::to_string(tid) + "/schedstat");
+	std::array<uint64_t, 3> result;
+	if (file >> result[0] >> result[1] >> result[2])
+		return result;
+	return std::nullopt;
+}
+} // namespace
+
+void wivrn::set_thread_policy(const std::string & name)
+{
+	pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+	pid_t tid = gettid();
+	current_thread.emplace(tid, name);
+	if (auto stats = read_schedstat(tid))
+	{
+		std::lock_guard lock(registry_mutex);
+		registry[tid].wait_ns = (*stats)[1];
+		registry[tid].timeslices = (*stats)[2];
+	}
+
+	auto policy = find_policy(cached_policies(), name);
+	if (not policy)
+		return;
+
+	if (not policy->cpus.empty())
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for (int cpu: policy->cpus)
+			CPU_SET(cpu, &cpus);
+
+		if (int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+			U_LOG_W("Failed to set CPU affinity of thread %s: %s", name.c_str(), strerror(err));
+	}
+
+	if (policy->scheduler)
+	{
+		sched_param param{.sched_priority = policy->priority.value_or(0)};
+
+		// Do not let processes started from this thread inherit a real-time priority
+		if (sched_setscheduler(0, *policy->scheduler | SCHED_RESET_ON_FORK, &param) < 0)
+		{
+			int err = errno;
+			U_LOG_W("Failed to set scheduler of thread %s: %s%s", name.c_str(), strerror(err), permission_hint(err));
+		}
+	}
+
+	if (policy->nice)
+	{
+		if (setpriority(PRIO_PROCESS, tid, *policy->nice) < 0)
+		{
+			int err = errno;
+			U_LOG_W("Failed to set nice value of thread %s: %s%s", name.c_str(), strerror(err), permission_hint(err));
+		}
+	}
+
+	sched_param param{};
+	sched_getparam(0, &param);
+	U_LOG_I("Thread %s: scheduler %d, priority %d, nice %d",
+	        name.c_str(),
+	        sched_getscheduler(0) & ~SCHED_RESET_ON_FORK,
+	        param.sched_priority,
+	        getpriority(PRIO_PROCESS, tid));
+}
+
+void wivrn::isolate_application(const configuration & config)
+{
+	if (not config.isolate_application)
+		return;
+
+	cpu_set_t cpus;
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) < 0)
+		return;
+
+	int reserved = 0;
+	for (const auto & [name, policy]: config.threads)
+	{
+		for (int cpu: policy.cpus)
+		{
+			if (CPU_ISSET(cpu, &cpus))
+			{
+				CPU_CLR(cpu, &cpus);
+				reserved++;
+			}
+		}
+	}
+
+	if (reserved == 0)
+		return;
+
+	if (CPU_COUNT(&cpus) == 0)
+	{
+		U_LOG_W("All CPUs are reserved for pipeline threads, not isolating application");
+		return;
+	}
+
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+		U_LOG_W("Failed to set CPU affinity of application: %s", strerror(errno));
+}
+
+std::vector<wivrn::thread_latency> wivrn::run_queue_latency()
+{
+	std::lock_guard lock(registry_mutex);
+
+	std::vector<thread_latency> result;
+	result.reserve(registry.size());
+	for (auto & [tid, thread]: registry)
+	{
+		auto stats = read_schedstat(tid);
+		if (not stats)
+			continue;
+
+		result.push_back({
+		        .name = thread.name,
+		        .wait_ns = (*stats)[1] - thread.wait_ns,
+		        .timeslices = (*stats)[2] - thread.timeslices,
+		});
+		thread.wait_ns = (*stats)[1];
+		thread.timeslices = (*stats)[2];
+	}
+	return result;
+}
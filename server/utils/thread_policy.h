@@ -0,0 +1,50 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace wivrn
+{
+struct configuration;
+
+// Names the calling thread and applies the scheduler, priority, nice value
+// and CPU affinity configured for that name in the "threads" section.
+// The configuration is read on the first call and kept for the process.
+// The thread is then included in run_queue_latency until it exits.
+void set_thread_policy(const std::string & name);
+
+// Restricts the calling process to the CPUs which are not reserved for
+// pipeline threads, if isolate_application is set.
+void isolate_application(const configuration &);
+
+struct thread_latency
+{
+	std::string name;
+	// Time spent runnable but waiting for a CPU, since the previous call
+	uint64_t wait_ns;
+	// Number of times the thread was scheduled, since the previous call
+	uint64_t timeslices;
+};
+
+// Reads the scheduler statistics of the threads registered with set_thread_policy
+std::vector<thread_latency> run_queue_latency();
+} // namespace wivrn
@@ -0,0 +1,48 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// Unlike assert, also checked in release builds
+#define CHECK(condition)                                                                           \
+	do                                                                                         \
+	{                                                                                          \
+		if (not(condition))                                                                \
+		{                                                                                  \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			std::abort();                                                              \
+		}                                                                                  \
+	} while (false)
+
+#define CHECK_THROWS(expression, exception_type)                                               \
+	do                                                                                         \
+	{                                                                                          \
+		bool thrown = false;                                                               \
+		try                                                                                \
+		{                                                                                  \
+			expression;                                                                \
+		}                                                                                  \
+		catch (exception_type &)                                                           \
+		{                                                                                  \
+			thrown = true;                                                             \
+		}                                                                                  \
+		CHECK(thrown);                                                                     \
+	} while (false)
@@ -0,0 +1,241 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "check.h"
+#include "utils/happy_eyeballs.h"
+
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+in_addr loopback(const char * address)
+{
+	in_addr result;
+	inet_pton(AF_INET, address, &result);
+	return result;
+}
+
+int listen_on(in_addr address, int port, int backlog)
+{
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	CHECK(fd >= 0);
+
+	sockaddr_in sa{
+	        .sin_family = AF_INET,
+	        .sin_port = htons(port),
+	        .sin_addr = address,
+	};
+	CHECK(bind(fd, (sockaddr *)&sa, sizeof(sa)) == 0);
+	CHECK(listen(fd, backlog) == 0);
+	return fd;
+}
+
+int port_of(int fd)
+{
+	sockaddr_in sa;
+	socklen_t len = sizeof(sa);
+	CHECK(getsockname(fd, (sockaddr *)&sa, &len) == 0);
+	return ntohs(sa.sin_port);
+}
+
+// A listener whose accept queue is full: connection attempts neither succeed nor fail
+// until they time out, like a black-holed address
+struct unresponsive_listener
+{
+	int fd;
+	int filler;
+
+	unresponsive_listener(in_addr address, int port)
+	{
+		fd = listen_on(address, port, 0);
+		filler = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		sockaddr_in sa{
+		        .sin_family = AF_INET,
+		        .sin_port = htons(port_of(fd)),
+		        .sin_addr = address,
+		};
+		CHECK(connect(filler, (sockaddr *)&sa, sizeof(sa)) == 0);
+	}
+
+	~unresponsive_listener()
+	{
+		::close(filler);
+		::close(fd);
+	}
+};
+
+bool is(const utils::ip_address & address, const char * expected)
+{
+	return utils::to_string(address) == expected;
+}
+
+template <typename F>
+std::chrono::steady_clock::duration time(F && f)
+{
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::steady_clock::now() - start;
+}
+
+// The second address is tried after connection_attempt_delay while the first one is still pending
+void test_race()
+{
+	int server = listen_on(loopback("127.0.0.1"), 0, 16);
+	int port = port_of(server);
+	unresponsive_listener unresponsive(loopback("127.0.0.2"), port);
+
+	utils::connection c;
+	auto duration = time([&]() {
+		c = utils::happy_eyeballs({loopback("127.0.0.2"), loopback("127.0.0.1")}, port);
+	});
+
+	CHECK(is(c.address, "127.0.0.1"));
+	CHECK(duration >= utils::connection_attempt_delay);
+	CHECK(duration < utils::connection_attempt_delay + 1s);
+
+	::close(c.fd);
+	::close(server);
+}
+
+// A refused connection starts the next attempt without waiting for the delay
+void test_fallback_on_failure()
+{
+	int server = listen_on(loopback("127.0.0.1"), 0, 16);
+	int port = port_of(server);
+
+	utils::connection c;
+	auto duration = time([&]() {
+		c = utils::happy_eyeballs({loopback("127.0.0.3"), loopback("127.0.0.1")}, port);
+	});
+
+	CHECK(is(c.address, "127.0.0.1"));
+	CHECK(duration < utils::connection_attempt_delay);
+
+	::close(c.fd);
+	::close(server);
+}
+
+// Resolved addresses join the race when they become available
+void test_resolved_later()
+{
+	int server = listen_on(loopback("127.0.0.1"), 0, 16);
+	int port = port_of(server);
+
+	std::promise<std::vector<utils::ip_address>> promise;
+	std::jthread resolver([&]() {
+		std::this_thread::sleep_for(50ms);
+		promise.set_value({loopback("127.0.0.1")});
+	});
+
+	auto c = utils::happy_eyeballs({loopback("127.0.0.3")}, port, promise.get_future());
+	CHECK(is(c.address, "127.0.0.1"));
+
+	::close(c.fd);
+	::close(server);
+}
+
+// The resolution error is reported when no address was available
+void test_resolution_error()
+{
+	std::promise<std::vector<utils::ip_address>> promise;
+	promise.set_exception(std::make_exception_ptr(std::runtime_error("resolution failed")));
+
+	bool thrown = false;
+	try
+	{
+		utils::happy_eyeballs({}, 1, promise.get_future());
+	}
+	catch (utils::connection_error &)
+	{
+		CHECK(false);
+	}
+	catch (std::runtime_error & e)
+	{
+		thrown = std::string(e.what()) == "resolution failed";
+	}
+	CHECK(thrown);
+}
+
+// Duplicate addresses are only tried once, all failures are reported
+void test_all_refused()
+{
+	int server = listen_on(loopback("127.0.0.1"), 0, 16);
+	int port = port_of(server);
+	::close(server);
+
+	try
+	{
+		utils::happy_eyeballs({loopback("127.0.0.1"), loopback("127.0.0.3"), loopback("127.0.0.1")}, port);
+		CHECK(false);
+	}
+	catch (utils::connection_error & e)
+	{
+		CHECK(e.errors.size() == 2);
+	}
+}
+
+void test_timeout()
+{
+	unresponsive_listener unresponsive(loopback("127.0.0.2"), 0);
+
+	auto duration = time([&]() {
+		CHECK_THROWS(utils::happy_eyeballs({loopback("127.0.0.2")}, port_of(unresponsive.fd), {}, 300ms), utils::connection_error);
+	});
+
+	CHECK(duration >= 300ms);
+	CHECK(duration < 2s);
+}
+
+// The scope id survives the round trip through the configuration file
+void test_scope_id()
+{
+	unsigned int lo = if_nametoindex("lo");
+	CHECK(lo != 0);
+
+	auto address = utils::parse_ip_address("fe80::1%" + std::to_string(lo));
+	CHECK(address);
+	CHECK(std::get<sockaddr_in6>(*address).sin6_scope_id == lo);
+	CHECK(is(*address, "fe80::1%lo"));
+
+	auto parsed = utils::parse_ip_address(utils::to_string(*address));
+	CHECK(parsed);
+	CHECK(std::get<sockaddr_in6>(*parsed).sin6_scope_id == lo);
+
+	CHECK(is(*utils::parse_ip_address("::1"), "::1"));
+	CHECK(is(*utils::parse_ip_address("192.168.1.1"), "192.168.1.1"));
+	CHECK(not utils::parse_ip_address(""));
+	CHECK(not utils::parse_ip_address("not an address"));
+}
+} // namespace
+
+int main()
+{
+	test_race();
+	test_fallback_on_failure();
+	test_resolved_later();
+	test_resolution_error();
+	test_all_refused();
+	test_timeout();
+	test_scope_id();
+}
@@ -0,0 +1,211 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "check.h"
+#include "utils/mpmc_queue.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using utils::mpmc_queue;
+using utils::overflow_policy;
+
+namespace
+{
+void test_fifo()
+{
+	mpmc_queue<int, 8> queue;
+	CHECK(not queue.try_pop());
+
+	for (int i = 0; i < 20; ++i)
+	{
+		CHECK(queue.push(i));
+		CHECK(queue.push(i + 100));
+		CHECK(queue.size() == 2);
+		CHECK(queue.pop() == i);
+		CHECK(*queue.try_pop() == i + 100);
+	}
+	CHECK(queue.size() == 0);
+	CHECK(not queue.try_pop());
+	CHECK(queue.get_stats().max_depth == 2);
+}
+
+void test_move_only()
+{
+	mpmc_queue<std::unique_ptr<int>, 2> queue;
+	CHECK(queue.push(std::make_unique<int>(42)));
+	auto item = queue.pop();
+	CHECK(item and *item == 42);
+}
+
+void test_reject()
+{
+	mpmc_queue<int, 4, overflow_policy::reject> queue;
+	for (int i = 0; i < 4; ++i)
+		CHECK(queue.push(i));
+	CHECK(not queue.push(4));
+	CHECK(not queue.push(5));
+
+	auto stats = queue.get_stats();
+	CHECK(stats.depth == 4);
+	CHECK(stats.max_depth == 4);
+	CHECK(stats.dropped == 2);
+
+	for (int i = 0; i < 4; ++i)
+		CHECK(queue.pop() == i);
+	CHECK(queue.push(6));
+	CHECK(queue.pop() == 6);
+}
+
+void test_drop_oldest()
+{
+	mpmc_queue<int, 4, overflow_policy::drop_oldest> queue;
+	for (int i = 0; i < 7; ++i)
+		CHECK(queue.push(i));
+
+	CHECK(queue.get_stats().dropped == 3);
+	for (int i = 3; i < 7; ++i)
+		CHECK(queue.pop() == i);
+	CHECK(not queue.try_pop());
+}
+
+// A full queue blocks the producer until a consumer makes room
+void test_block()
+{
+	mpmc_queue<int, 2> queue;
+	CHECK(queue.push(0));
+	CHECK(queue.push(1));
+
+	std::atomic<bool> pushed = false;
+	std::jthread producer([&]() {
+		CHECK(queue.push(2));
+		pushed = true;
+	});
+
+	std::this_thread::sleep_for(50ms);
+	CHECK(not pushed);
+	CHECK(queue.pop() == 0);
+	producer.join();
+	CHECK(pushed);
+
+	CHECK(queue.pop() == 1);
+	CHECK(queue.pop() == 2);
+	auto stats = queue.get_stats();
+	CHECK(stats.waits >= 1);
+	CHECK(stats.wait_ns > 0);
+	CHECK(stats.dropped == 0);
+}
+
+// close wakes up blocked consumers and producers
+void test_close()
+{
+	mpmc_queue<int, 2> empty;
+	std::jthread consumer([&]() { CHECK_THROWS(empty.pop(), utils::queue_closed); });
+
+	mpmc_queue<int, 2> full;
+	CHECK(full.push(0));
+	CHECK(full.push(1));
+	std::jthread producer([&]() { CHECK(not full.push(2)); });
+
+	std::this_thread::sleep_for(50ms);
+	empty.close();
+	full.close();
+	consumer.join();
+	producer.join();
+
+	CHECK(not empty.push(0));
+	CHECK_THROWS(full.pop(), utils::queue_closed);
+}
+
+// Every item is received exactly once, and items from one producer stay in order
+void test_concurrent()
+{
+	const int producers = 4;
+	const int consumers = 4;
+	const int items = 100'000;
+
+	mpmc_queue<std::pair<int, int>, 64> queue;
+	std::vector<std::vector<std::pair<int, int>>> received(consumers);
+	std::atomic<int> remaining = producers * items;
+
+	{
+		std::vector<std::jthread> threads;
+		for (int c = 0; c < consumers; ++c)
+		{
+			threads.emplace_back([&, c]() {
+				try
+				{
+					while (true)
+						received[c].push_back(queue.pop());
+				}
+				catch (utils::queue_closed &)
+				{
+				}
+			});
+		}
+		for (int p = 0; p < producers; ++p)
+		{
+			threads.emplace_back([&, p]() {
+				for (int i = 0; i < items; ++i)
+					CHECK(queue.push({p, i}));
+				if (remaining.fetch_sub(items) == items)
+				{
+					// Last producer: wait for the consumers to empty the queue
+					while (queue.size())
+						std::this_thread::yield();
+					queue.close();
+				}
+			});
+		}
+	}
+
+	std::vector<std::vector<bool>> seen(producers, std::vector<bool>(items));
+	size_t total = 0;
+	for (const auto & items_c: received)
+	{
+		std::vector<int> last(producers, -1);
+		for (auto [p, i]: items_c)
+		{
+			CHECK(not seen[p][i]);
+			seen[p][i] = true;
+			CHECK(i > last[p]);
+			last[p] = i;
+		}
+		total += items_c.size();
+	}
+	CHECK(total == producers * items);
+
+	auto stats = queue.get_stats();
+	CHECK(stats.dropped == 0);
+	CHECK(stats.max_depth <= 64);
+}
+} // namespace
+
+int main()
+{
+	test_fifo();
+	test_move_only();
+	test_reject();
+	test_drop_oldest();
+	test_block();
+	test_close();
+	test_concurrent();
+}
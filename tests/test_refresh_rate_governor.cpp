@@ -0,0 +1,206 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "check.h"
+#include "refresh_rate_governor.h"
+
+#include <vector>
+
+using wivrn::refresh_rate_governor;
+
+namespace
+{
+// Timings of one second of streaming
+struct window
+{
+	// Fraction of frames without a new application frame
+	float app_missed = 0;
+	// Encoding time of each frame
+	float encode_ms = 0;
+	// Fraction of frames not decoded by the headset
+	float lost = 0;
+	// Number of frames, the refresh rate when 0
+	int frames = 0;
+};
+
+window overloaded{.encode_ms = 11};
+window idle{.encode_ms = 4};
+
+// Replays a trace of timings, one window per second at the current refresh rate
+struct replay
+{
+	refresh_rate_governor governor;
+	int64_t now_ns = 1'000'000'000;
+
+	replay(std::vector<float> available, float max, float min = 0) :
+	        governor(std::move(available), max, min)
+	{
+		governor.update(now_ns);
+	}
+
+	// Returns the refresh rate after each window
+	std::vector<float> operator()(const std::vector<window> & trace)
+	{
+		std::vector<float> rates;
+		for (const auto & w: trace)
+		{
+			int frames = w.frames ? w.frames : governor.refresh_rate();
+			for (int i = 0; i < frames; ++i)
+			{
+				governor.on_app_frame(i >= frames * w.app_missed);
+				governor.on_encode(0, w.encode_ms * 1'000'000);
+				governor.on_feedback(i >= frames * w.lost);
+			}
+			now_ns += 1'000'000'000;
+			governor.update(now_ns);
+			rates.push_back(governor.refresh_rate());
+		}
+		return rates;
+	}
+
+	std::vector<float> operator()(window w, int count)
+	{
+		return (*this)(std::vector<window>(count, w));
+	}
+};
+
+// Number of windows until the refresh rate changes
+int windows_until_change(replay & r, window w, int max_windows = 200)
+{
+	float initial = r.governor.refresh_rate();
+	for (int i = 1; i <= max_windows; ++i)
+	{
+		if (r(w, 1).back() != initial)
+			return i;
+	}
+	return -1;
+}
+
+// The first window after a change is discarded, two overloaded windows step down
+void test_step_down()
+{
+	replay r({72, 80, 90, 120}, 90);
+	CHECK(r.governor);
+	CHECK(r.governor.refresh_rate() == 90);
+
+	// 11ms per frame is too much at 90 and 80Hz, fits at 72Hz
+	auto rates = r(overloaded, 8);
+	CHECK((rates == std::vector<float>{90, 90, 80, 80, 80, 72, 72, 72}));
+}
+
+void test_step_down_on_app_and_network()
+{
+	replay app({72, 90}, 90);
+	CHECK((app({.app_missed = 0.3}, 3) == std::vector<float>{90, 90, 72}));
+
+	replay network({72, 90}, 90);
+	CHECK((network({.lost = 0.2}, 3) == std::vector<float>{90, 90, 72}));
+}
+
+void test_stable()
+{
+	replay r({72, 80, 90}, 90);
+	auto rates = r(idle, 20);
+	CHECK((rates == std::vector<float>(20, 90)));
+}
+
+// Stepping up requires the load scaled to the next refresh rate to be low
+void test_step_up()
+{
+	replay r({72, 90}, 90);
+	r(overloaded, 3);
+	CHECK(r.governor.refresh_rate() == 72);
+
+	// 6ms is 0.43 at 72Hz but 0.54 at 90Hz: fits
+	CHECK(windows_until_change(r, {.encode_ms = 6}) == 6);
+	CHECK(r.governor.refresh_rate() == 90);
+
+	// 7.5ms is 0.54 at 72Hz, 0.68 at 90Hz: would not be idle after stepping up
+	replay busy({72, 90}, 90);
+	busy(overloaded, 3);
+	CHECK(windows_until_change(busy, {.encode_ms = 7.5}, 50) == -1);
+	CHECK(busy.governor.refresh_rate() == 72);
+}
+
+// A step up that immediately overloads doubles the idle time required for the next one
+void test_back_off()
+{
+	replay r({72, 90}, 90);
+	r(overloaded, 3);
+	CHECK(windows_until_change(r, idle) == 6);
+
+	CHECK(windows_until_change(r, overloaded) == 3);
+	CHECK(r.governor.refresh_rate() == 72);
+	CHECK(windows_until_change(r, idle) == 11);
+
+	CHECK(windows_until_change(r, overloaded) == 3);
+	CHECK(windows_until_change(r, idle) == 21);
+}
+
+void test_limits()
+{
+	// Never below the minimum
+	replay min({60, 72, 80, 90}, 90, 72);
+	auto rates = min(overloaded, 20);
+	CHECK(rates.back() == 72);
+
+	// The user selected refresh rate is the maximum, even if not advertised
+	replay max({72, 90}, 80);
+	CHECK(max.governor.refresh_rate() == 80);
+	CHECK(max(idle, 20).back() == 80);
+	CHECK(max(overloaded, 3).back() == 72);
+
+	// Nothing to choose from
+	replay disabled({}, 90);
+	CHECK(not disabled.governor);
+	CHECK(disabled(overloaded, 10).back() == 90);
+}
+
+// Windows with too few frames, such as when the application is paused, are ignored
+void test_few_frames()
+{
+	replay r({72, 90}, 90);
+	auto rates = r({.encode_ms = 11, .frames = 5}, 10);
+	CHECK((rates == std::vector<float>(10, 90)));
+}
+
+void test_reset()
+{
+	replay r({72, 80, 90}, 90);
+	r(overloaded, 6);
+	CHECK(r.governor.refresh_rate() == 72);
+
+	r.governor.reset();
+	CHECK(r.governor.refresh_rate() == 90);
+	r.now_ns += 1'000'000'000;
+	r.governor.update(r.now_ns);
+	CHECK((r(overloaded, 3) == std::vector<float>{90, 90, 80}));
+}
+} // namespace
+
+int main()
+{
+	test_step_down();
+	test_step_down_on_app_and_network();
+	test_stable();
+	test_step_up();
+	test_back_off();
+	test_limits();
+	test_few_frames();
+	test_reset();
+}
@@ -0,0 +1,180 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "check.h"
+#include "utils/ring_buffer.h"
+
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace
+{
+void test_single()
+{
+	utils::ring_buffer<int, 4> buffer;
+	CHECK(not buffer.read());
+	CHECK(buffer.size() == 0);
+
+	for (int i = 0; i < 4; ++i)
+		CHECK(buffer.write(int(i)));
+	CHECK(not buffer.write(4));
+	CHECK(buffer.size() == 4);
+
+	for (int i = 0; i < 4; ++i)
+		CHECK(buffer.read() == i);
+	CHECK(not buffer.read());
+	CHECK(buffer.size() == 0);
+}
+
+// Batches wrap around the end of the container
+void test_batch_wrap_around()
+{
+	utils::ring_buffer<int, 8> buffer;
+	std::vector<int> out(8);
+	int next_write = 0;
+	int next_read = 0;
+
+	// Every start position, with batches which do and do not cross the end
+	for (int round = 0; round < 16; ++round)
+	{
+		size_t count = 1 + round % 7;
+		std::vector<int> in(count);
+		std::iota(in.begin(), in.end(), next_write);
+		CHECK(buffer.write_n(in) == count);
+		next_write += count;
+
+		CHECK(buffer.read_n(std::span(out).first(count)) == count);
+		for (size_t i = 0; i < count; ++i)
+			CHECK(out[i] == next_read++);
+		CHECK(buffer.size() == 0);
+	}
+}
+
+// Batches are truncated to the available space or elements
+void test_batch_partial()
+{
+	utils::ring_buffer<int, 8> buffer;
+	std::vector<int> in(10);
+	std::iota(in.begin(), in.end(), 0);
+
+	CHECK(buffer.write_n(std::span(in).first(5)) == 5);
+	CHECK(buffer.write_n(std::span(in).subspan(5)) == 3);
+	CHECK(buffer.size() == 8);
+	CHECK(buffer.write_n(in) == 0);
+
+	std::vector<int> out(10);
+	CHECK(buffer.read_n(std::span(out).first(3)) == 3);
+	CHECK(buffer.write_n(std::span(in).subspan(8)) == 2);
+	CHECK(buffer.read_n(out) == 7);
+	for (int i = 0; i < 7; ++i)
+		CHECK(out[i] == i + 3);
+	CHECK(buffer.read_n(out) == 0);
+}
+
+void test_skip()
+{
+	utils::ring_buffer<int, 8> buffer;
+	for (int i = 0; i < 6; ++i)
+		CHECK(buffer.write(int(i)));
+
+	CHECK(buffer.skip(2) == 2);
+	CHECK(buffer.read() == 2);
+	CHECK(buffer.skip(10) == 3);
+	CHECK(buffer.size() == 0);
+	CHECK(buffer.skip(1) == 0);
+
+	CHECK(buffer.write(6));
+	CHECK(buffer.read() == 6);
+}
+
+// The reader sees the elements in order while the writer and the reader mix
+// single and batch operations
+void test_concurrent()
+{
+	const int elements = 2'000'000;
+	utils::ring_buffer<int, 256> buffer;
+
+	std::jthread writer([&]() {
+		std::vector<int> batch(100);
+		int next = 0;
+		while (next < elements)
+		{
+			int previous = next;
+			if (next % 3 == 0)
+			{
+				if (buffer.write(int(next)))
+					++next;
+			}
+			else
+			{
+				size_t count = std::min<size_t>(1 + next % batch.size(), elements - next);
+				std::iota(batch.begin(), batch.begin() + count, next);
+				next += buffer.write_n(std::span(batch).first(count));
+			}
+			if (next == previous)
+				std::this_thread::yield();
+		}
+	});
+
+	std::vector<int> batch(64);
+	int next = 0;
+	int skipped = 0;
+	while (next < elements)
+	{
+		int previous = next;
+		switch (next % 5)
+		{
+			case 0:
+				if (auto value = buffer.read())
+				{
+					CHECK(*value == next);
+					++next;
+				}
+				break;
+			case 1: {
+				size_t n = buffer.skip(2);
+				next += n;
+				skipped += n;
+				break;
+			}
+			default: {
+				size_t n = buffer.read_n(batch);
+				for (size_t i = 0; i < n; ++i)
+					CHECK(batch[i] == next++);
+			}
+		}
+		if (next == previous)
+			std::this_thread::yield();
+	}
+	writer.join();
+
+	CHECK(next == elements);
+	CHECK(skipped > 0);
+	CHECK(buffer.size() == 0);
+}
+} // namespace
+
+int main()
+{
+	test_single();
+	test_batch_wrap_around();
+	test_batch_partial();
+	test_skip();
+	test_concurrent();
+}
@@ -0,0 +1,311 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "check.h"
+#include "video_shards.h"
+#include "wivrn_sockets.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <poll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <variant>
+#include <vector>
+
+using wivrn::TCP;
+
+namespace
+{
+// Both ends of a loopback TCP connection
+struct connection
+{
+	TCP client;
+	TCP server;
+};
+
+connection connect_loopback()
+{
+	int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	CHECK(listener >= 0);
+
+	sockaddr_in sa{
+	        .sin_family = AF_INET,
+	        .sin_port = 0,
+	        .sin_addr = {htonl(INADDR_LOOPBACK)},
+	};
+	socklen_t len = sizeof(sa);
+	CHECK(bind(listener, (sockaddr *)&sa, sizeof(sa)) == 0);
+	CHECK(listen(listener, 1) == 0);
+	CHECK(getsockname(listener, (sockaddr *)&sa, &len) == 0);
+
+	TCP client(sa.sin_addr, ntohs(sa.sin_port));
+	int fd = accept(listener, nullptr, nullptr);
+	CHECK(fd >= 0);
+	::close(listener);
+
+	return {std::move(client), TCP(fd)};
+}
+
+// Waits for a complete message
+wivrn::deserialization_packet receive(TCP & socket)
+{
+	while (true)
+	{
+		if (auto packet = socket.receive_pending(); not packet.empty())
+			return packet;
+
+		pollfd fds{.fd = socket.get_fd(), .events = POLLIN};
+		CHECK(::poll(&fds, 1, 5000) == 1);
+		if (auto packet = socket.receive_raw(); not packet.empty())
+			return packet;
+	}
+}
+
+std::vector<uint8_t> make_data(size_t size, uint8_t first = 0)
+{
+	std::vector<uint8_t> data(size);
+	std::iota(data.begin(), data.end(), first);
+	return data;
+}
+
+bool equal(wivrn::deserialization_packet packet, const std::vector<uint8_t> & expected)
+{
+	std::vector<uint8_t> data(expected.size());
+	packet.read(data.data(), data.size());
+	return packet.empty() and data == expected;
+}
+
+// Raw bytes as they would appear on the wire: 32 bits size then the payload
+std::vector<uint8_t> frame(const std::vector<uint8_t> & payload)
+{
+	uint32_t size = payload.size();
+	std::vector<uint8_t> result(sizeof(size) + payload.size());
+	memcpy(result.data(), &size, sizeof(size));
+	std::ranges::copy(payload, result.begin() + sizeof(size));
+	return result;
+}
+
+void write_all(int fd, std::span<const uint8_t> data)
+{
+	while (not data.empty())
+	{
+		ssize_t sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+		CHECK(sent > 0);
+		data = data.subspan(sent);
+	}
+}
+
+// Messages larger than a 16 bits size, sent while the receiver drains the socket
+void test_large_messages()
+{
+	auto [client, server] = connect_loopback();
+	std::vector<std::vector<uint8_t>> messages{
+	        make_data(1),
+	        make_data(70'000, 1),
+	        make_data(1024 * 1024, 2),
+	        make_data(4 * 1024 * 1024, 3),
+	};
+
+	std::jthread sender([&]() {
+		for (auto & message: messages)
+			client.send_raw({std::span(message)});
+	});
+
+	for (const auto & message: messages)
+		CHECK(equal(receive(server), message));
+}
+
+// A message split across writes is only returned once complete, including
+// when the size itself is split
+void test_partial_writes()
+{
+	auto [client, server] = connect_loopback();
+	auto message = make_data(10'000);
+	auto bytes = frame(message);
+
+	for (size_t split: {size_t(2), size_t(4), size_t(5000)})
+	{
+		write_all(client.get_fd(), std::span(bytes).first(split));
+		pollfd fds{.fd = server.get_fd(), .events = POLLIN};
+		CHECK(::poll(&fds, 1, 5000) == 1);
+		CHECK(server.receive_raw().empty());
+		CHECK(server.receive_pending().empty());
+
+		write_all(client.get_fd(), std::span(bytes).subspan(split));
+		CHECK(equal(receive(server), message));
+	}
+}
+
+// Messages received in a single read are returned one by one
+void test_several_messages_per_read()
+{
+	auto [client, server] = connect_loopback();
+	std::vector<std::vector<uint8_t>> messages{make_data(10), make_data(3000, 1), make_data(1, 2)};
+
+	std::vector<uint8_t> bytes;
+	for (const auto & message: messages)
+	{
+		auto framed = frame(message);
+		bytes.insert(bytes.end(), framed.begin(), framed.end());
+	}
+	write_all(client.get_fd(), bytes);
+
+	// Wait for everything to be in the receive buffer
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	CHECK(equal(receive(server), messages[0]));
+	CHECK(equal(server.receive_pending(), messages[1]));
+	CHECK(equal(server.receive_pending(), messages[2]));
+	CHECK(server.receive_pending().empty());
+}
+
+void test_send_many()
+{
+	auto [client, server] = connect_loopback();
+	auto a = make_data(100);
+	auto b = make_data(80'000, 1);
+	std::vector<std::span<uint8_t>> message_a{std::span(a)};
+	// A message made of several spans
+	std::vector<std::span<uint8_t>> message_b{std::span(b).first(1000), std::span(b).subspan(1000)};
+	std::vector<const std::vector<std::span<uint8_t>> *> messages{&message_a, &message_b};
+
+	std::jthread sender([&]() { client.send_many_raw(messages); });
+	CHECK(equal(receive(server), a));
+	CHECK(equal(receive(server), b));
+}
+
+// Corrupted sizes are rejected instead of allocating or waiting forever
+void test_invalid_sizes()
+{
+	for (uint32_t size: {uint32_t(0), uint32_t(4 * 1024 * 1024 + 1), uint32_t(0xffffffff)})
+	{
+		auto [client, server] = connect_loopback();
+		std::vector<uint8_t> bytes(sizeof(size) + 16);
+		memcpy(bytes.data(), &size, sizeof(size));
+		write_all(client.get_fd(), bytes);
+
+		CHECK_THROWS(receive(server), std::runtime_error);
+	}
+}
+
+struct shard
+{
+	std::vector<uint8_t> payload;
+	bool last;
+};
+
+std::vector<shard> split(std::span<uint8_t> data, size_t shard_size, size_t first_overhead)
+{
+	std::vector<shard> shards;
+	wivrn::split_shards(data, shard_size, first_overhead, [&](std::span<uint8_t> payload, bool last) {
+		shards.push_back({{payload.begin(), payload.end()}, last});
+	});
+	return shards;
+}
+
+// Shards are at most shard_size with the view information, and only the last
+// one is marked as such
+void test_split()
+{
+	auto data = make_data(5000);
+	auto shards = split(data, 1400, 300);
+	CHECK(shards.size() == 4);
+	CHECK(shards[0].payload.size() == 1100);
+	CHECK(shards[1].payload.size() == 1400);
+	CHECK(shards[2].payload.size() == 1400);
+	CHECK(shards[3].payload.size() == 1100);
+
+	std::vector<uint8_t> joined;
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		CHECK(shards[i].last == (i == shards.size() - 1));
+		joined.insert(joined.end(), shards[i].payload.begin(), shards[i].payload.end());
+	}
+	CHECK(joined == data);
+
+	// Exact multiple: no empty shard at the end
+	auto exact = make_data(2800);
+	shards = split(exact, 1400, 0);
+	CHECK(shards.size() == 2);
+	CHECK(shards[1].payload.size() == 1400);
+	CHECK(shards[1].last);
+
+	// Small slice
+	auto small = make_data(10);
+	shards = split(small, 1400, 300);
+	CHECK(shards.size() == 1);
+	CHECK(shards[0].payload.size() == 10);
+	CHECK(shards[0].last);
+
+	CHECK(split({}, 1400, 300).empty());
+}
+
+// TCP only chunks round trip through a typed socket: their payload fits the
+// 16 bits size of serialized spans
+void test_tcp_chunks()
+{
+	const size_t max_tcp_payload_size = 60 * 1024;
+	using span_socket = wivrn::typed_socket<TCP, std::variant<std::span<uint8_t>>, std::variant<std::span<uint8_t>>>;
+
+	auto [client_socket, server_socket] = connect_loopback();
+	span_socket client(std::move(client_socket));
+	span_socket server(std::move(server_socket));
+
+	auto data = make_data(200 * 1024);
+	auto shards = split(data, max_tcp_payload_size, 0);
+	CHECK(shards.size() == 4);
+
+	std::jthread sender([&]() {
+		for (auto & s: shards)
+		{
+			CHECK(s.payload.size() <= std::numeric_limits<uint16_t>::max());
+			client.send(std::span(s.payload));
+		}
+	});
+
+	for (const auto & s: shards)
+	{
+		std::optional<std::variant<std::span<uint8_t>>> received;
+		while (not received)
+		{
+			received = server.receive_pending();
+			if (received)
+				break;
+			pollfd fds{.fd = server.get_fd(), .events = POLLIN};
+			CHECK(::poll(&fds, 1, 5000) == 1);
+			received = server.receive();
+		}
+		CHECK(std::ranges::equal(std::get<0>(*received), s.payload));
+	}
+}
+} // namespace
+
+int main()
+{
+	test_large_messages();
+	test_partial_writes();
+	test_several_messages_per_read();
+	test_send_many();
+	test_invalid_sizes();
+	test_split();
+	test_tcp_chunks();
+}
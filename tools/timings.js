@@ -153,6 +153,21 @@ function draw_frame(svg, frame_id, frame_data, t_offset, t_scale, line_height, l
 	compositor.setAttribute('class', 'compositor');
 	g.appendChild(compositor);
 
+	if (("gpu_render_begin" in frame_data["global"]) && ("gpu_render_end" in frame_data["global"]))
+	{
+		const gpu_begin = frame_data["global"]["gpu_render_begin"];
+		const gpu_end = frame_data["global"]["gpu_render_end"];
+
+		let gpu = document.createElementNS("http://www.w3.org/2000/svg", 'rect');
+		gpu.setAttribute('x', gpu_begin * t_scale);
+		gpu.setAttribute('y', line_height * 0.2);
+		gpu.setAttribute('width', (gpu_end - gpu_begin) * t_scale);
+		gpu.setAttribute('height', line_height * 0.6);
+		gpu.setAttribute('fill', colours[2]);
+		gpu.setAttribute('class', 'gpu');
+		g.appendChild(gpu);
+	}
+
 	var text = document.createElementNS("http://www.w3.org/2000/svg", 'text');
 	text.setAttribute('x', wake_up * t_scale);
 	text.setAttribute('y', line_height / 2);